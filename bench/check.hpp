@@ -0,0 +1,74 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Helpers of the check programs in bench/.
+ *
+ * A check program runs a series of checks, reports each failed one on 
+ * stderr and exits with status 1 if any check failed.
+ */
+
+#ifndef _BENCH_CHECK_H_
+#define _BENCH_CHECK_H_
+
+#include <cstdio>
+
+namespace
+{
+    /**
+     * \brief The number of failed checks.
+     */
+    int failed_checks = 0;
+
+    /**
+     * \brief The number of checks run.
+     */
+    int run_checks = 0;
+
+    /**
+     * \brief Check a condition and report it if it does not hold.
+     *
+     * \param condition The result of the check.
+     *
+     * \param what A description of the check.
+     */
+    void check(bool condition, const char* what)
+    {
+        run_checks++;
+        if( ! condition )
+        {
+            fprintf(stderr, "FAILED: %s\n", what);
+            failed_checks++;
+        }
+    }
+
+    /**
+     * \brief Print the summary of the checks.
+     *
+     * \return The exit status of the program.
+     */
+    int check_summary(const char* program)
+    {
+        printf("%s: %d checks, %d failed\n",
+               program, run_checks, failed_checks);
+        return (failed_checks == 0) ? 0 : 1;
+    }
+}
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Round-trip checks of the encoding and parsing of PDU's.
+ *
+ * OID's, varbinds and PDU's are serialized, parsed again and compared with 
+ * the original. The checks cover the prefix compression of OID's, the 
+ * error codes of the non-throwing parse path, the single-buffer encoding 
+ * of PDU's, the lazy decoding of TestSet and Notify varbinds from a 
+ * shared buffer and the pre-encoded names of varbinds.
+ *
+ * Usage: codec_check
+ *
+ * The program exits with status 1 if a check failed.
+ */
+
+#include <QCoreApplication>
+
+#include "check.hpp"
+#include "Oid.hpp"
+#include "OidVariable.hpp"
+#include "IntegerVariable.hpp"
+#include "OctetStringVariable.hpp"
+#include "Counter64Variable.hpp"
+#include "Varbind.hpp"
+#include "GetPDU.hpp"
+#include "GetNextPDU.hpp"
+#include "GetBulkPDU.hpp"
+#include "ResponsePDU.hpp"
+#include "RegisterPDU.hpp"
+#include "OpenPDU.hpp"
+#include "ClosePDU.hpp"
+#include "PingPDU.hpp"
+#include "NotifyPDU.hpp"
+#include "TestSetPDU.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief A string of equal bytes.
+     */
+    binary repeated(size_t length, quint8 byte)
+    {
+        binary value;
+        value.append(length, byte);
+        return value;
+    }
+
+    /**
+     * \brief Serialize an OID, parse it and compare it with the original.
+     */
+    void check_oid(const Oid& oid, const char* what)
+    {
+        binary serialized = OidVariable(oid).serialize();
+        binary::const_iterator pos = serialized.begin();
+        OidVariable parsed(pos, serialized.end());
+        check(parsed.value() == oid
+              && parsed.value().include() == oid.include()
+              && pos == serialized.end(), what);
+    }
+
+    /**
+     * \brief Check the OID encoding.
+     */
+    void check_oids()
+    {
+        check_oid(Oid(), "empty OID");
+        check_oid(Oid("1.3.6.1.4.1.42.3.1"), "OID with prefix");
+        check_oid(Oid("1.3.6.1.5"), "OID consisting of a prefix");
+        check_oid(Oid("1.3.6.1.0.5"), "OID below 1.3.6.1.0");
+        check_oid(Oid("1.3.6.1"), "OID 1.3.6.1");
+        check_oid(Oid("1.3.6.2.1"), "OID without prefix");
+        check_oid(Oid("1.3.6.1.256.1"), "OID with a large fifth subid");
+
+        Oid include("1.3.6.1.2.1.1");
+        include.setInclude(true);
+        check_oid(include, "OID with include flag");
+
+        Oid large("1.3.6.1.4.1");
+        large.push_back(4294967295u);
+        large.push_back(0);
+        check_oid(large, "OID with the largest subid");
+
+        Oid longest;
+        for(quint32 i = 0; i < 128; i++)
+        {
+            longest.push_back(i * 1000003u);
+        }
+        check_oid(longest, "OID with 128 subids");
+
+        // The prefix field (RFC 2741, 5.1. "Object Identifier")
+        binary prefixed = OidVariable(Oid("1.3.6.1.4.1.42")).serialize();
+        check(prefixed[0] == 2 && prefixed[1] == 4,
+              "1.3.6.1.4.1.42 is encoded with prefix 4");
+        binary zero = OidVariable(Oid("1.3.6.1.0.5")).serialize();
+        check(zero[0] == 6 && zero[1] == 0,
+              "1.3.6.1.0.5 is encoded without prefix");
+    }
+
+    /**
+     * \brief Serialize a PDU, parse it with both parse paths and check
+     *        that the result serializes identically.
+     */
+    void check_pdu(const PDU& pdu, const char* what)
+    {
+        binary serialized = pdu.serialize();
+
+        check(PDU::scan_pdu(serialized) == 0, what);
+
+        int error = 1;
+        QSharedPointer<PDU> parsed = PDU::parse_pdu(serialized, error);
+        check(error == 0 && parsed && parsed->serialize() == serialized,
+              what);
+
+        QSharedPointer<const binary> shared(new binary(serialized));
+        error = 1;
+        parsed = PDU::parse_pdu(shared, error);
+        check(error == 0 && parsed && parsed->serialize() == serialized,
+              what);
+    }
+
+    /**
+     * \brief Check the round trip of the PDU types.
+     */
+    void check_pdus()
+    {
+        GetPDU get;
+        get.get_sr().push_back(Oid("1.3.6.1.2.1.1.1.0"));
+        get.get_sr().push_back(Oid("1.3.6.1.0.7"));
+        check_pdu(get, "GetPDU round trip");
+
+        GetNextPDU getnext;
+        getnext.get_sr().push_back(make_pair(Oid("1.3.6.1.2.1.2"),
+                                             Oid("1.3.6.1.2.1.3")));
+        check_pdu(getnext, "GetNextPDU round trip");
+
+        GetBulkPDU bulk;
+        bulk.set_non_repeaters(1);
+        bulk.set_max_repititions(10);
+        bulk.get_sr().push_back(make_pair(Oid("1.3.6.1.2.1.1.3"), Oid()));
+        bulk.get_sr().push_back(make_pair(Oid("1.3.6.1.2.1.2.2.1.2"),
+                                          Oid("1.3.6.1.2.1.2.2.1.3")));
+        check_pdu(bulk, "GetBulkPDU round trip");
+
+        ResponsePDU response;
+        response.set_error(ResponsePDU::noAgentXError);
+        response.varbindlist.push_back(Varbind(Oid("1.3.6.1.4.1.42.1"),
+                QSharedPointer<AbstractVariable>(new IntegerVariable(-42))));
+        response.varbindlist.push_back(Varbind(Oid("1.3.6.1.4.1.42.2"),
+                QSharedPointer<AbstractVariable>(
+                    new OctetStringVariable(repeated(13, 'x')))));
+        response.varbindlist.push_back(Varbind(Oid("1.3.6.1.4.1.42.3"),
+                QSharedPointer<AbstractVariable>(
+                    new Counter64Variable(0x123456789abcdefULL))));
+        response.varbindlist.push_back(Varbind(Oid("1.3.6.1.4.1.42.4"),
+                                               Varbind::noSuchObject));
+        response.varbindlist.push_back(Varbind(Oid("1.3.6.1.4.1.42.5"),
+                                               Varbind::endOfMibView));
+        check_pdu(response, "ResponsePDU round trip");
+
+        RegisterPDU reg;
+        reg.set_subtree(Oid("1.3.6.1.4.1.42"));
+        reg.set_priority(100);
+        reg.set_timeout(5);
+        check_pdu(reg, "RegisterPDU round trip");
+
+        OpenPDU open;
+        open.set_id(Oid("1.3.6.1.4.1.42"));
+        open.set_descr(OctetStringVariable(QString("codec_check")));
+        check_pdu(open, "OpenPDU round trip");
+
+        check_pdu(ClosePDU(7, ClosePDU::reasonShutdown),
+                  "ClosePDU round trip");
+        check_pdu(PingPDU(), "PingPDU round trip");
+    }
+
+    /**
+     * \brief Check the error codes of the non-throwing parse path.
+     */
+    void check_errors()
+    {
+        GetPDU get;
+        get.get_sr().push_back(Oid("1.3.6.1.2.1.1.1.0"));
+        binary serialized = get.serialize();
+        int error;
+
+        binary truncated = serialized;
+        truncated.resize(serialized.size() - 4);
+        check(PDU::scan_pdu(truncated) == -1,
+              "scan_pdu() rejects a truncated PDU");
+        error = 0;
+        check( ! PDU::parse_pdu(truncated, error) && error == -1,
+              "parse_pdu() rejects a truncated PDU");
+
+        binary header = serialized;
+        header.resize(19);
+        error = 0;
+        check( ! PDU::parse_pdu(header, error) && error == -1,
+              "parse_pdu() rejects a truncated header");
+
+        binary version = serialized;
+        version[0] = 2;
+        check(PDU::scan_pdu(version) == -2,
+              "scan_pdu() rejects AgentX version 2");
+        error = 0;
+        check( ! PDU::parse_pdu(version, error) && error == -2,
+              "parse_pdu() rejects AgentX version 2");
+
+        // The search range claims more subids than the payload holds
+        binary subids = serialized;
+        subids[20] = 100;
+        check(PDU::scan_pdu(subids) == -1,
+              "scan_pdu() rejects an overlong OID");
+        error = 0;
+        check( ! PDU::parse_pdu(subids, error) && error == -1,
+              "parse_pdu() rejects an overlong OID");
+    }
+
+    /**
+     * \brief Fill a varbind list with one variable of several types.
+     */
+    void fill(vector<Varbind>& vb)
+    {
+        vb.push_back(Varbind(Oid("1.3.6.1.4.1.42.1.0"),
+                QSharedPointer<AbstractVariable>(new IntegerVariable(4711))));
+        vb.push_back(Varbind(Oid("1.3.6.1.4.1.42.2.0"),
+                QSharedPointer<AbstractVariable>(
+                    new OctetStringVariable(repeated(5, 'v')))));
+        vb.push_back(Varbind(Oid("1.3.6.1.4.1.42.3.0"),
+                QSharedPointer<AbstractVariable>(
+                    new OidVariable(Oid("1.3.6.1.0.1")))));
+    }
+
+    /**
+     * \brief Check the values of the varbinds created by fill().
+     */
+    bool filled(const vector<Varbind>& vb)
+    {
+        if(vb.size() != 3)
+        {
+            return false;
+        }
+        QSharedPointer<IntegerVariable> integer =
+            qSharedPointerDynamicCast<IntegerVariable>(vb[0].get_var());
+        QSharedPointer<OctetStringVariable> string =
+            qSharedPointerDynamicCast<OctetStringVariable>(vb[1].get_var());
+        QSharedPointer<OidVariable> oid =
+            qSharedPointerDynamicCast<OidVariable>(vb[2].get_var());
+        return integer && integer->value() == 4711
+               && string && string->value() == repeated(5, 'v')
+               && oid && oid->value() == Oid("1.3.6.1.0.1")
+               && vb[2].get_name() == Oid("1.3.6.1.4.1.42.3.0");
+    }
+
+    /**
+     * \brief Check the lazily decoded varbinds of TestSet and Notify
+     *        PDU's.
+     */
+    void check_lazy_varbinds()
+    {
+        TestSetPDU testset;
+        fill(testset.get_vb());
+        binary serialized = testset.serialize();
+
+        // Parsed from a shared buffer, which is released by the caller
+        int error;
+        QSharedPointer<binary> buf(new binary(serialized));
+        QSharedPointer<PDU> parsed = PDU::parse_pdu(
+                        QSharedPointer<const binary>(buf), error);
+        buf.clear();
+        QSharedPointer<TestSetPDU> shared =
+            qSharedPointerDynamicCast<TestSetPDU>(parsed);
+        check(error == 0 && shared,
+              "TestSetPDU is parsed from a shared buffer");
+        if(shared)
+        {
+            // A copy decodes independently
+            vector<Varbind> copy = shared->get_vb();
+            check(filled(copy),
+                  "copied TestSet varbinds are decoded");
+            check(filled(shared->get_vb()),
+                  "TestSet varbinds from a shared buffer are decoded");
+            check(shared->serialize() == serialized,
+                  "TestSetPDU from a shared buffer serializes identically");
+        }
+
+        // Parsed from a buffer of the caller (the payload is copied)
+        QSharedPointer<TestSetPDU> copied =
+            qSharedPointerDynamicCast<TestSetPDU>(
+                                PDU::parse_pdu(serialized, error));
+        serialized.assign(serialized.size(), 0);
+        check(error == 0 && copied && filled(copied->get_vb()),
+              "TestSet varbinds survive the buffer of the caller");
+
+        NotifyPDU notify;
+        fill(notify.get_vb());
+        binary notification = notify.serialize();
+        QSharedPointer<NotifyPDU> parsed_notify =
+            qSharedPointerDynamicCast<NotifyPDU>(PDU::parse_pdu(
+                QSharedPointer<const binary>(new binary(notification)),
+                error));
+        check(error == 0 && parsed_notify
+              && parsed_notify->serialize() == notification
+              && filled(parsed_notify->get_vb()),
+              "NotifyPDU from a shared buffer");
+    }
+
+    /**
+     * \brief Check varbinds with a pre-encoded name.
+     */
+    void check_encoded_names()
+    {
+        Oid name("1.3.6.1.4.1.42.1.1.17");
+        QSharedPointer<AbstractVariable> var(new IntegerVariable(17));
+        QSharedPointer<const binary> encoded(
+                        new binary(OidVariable(name).serialize()));
+
+        check(Varbind(name, encoded, var).serialize()
+              == Varbind(name, var).serialize(),
+              "varbind with encoded name serializes identically");
+        check(Varbind(name, QSharedPointer<const binary>(), var).serialize()
+              == Varbind(name, var).serialize(),
+              "varbind without encoded name serializes identically");
+
+        ResponsePDU response;
+        response.varbindlist.push_back(Varbind(name, encoded, var));
+        check_pdu(response, "ResponsePDU with encoded name round trip");
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    check_oids();
+    check_pdus();
+    check_errors();
+    check_lazy_varbinds();
+    check_encoded_names();
+
+    return check_summary("codec_check");
+}
@@ -0,0 +1,495 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Benchmark of the connectors under pipelined GetBulk load.
+ *
+ * A minimal master agent runs in a thread of this process and listens on a 
+ * Unix domain socket. The subagent, a MasterProxy using the connector under 
+ * test, registers a table of IntegerVariables. The master agent then keeps 
+ * a window of GetBulk requests in flight and measures the latency of each 
+ * response.
+ *
+ * Usage: connector_bench unix|epoll|uring [requests [window]]
+ *
+ * "unix" is the QLocalSocket based UnixDomainConnector. The benchmark 
+ * reports the context switches per PDU as obtained by getrusage(2), and the 
+ * system calls per PDU as counted by the raw_syscalls:sys_enter tracepoint.  
+ * The latter needs tracefs (mounted at /sys/kernel/tracing or 
+ * /sys/kernel/debug/tracing) and permission to use perf_event_open(2), 
+ * otherwise it is reported as "n/a". Both figures include the master agent 
+ * stub. Its share depends on how the connector under test batches the 
+ * PDU's, so the figures compare whole setups rather than connectors alone.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <QSemaphore>
+
+#include "MasterProxy.hpp"
+#include "EpollConnector.hpp"
+#include "UringConnector.hpp"
+#include "IntegerVariable.hpp"
+#include "GetBulkPDU.hpp"
+#include "RegisterPDU.hpp"
+#include "ResponsePDU.hpp"
+#include "util.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief The socket of the master agent stub.
+     */
+    const char* socket_path = "/tmp/agentxcpp-bench.sock";
+
+    /**
+     * \brief The table served by the subagent.
+     */
+    const char* table_oid = "1.3.6.1.4.1.42.2";
+
+    /**
+     * \brief The number of rows of the table.
+     */
+    const int table_rows = 1000;
+
+    /**
+     * \brief Read exactly size bytes.
+     *
+     * \return False on EOF or error.
+     */
+    bool read_all(int fd, quint8* data, size_t size)
+    {
+        while(size != 0)
+        {
+            ssize_t n = ::read(fd, data, size);
+            if(n <= 0)
+            {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    /**
+     * \brief Write a %PDU.
+     */
+    void write_pdu(int fd, const PDU& pdu)
+    {
+        binary buf = pdu.serialize();
+        const quint8* data = buf.data();
+        size_t size = buf.size();
+        while(size != 0)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if(n <= 0)
+            {
+                return;
+            }
+            data += n;
+            size -= n;
+        }
+    }
+
+    /**
+     * \brief Read a %PDU.
+     *
+     * \return The %PDU, or NULL on EOF or error.
+     */
+    QSharedPointer<PDU> read_pdu(int fd)
+    {
+        binary buf;
+        buf.resize(20);
+        if( ! read_all(fd, &buf[0], 20) )
+        {
+            return QSharedPointer<PDU>();
+        }
+        bool big_endian = (buf[2] & (1<<4)) ? true : false;
+        binary::const_iterator pos = buf.begin() + 16;
+        quint32 length = read32(pos, big_endian);
+        buf.resize(20 + length);
+        if( length != 0 && ! read_all(fd, &buf[20], length) )
+        {
+            return QSharedPointer<PDU>();
+        }
+        int error;
+        return PDU::parse_pdu(buf, error);
+    }
+
+
+    /**
+     * \brief A minimal master agent.
+     *
+     * Answers all administrative %PDU's of the subagent. After the first 
+     * RegisterPDU, it waits until go is released, then sends the GetBulk 
+     * requests and records their latencies.
+     */
+    class MasterStub : public QThread
+    {
+        private:
+            int m_listener;
+            int m_requests;
+            int m_window;
+
+            /**
+             * \brief The number of requests sent so far.
+             */
+            int m_issued;
+
+            /**
+             * \brief The start of the load phase.
+             */
+            qint64 m_start;
+
+            /**
+             * \brief The send times of the outstanding requests, by
+             *        packetID.
+             */
+            map<quint32, qint64> m_sent;
+
+            QElapsedTimer m_clock;
+
+            /**
+             * \brief Send the next request.
+             */
+            void send_request(int fd, quint32 sessionID)
+            {
+                GetBulkPDU pdu;
+                pdu.set_sessionID(sessionID);
+                pdu.set_max_repititions(10);
+                pdu.get_sr().push_back(make_pair(Oid(table_oid), Oid()));
+                m_sent[pdu.get_packetID()] = m_clock.nsecsElapsed();
+                write_pdu(fd, pdu);
+                m_issued++;
+            }
+
+        protected:
+            virtual void run()
+            {
+                int fd = ::accept(m_listener, 0, 0);
+                if(fd == -1)
+                {
+                    return;
+                }
+                m_clock.start();
+
+                QSharedPointer<PDU> pdu;
+                while( (pdu = read_pdu(fd)) )
+                {
+                    QSharedPointer<ResponsePDU> response;
+                    response = qSharedPointerDynamicCast<ResponsePDU>(pdu);
+                    if( ! response )
+                    {
+                        // An administrative PDU: accept it
+                        ResponsePDU answer;
+                        answer.set_sessionID(1);
+                        answer.set_transactionID(pdu->get_transactionID());
+                        answer.set_packetID(pdu->get_packetID());
+                        write_pdu(fd, answer);
+
+                        if(qSharedPointerDynamicCast<RegisterPDU>(pdu)
+                           && m_issued == 0)
+                        {
+                            // Start the load when the table is complete
+                            go.acquire();
+                            m_start = m_clock.nsecsElapsed();
+                            while(m_issued < m_window
+                                  && m_issued < m_requests)
+                            {
+                                send_request(fd, 1);
+                            }
+                        }
+                        continue;
+                    }
+
+                    // A response to our request
+                    map<quint32, qint64>::iterator i;
+                    i = m_sent.find(response->get_packetID());
+                    if(i == m_sent.end())
+                    {
+                        continue;
+                    }
+                    qint64 now = m_clock.nsecsElapsed();
+                    latencies.push_back((now - i->second) / 1000);
+                    m_sent.erase(i);
+                    if(m_issued < m_requests)
+                    {
+                        send_request(fd, 1);
+                    }
+                    else if(m_sent.empty())
+                    {
+                        elapsed = now - m_start;
+                        QMetaObject::invokeMethod(
+                                        QCoreApplication::instance(),
+                                        "quit", Qt::QueuedConnection);
+                    }
+                }
+                ::close(fd);
+            }
+
+        public:
+            /**
+             * \brief Released when the subagent is ready.
+             */
+            QSemaphore go;
+
+            /**
+             * \brief The latencies in microseconds.
+             */
+            vector<qint64> latencies;
+
+            /**
+             * \brief The duration of the load phase in nanoseconds.
+             */
+            qint64 elapsed;
+
+            MasterStub(int listener, int requests, int window)
+                : m_listener(listener),
+                  m_requests(requests),
+                  m_window(window),
+                  m_issued(0),
+                  m_start(0),
+                  elapsed(0)
+            {
+            }
+    };
+
+
+    /**
+     * \brief Create the listening socket of the master agent stub.
+     */
+    int listen_socket()
+    {
+        ::unlink(socket_path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+        if(fd == -1
+           || ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                     sizeof(addr)) == -1
+           || ::listen(fd, 1) == -1)
+        {
+            perror("listen");
+            exit(1);
+        }
+        return fd;
+    }
+
+    /**
+     * \brief Open a counter of the system calls of the process.
+     *
+     * The counter includes the threads started later. Their system calls 
+     * are added when they exit.
+     *
+     * \return The file descriptor of the counter, or -1 if the
+     *         tracepoint is not available.
+     */
+    int open_syscall_counter()
+    {
+        const char* paths[] = {
+            "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+            "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+        };
+        unsigned long long id = 0;
+        for(size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+        {
+            FILE* file = fopen(paths[i], "r");
+            if(file)
+            {
+                if(fscanf(file, "%llu", &id) != 1)
+                {
+                    id = 0;
+                }
+                fclose(file);
+            }
+            if(id != 0)
+            {
+                break;
+            }
+        }
+        if(id == 0)
+        {
+            return -1;
+        }
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = id;
+        attr.inherit = 1;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    /**
+     * \brief Read the system call counter.
+     *
+     * \return The number of system calls so far, or 0 if the counter is
+     *         not available.
+     */
+    long long syscalls(int counter)
+    {
+        long long count = 0;
+        if(counter == -1 || ::read(counter, &count, sizeof(count))
+                                                        != sizeof(count))
+        {
+            return 0;
+        }
+        return count;
+    }
+
+    /**
+     * \brief Get the context switches of the process so far.
+     */
+    long context_switches()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_nvcsw + usage.ru_nivcsw;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    if(argc < 2)
+    {
+        fprintf(stderr,
+                "usage: %s unix|epoll|uring [requests [window]]\n", argv[0]);
+        return 1;
+    }
+    string transport = argv[1];
+    int requests = (argc > 2) ? atoi(argv[2]) : 100000;
+    int window = (argc > 3) ? atoi(argv[3]) : 16;
+
+    // Opened before any thread is started, so that all are counted
+    int counter = open_syscall_counter();
+
+    int listener = listen_socket();
+    MasterStub master(listener, requests, window);
+    master.start();
+
+    MasterProxy* proxy;
+    if(transport == "unix")
+    {
+        proxy = new MasterProxy("connector_bench", 5, Oid(), socket_path);
+    }
+    else if(transport == "epoll")
+    {
+        proxy = new MasterProxy(new EpollConnector(socket_path),
+                                "connector_bench", 5);
+    }
+    else if(transport == "uring")
+    {
+        proxy = new MasterProxy(new UringConnector(socket_path),
+                                "connector_bench", 5);
+    }
+    else
+    {
+        fprintf(stderr, "unknown transport: %s\n", transport.c_str());
+        return 1;
+    }
+    if( ! proxy->is_connected() )
+    {
+        fprintf(stderr, "%s: cannot connect\n", transport.c_str());
+        return 1;
+    }
+
+    // The registration, then the table
+    proxy->register_subtree(Oid(table_oid));
+    for(int row = 1; row <= table_rows; row++)
+    {
+        Oid name(table_oid);
+        name.push_back(1);
+        name.push_back(row);
+        proxy->add_variable(name, 
+                            QSharedPointer<IntegerVariable>(
+                                            new IntegerVariable(row)));
+    }
+    long switches = context_switches();
+    long long calls = syscalls(counter);
+    master.go.release();
+
+    app.exec();
+    switches = context_switches() - switches;
+
+    delete proxy;
+    master.wait();
+    ::close(listener);
+    ::unlink(socket_path);
+
+    // The system calls of the threads are counted when they exited. This 
+    // includes their setup and shutdown, which is negligible for many 
+    // requests.
+    calls = syscalls(counter) - calls;
+
+    // Report
+    vector<qint64>& lat = master.latencies;
+    if(lat.empty())
+    {
+        fprintf(stderr, "no responses\n");
+        return 1;
+    }
+    sort(lat.begin(), lat.end());
+    double seconds = master.elapsed / 1e9;
+    char calls_per_pdu[32] = "n/a";
+    if(counter != -1)
+    {
+        snprintf(calls_per_pdu, sizeof(calls_per_pdu), "%.2f",
+                 double(calls) / lat.size());
+        ::close(counter);
+    }
+    printf("%-6s requests %lu window %d: %.0f PDU/s, "
+           "latency p50 %lld us, p99 %lld us, max %lld us, "
+           "%.2f context switches/PDU, %s syscalls/PDU\n",
+           transport.c_str(), (unsigned long)lat.size(), window,
+           lat.size() / seconds,
+           (long long)lat[lat.size() / 2],
+           (long long)lat[lat.size() * 99 / 100],
+           (long long)lat.back(),
+           double(switches) / lat.size(),
+           calls_per_pdu);
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Benchmark of the encoding of GetBulk responses.
+ *
+ * The subagent, a MasterProxy using a LoopbackConnector, serves a table of 
+ * OctetStringVariables, like the description columns of an interface 
+ * table. GetBulk requests walk the table, and each response is serialized 
+ * as a connector would do before sending it.
+ *
+ * Usage: encoding_bench [rows [length [requests]]]
+ *
+ * The LoopbackConnector does not encode the PDU's itself (see 
+ * LoopbackConnector::set_encoding()), so that the parsing of the response 
+ * by the master agent stub is not part of the measurement.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "MasterProxy.hpp"
+#include "LoopbackConnector.hpp"
+#include "OctetStringVariable.hpp"
+#include "GetBulkPDU.hpp"
+#include "ResponsePDU.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief The table served by the subagent.
+     */
+    const char* table_oid = "1.3.6.1.4.1.42.4";
+
+    /**
+     * \brief The rows returned by each GetBulk request.
+     */
+    const int bulk_rows = 10;
+
+    /**
+     * \brief Walk the table and report the time spent.
+     *
+     * \return False if a request failed.
+     */
+    bool run(LoopbackConnector* loop, int rows, int requests)
+    {
+        QElapsedTimer clock;
+        qint64 serializing = 0;
+        size_t bytes = 0;
+        clock.start();
+
+        for(int i = 0; i < requests; i++)
+        {
+            // Continue the walk behind the last row of the previous request
+            Oid start(table_oid);
+            start.push_back(1);
+            start.push_back((i * bulk_rows) % rows);
+
+            QSharedPointer<GetBulkPDU> bulk(new GetBulkPDU);
+            bulk->set_max_repititions(bulk_rows);
+            bulk->get_sr().push_back(make_pair(start, Oid()));
+            QSharedPointer<ResponsePDU> response = loop->inject(bulk);
+            if( ! response
+                || response->get_error() != ResponsePDU::noAgentXError )
+            {
+                fprintf(stderr, "request %d failed\n", i);
+                return false;
+            }
+
+            qint64 before = clock.nsecsElapsed();
+            binary serialized = response->serialize();
+            serializing += clock.nsecsElapsed() - before;
+            bytes += serialized.size();
+        }
+
+        double seconds = clock.nsecsElapsed() / 1e9;
+        printf("%.0f requests/s, serialize %lld ns/PDU, %lu bytes/PDU\n",
+               requests / seconds,
+               (long long)(serializing / requests),
+               (unsigned long)(bytes / requests));
+        return true;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int rows = (argc > 1) ? atoi(argv[1]) : 1000;
+    int length = (argc > 2) ? atoi(argv[2]) : 64;
+    int requests = (argc > 3) ? atoi(argv[3]) : 100000;
+    if(rows < bulk_rows || rows % bulk_rows != 0
+       || length < 0 || requests < 1)
+    {
+        fprintf(stderr,
+                "usage: %s [rows [length [requests]]]\n"
+                "rows must be a multiple of %d\n", argv[0], bulk_rows);
+        return 1;
+    }
+
+    LoopbackConnector* loop = new LoopbackConnector;
+    loop->set_encoding(false);
+    MasterProxy proxy(loop, "encoding_bench");
+
+    proxy.register_subtree(Oid(table_oid));
+    for(int row = 1; row <= rows; row++)
+    {
+        binary value;
+        value.append(length, 'a' + row % 26);
+        QSharedPointer<OctetStringVariable> variable(
+                                        new OctetStringVariable(value));
+        Oid name(table_oid);
+        name.push_back(1);
+        name.push_back(row);
+        proxy.add_variable(name, variable);
+    }
+
+    return run(loop, rows, requests) ? 0 : 1;
+}
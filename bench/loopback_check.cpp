@@ -0,0 +1,372 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Request/response checks of a subagent over the LoopbackConnector.
+ *
+ * The subagent, a MasterProxy using a LoopbackConnector, serves a few 
+ * IntegerVariables. Get, GetNext, GetBulk and Set requests are injected 
+ * and the responses are compared with the expected ones. The checks run 
+ * twice: with the PDU's passed as objects and with each PDU encoded and 
+ * parsed again (see LoopbackConnector::set_encoding()).
+ *
+ * Usage: loopback_check
+ *
+ * The program exits with status 1 if a check failed.
+ */
+
+#include <QCoreApplication>
+
+#include "check.hpp"
+#include "MasterProxy.hpp"
+#include "LoopbackConnector.hpp"
+#include "IntegerVariable.hpp"
+#include "GetPDU.hpp"
+#include "GetNextPDU.hpp"
+#include "GetBulkPDU.hpp"
+#include "TestSetPDU.hpp"
+#include "ResponsePDU.hpp"
+#include "util.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief The subtree served by the subagent.
+     */
+    const char* subtree_oid = "1.3.6.1.4.1.42.6";
+
+    /**
+     * \brief The number of variables served.
+     */
+    const int variables = 5;
+
+    /**
+     * \brief The name of a variable.
+     */
+    Oid variable_name(int number)
+    {
+        Oid name(subtree_oid);
+        name.push_back(number);
+        name.push_back(0);
+        return name;
+    }
+
+    /**
+     * \brief A variable which accepts Set requests.
+     */
+    class WritableVariable : public IntegerVariable
+    {
+        public:
+            WritableVariable(qint32 value) : IntegerVariable(value) { }
+
+        protected:
+            virtual testset_result_t perform_testset(qint32)
+            {
+                return noError;
+            }
+
+            virtual bool perform_commitset(qint32 value)
+            {
+                setValue(value);
+                return true;
+            }
+    };
+
+    /**
+     * \brief Whether a varbind carries the variable with the given number.
+     */
+    bool is_variable(const Varbind& varbind, int number)
+    {
+        QSharedPointer<IntegerVariable> integer =
+            qSharedPointerDynamicCast<IntegerVariable>(varbind.get_var());
+        return varbind.get_name() == variable_name(number)
+               && integer && integer->value() == number * 10;
+    }
+
+    /**
+     * \brief Whether a varbind is an exception (noSuchObject etc.).
+     */
+    bool is_exception(const Varbind& varbind, const Oid& name,
+                      Varbind::type_t type)
+    {
+        return varbind.serialize() == Varbind(name, type).serialize();
+    }
+
+    /**
+     * \brief Whether a response was successful and has the given number
+     *        of varbinds.
+     */
+    bool succeeded(QSharedPointer<ResponsePDU> response, size_t varbinds)
+    {
+        return response
+               && response->get_error() == ResponsePDU::noAgentXError
+               && response->varbindlist.size() == varbinds;
+    }
+
+    /**
+     * \brief Check Get requests.
+     */
+    void check_get(LoopbackConnector* loop)
+    {
+        QSharedPointer<GetPDU> get(new GetPDU);
+        get->get_sr().push_back(variable_name(2));
+        get->get_sr().push_back(variable_name(variables + 1));
+        get->get_sr().push_back(Oid("1.3.6.1.4.1.42.7.1.0"));
+        QSharedPointer<ResponsePDU> response = loop->inject(get);
+        check(succeeded(response, 3)
+              && response->get_packetID() == get->get_packetID(),
+              "Get is answered");
+        if(succeeded(response, 3))
+        {
+            check(is_variable(response->varbindlist[0], 2),
+                  "Get returns the variable");
+            check(is_exception(response->varbindlist[1],
+                               variable_name(variables + 1),
+                               Varbind::noSuchObject),
+                  "Get of a missing variable returns noSuchObject");
+            check(is_exception(response->varbindlist[2],
+                               Oid("1.3.6.1.4.1.42.7.1.0"),
+                               Varbind::noSuchObject),
+                  "Get outside the subtree returns noSuchObject");
+        }
+    }
+
+    /**
+     * \brief Check a walk of the subtree with GetNext requests.
+     */
+    void check_walk(LoopbackConnector* loop)
+    {
+        Oid start(subtree_oid);
+        bool in_order = true;
+        int number = 1;
+        for( ; number <= variables + 1; number++)
+        {
+            QSharedPointer<GetNextPDU> getnext(new GetNextPDU);
+            getnext->get_sr().push_back(make_pair(start, Oid()));
+            QSharedPointer<ResponsePDU> response = loop->inject(getnext);
+            if( ! succeeded(response, 1) )
+            {
+                in_order = false;
+                break;
+            }
+            const Varbind& varbind = response->varbindlist[0];
+            if(number > variables)
+            {
+                // Behind the last variable
+                in_order = is_exception(varbind, start,
+                                        Varbind::endOfMibView);
+                break;
+            }
+            if( ! is_variable(varbind, number) )
+            {
+                in_order = false;
+                break;
+            }
+            start = varbind.get_name();
+        }
+        check(in_order, "GetNext walks the subtree in order");
+
+        // The end of a search range is exclusive
+        QSharedPointer<GetNextPDU> getnext(new GetNextPDU);
+        getnext->get_sr().push_back(make_pair(variable_name(1),
+                                              variable_name(2)));
+        QSharedPointer<ResponsePDU> response = loop->inject(getnext);
+        check(succeeded(response, 1)
+              && is_exception(response->varbindlist[0], variable_name(1),
+                              Varbind::endOfMibView),
+              "GetNext stops at the end of the search range");
+    }
+
+    /**
+     * \brief Check GetBulk requests.
+     */
+    void check_bulk(LoopbackConnector* loop)
+    {
+        QSharedPointer<GetBulkPDU> bulk(new GetBulkPDU);
+        bulk->set_non_repeaters(1);
+        bulk->set_max_repititions(3);
+        bulk->get_sr().push_back(make_pair(Oid(subtree_oid), Oid()));
+        bulk->get_sr().push_back(make_pair(variable_name(1), Oid()));
+        QSharedPointer<ResponsePDU> response = loop->inject(bulk);
+        check(succeeded(response, 4)
+              && is_variable(response->varbindlist[0], 1)
+              && is_variable(response->varbindlist[1], 2)
+              && is_variable(response->varbindlist[2], 3)
+              && is_variable(response->varbindlist[3], 4),
+              "GetBulk returns the non-repeater and the repetitions");
+
+        // Repetitions beyond the last variable
+        bulk = QSharedPointer<GetBulkPDU>(new GetBulkPDU);
+        bulk->set_max_repititions(3);
+        bulk->get_sr().push_back(make_pair(variable_name(variables - 1),
+                                           Oid()));
+        response = loop->inject(bulk);
+        check(response
+              && response->get_error() == ResponsePDU::noAgentXError
+              && response->varbindlist.size() >= 2
+              && is_variable(response->varbindlist[0], variables)
+              && is_exception(response->varbindlist[1],
+                              variable_name(variables),
+                              Varbind::endOfMibView),
+              "GetBulk ends with endOfMibView");
+    }
+
+    /**
+     * \brief Create a PDU without payload, as sent by the master agent.
+     *
+     * Used for CommitSet and CleanupSet PDU's, which have no constructor 
+     * for sending them.
+     *
+     * \param type The PDU type (RFC 2741, 6.1. "AgentX PDU Header").
+     *
+     * \param transactionID The transaction of the preceding TestSet.
+     */
+    QSharedPointer<PDU> header_pdu(quint8 type, quint32 transactionID)
+    {
+        binary serialized;
+        serialized.push_back(1);            // version
+        serialized.push_back(type);
+        serialized.push_back(1 << 4);       // network byte order
+        serialized.push_back(0);            // reserved
+        write32(serialized, 0);             // sessionID, set by deliver()
+        write32(serialized, transactionID);
+        write32(serialized, 4711);          // packetID
+        write32(serialized, 0);             // payload length
+        return PDU::parse_pdu(serialized);
+    }
+
+    /**
+     * \brief Check a Set transaction.
+     */
+    void check_set(LoopbackConnector* loop, MasterProxy& proxy)
+    {
+        Oid name = variable_name(variables + 1);
+        proxy.add_variable(name, QSharedPointer<AbstractVariable>(
+                                        new WritableVariable(0)));
+
+        QSharedPointer<TestSetPDU> testset(new TestSetPDU);
+        testset->get_vb().push_back(Varbind(name,
+                QSharedPointer<AbstractVariable>(new IntegerVariable(99))));
+        QSharedPointer<ResponsePDU> response = loop->inject(testset);
+        check(response && response->get_error() == ResponsePDU::noAgentXError,
+              "TestSet of a writable variable succeeds");
+
+        response = loop->inject(header_pdu(9, testset->get_transactionID()));
+        check(response && response->get_error() == ResponsePDU::noAgentXError,
+              "CommitSet succeeds");
+
+        check( ! loop->inject(header_pdu(11, testset->get_transactionID())),
+              "CleanupSet is not answered");
+
+        QSharedPointer<GetPDU> get(new GetPDU);
+        get->get_sr().push_back(name);
+        response = loop->inject(get);
+        QSharedPointer<IntegerVariable> integer;
+        if(succeeded(response, 1))
+        {
+            integer = qSharedPointerDynamicCast<IntegerVariable>(
+                                    response->varbindlist[0].get_var());
+        }
+        check(integer && integer->value() == 99,
+              "Get returns the value written by Set");
+
+        // Read-only variables reject the Set
+        testset = QSharedPointer<TestSetPDU>(new TestSetPDU);
+        testset->get_vb().push_back(Varbind(variable_name(1),
+                QSharedPointer<AbstractVariable>(new IntegerVariable(1))));
+        response = loop->inject(testset);
+        check(response && response->get_error() == ResponsePDU::noAccess
+              && response->get_index() == 1,
+              "TestSet of a read-only variable fails with noAccess");
+        loop->inject(header_pdu(11, testset->get_transactionID()));
+
+        proxy.remove_variable(name);
+    }
+
+    /**
+     * \brief Check PDU's of an unknown session.
+     */
+    void check_unknown_session(LoopbackConnector* loop)
+    {
+        size_t old_count = loop->sent_count();
+        QSharedPointer<GetPDU> get(new GetPDU);
+        get->set_sessionID(loop->sessionID() + 1000);
+        get->get_sr().push_back(variable_name(1));
+        loop->deliver(get);
+
+        QSharedPointer<ResponsePDU> response;
+        if(loop->sent_count() == old_count + 1)
+        {
+            for(size_t i = 0; i < old_count; i++)
+            {
+                loop->take_sent();
+            }
+            response = qSharedPointerDynamicCast<ResponsePDU>(
+                                                loop->take_sent());
+        }
+        check(response && response->get_error() == ResponsePDU::notOpen
+              && response->get_packetID() == get->get_packetID(),
+              "a PDU of an unknown session is answered with notOpen");
+    }
+
+    /**
+     * \brief Run all checks on a new subagent.
+     */
+    void check_subagent(bool encoding)
+    {
+        LoopbackConnector* loop = new LoopbackConnector;
+        loop->set_encoding(encoding);
+        MasterProxy proxy(loop, "loopback_check");
+        check(proxy.is_connected() && loop->sessionID() != 0,
+              "the session is opened");
+
+        proxy.register_subtree(Oid(subtree_oid));
+        for(int number = 1; number <= variables; number++)
+        {
+            proxy.add_variable(variable_name(number),
+                               QSharedPointer<AbstractVariable>(
+                                    new IntegerVariable(number * 10)));
+        }
+
+        check_get(loop);
+        check_walk(loop);
+        check_bulk(loop);
+        check_set(loop, proxy);
+        check_unknown_session(loop);
+
+        check(proxy.ping() >= 0, "ping is answered");
+        proxy.send_notification(Oid("1.3.6.1.4.1.42.6.0.1"));
+        check(loop->sent_count() == 0, "all PDU's are answered");
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    check_subagent(false);
+    check_subagent(true);
+
+    return check_summary("loopback_check");
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Routing checks of the ShardedMasterProxy.
+ *
+ * A ShardedMasterProxy with two shards, each using its own 
+ * LoopbackConnector, registers several subtrees and serves a variable in 
+ * each. The checks verify that the subtrees are spread over the shards, 
+ * that each registration and each variable is handled by the session of 
+ * its shard, and that the sessions are closed on destruction.
+ *
+ * Usage: shard_check
+ *
+ * The program exits with status 1 if a check failed.
+ */
+
+#include <vector>
+
+#include <QCoreApplication>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+
+#include "check.hpp"
+#include "ShardedMasterProxy.hpp"
+#include "LoopbackConnector.hpp"
+#include "IntegerVariable.hpp"
+#include "GetPDU.hpp"
+#include "RegisterPDU.hpp"
+#include "UnregisterPDU.hpp"
+#include "ClosePDU.hpp"
+#include "NotifyPDU.hpp"
+#include "ResponsePDU.hpp"
+#include "exceptions.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief The number of subtrees registered at top level.
+     */
+    const int subtrees = 4;
+
+    /**
+     * \brief The name of a subtree.
+     */
+    Oid subtree_name(int number)
+    {
+        Oid name("1.3.6.1.4.1.42.8");
+        name.push_back(number);
+        return name;
+    }
+
+    /**
+     * \brief The name of the variable within a subtree.
+     */
+    Oid variable_name(const Oid& subtree)
+    {
+        Oid name(subtree);
+        name.push_back(1);
+        name.push_back(0);
+        return name;
+    }
+
+    /**
+     * \brief A LoopbackConnector which records the PDU's of its session.
+     *
+     * The MasterProxy of a shard sends from the shard's thread, while 
+     * requests are delivered from the main thread. The records are 
+     * therefore protected by a mutex.
+     */
+    class RecordingConnector : public LoopbackConnector
+    {
+        private:
+            QMutex m_mutex;
+            QSemaphore m_responses;
+            QSharedPointer<ResponsePDU> m_response;
+            vector<Oid> m_registered;
+            vector<Oid> m_unregistered;
+            int m_notifications;
+            int m_closes;
+
+        protected:
+            virtual QSharedPointer<ResponsePDU> answer(QSharedPointer<PDU> pdu)
+            {
+                QMutexLocker locker(&m_mutex);
+
+                QSharedPointer<RegisterPDU> reg;
+                QSharedPointer<UnregisterPDU> unreg;
+                QSharedPointer<ResponsePDU> response;
+                reg = qSharedPointerDynamicCast<RegisterPDU>(pdu);
+                unreg = qSharedPointerDynamicCast<UnregisterPDU>(pdu);
+                response = qSharedPointerDynamicCast<ResponsePDU>(pdu);
+                if(reg)
+                {
+                    m_registered.push_back(reg->get_subtree());
+                }
+                else if(unreg)
+                {
+                    m_unregistered.push_back(unreg->get_subtree());
+                }
+                else if(qSharedPointerDynamicCast<NotifyPDU>(pdu))
+                {
+                    m_notifications++;
+                }
+                else if(qSharedPointerDynamicCast<ClosePDU>(pdu))
+                {
+                    m_closes++;
+                }
+                else if(response)
+                {
+                    // Response of the subagent to a request
+                    m_response = response;
+                    m_responses.release();
+                }
+
+                return LoopbackConnector::answer(pdu);
+            }
+
+        public:
+            RecordingConnector() : m_notifications(0), m_closes(0) { }
+
+            /**
+             * \brief Deliver a request and wait for the response.
+             *
+             * \return The response, or NULL if it did not arrive within
+             *         5 seconds.
+             */
+            QSharedPointer<ResponsePDU> ask(QSharedPointer<PDU> pdu)
+            {
+                deliver(pdu);
+                if( ! m_responses.tryAcquire(1, 5000) )
+                {
+                    return QSharedPointer<ResponsePDU>();
+                }
+                QMutexLocker locker(&m_mutex);
+                return m_response;
+            }
+
+            /**
+             * \brief Get the value of a variable.
+             *
+             * \return The value, or -1 if the variable was not found.
+             */
+            int get(const Oid& name)
+            {
+                QSharedPointer<GetPDU> request(new GetPDU);
+                request->get_sr().push_back(name);
+                QSharedPointer<ResponsePDU> response = ask(request);
+                if( ! response || response->varbindlist.size() != 1 )
+                {
+                    return -1;
+                }
+                QSharedPointer<IntegerVariable> integer =
+                    qSharedPointerDynamicCast<IntegerVariable>(
+                                    response->varbindlist[0].get_var());
+                return integer ? integer->value() : -1;
+            }
+
+            vector<Oid> registered()
+            {
+                QMutexLocker locker(&m_mutex);
+                return m_registered;
+            }
+
+            vector<Oid> unregistered()
+            {
+                QMutexLocker locker(&m_mutex);
+                return m_unregistered;
+            }
+
+            int notifications()
+            {
+                QMutexLocker locker(&m_mutex);
+                return m_notifications;
+            }
+
+            int closes()
+            {
+                QMutexLocker locker(&m_mutex);
+                return m_closes;
+            }
+    };
+
+    /**
+     * \brief Whether a variable can only be read via one connector.
+     */
+    bool served_by(const vector< QSharedPointer<RecordingConnector> >& loops,
+                   size_t shard, const Oid& name, int value)
+    {
+        for(size_t i = 0; i < loops.size(); i++)
+        {
+            int expected = (i == shard) ? value : -1;
+            if(loops[i]->get(name) != expected)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    vector< QSharedPointer<RecordingConnector> > loops;
+    vector< QSharedPointer<Connector> > connectors;
+    for(int i = 0; i < 2; i++)
+    {
+        loops.push_back(QSharedPointer<RecordingConnector>(
+                                            new RecordingConnector));
+        connectors.push_back(loops.back());
+    }
+
+    ShardedMasterProxy* proxy = new ShardedMasterProxy(connectors,
+                                                       "shard_check");
+    check(proxy->shard_count() == 2 && proxy->is_connected(),
+          "both shards are connected");
+
+    // Spread the subtrees
+    vector<size_t> placement;
+    vector<size_t> load(2, 0);
+    for(int number = 1; number <= subtrees; number++)
+    {
+        placement.push_back(proxy->register_subtree(subtree_name(number)));
+        if(placement.back() < load.size())
+        {
+            load[placement.back()]++;
+        }
+    }
+    check(load[0] == subtrees / 2 && load[1] == subtrees / 2,
+          "the subtrees are spread evenly");
+    for(size_t shard = 0; shard < loops.size(); shard++)
+    {
+        vector<Oid> registered = loops[shard]->registered();
+        bool own = (registered.size() == load[shard]);
+        for(size_t i = 0; own && i < registered.size(); i++)
+        {
+            int number = registered[i].back();
+            own = (registered[i] == subtree_name(number)
+                   && placement[number - 1] == shard);
+        }
+        check(own, "each shard registers its own subtrees");
+    }
+
+    // A nested subtree, registered while the first shard has more
+    // registrations (so that it goes to another shard)
+    proxy->register_subtree(subtree_name(subtrees + 1));
+    Oid nested(subtree_name(1));
+    nested.push_back(5);
+    size_t nested_shard = proxy->register_subtree(nested);
+    check(nested_shard != placement[0],
+          "the nested subtree is placed on the least loaded shard");
+
+    // Variables are routed to the shard of the enclosing subtree
+    for(int number = 1; number <= subtrees; number++)
+    {
+        proxy->add_variable(variable_name(subtree_name(number)),
+                            QSharedPointer<AbstractVariable>(
+                                        new IntegerVariable(number)));
+    }
+    proxy->add_variable(variable_name(nested),
+                        QSharedPointer<AbstractVariable>(
+                                        new IntegerVariable(100)));
+    for(int number = 1; number <= subtrees; number++)
+    {
+        check(served_by(loops, placement[number - 1],
+                        variable_name(subtree_name(number)), number),
+              "a variable is served by the shard of its subtree");
+    }
+    check(served_by(loops, nested_shard, variable_name(nested), 100),
+          "a variable is served by the shard of the nested subtree");
+
+    bool refused = false;
+    try
+    {
+        proxy->add_variable(Oid("1.3.6.1.4.1.42.9.1.0"),
+                            QSharedPointer<AbstractVariable>(
+                                        new IntegerVariable(0)));
+    }
+    catch(unknown_registration)
+    {
+        refused = true;
+    }
+    check(refused, "a variable outside the subtrees is refused");
+
+    proxy->remove_variable(variable_name(subtree_name(2)));
+    check(served_by(loops, placement[1], variable_name(subtree_name(2)), -1),
+          "a removed variable is not served");
+
+    // Unregistration by the shard which registered
+    size_t last = placement[subtrees - 1];
+    proxy->unregister_subtree(subtree_name(subtrees));
+    vector<Oid> unregistered = loops[last]->unregistered();
+    check(unregistered.size() == 1
+          && unregistered[0] == subtree_name(subtrees)
+          && loops[1 - last]->unregistered().empty(),
+          "a subtree is unregistered by its shard");
+    refused = false;
+    try
+    {
+        proxy->add_variable(variable_name(subtree_name(subtrees)),
+                            QSharedPointer<AbstractVariable>(
+                                        new IntegerVariable(0)));
+    }
+    catch(unknown_registration)
+    {
+        refused = true;
+    }
+    check(refused, "a variable of an unregistered subtree is refused");
+
+    proxy->send_notification(Oid("1.3.6.1.4.1.42.8.0.1"));
+    check(loops[0]->notifications() + loops[1]->notifications() == 1,
+          "a notification is sent once");
+
+    delete proxy;
+    check(loops[0]->closes() == 1 && loops[1]->closes() == 1,
+          "both sessions are closed");
+
+    return check_summary("shard_check");
+}
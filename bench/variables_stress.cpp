@@ -0,0 +1,263 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Stress test of adding and removing variables while requests are served.
+ *
+ * The subagent, a MasterProxy using a LoopbackConnector, serves a subtree 
+ * whose variables are added and removed continuously by several writer 
+ * threads, one at a time and in batches. Meanwhile, the thread of the 
+ * MasterProxy injects Get and GetNext requests and checks each varbind of 
+ * the responses: a variable is either missing or carries its own number 
+ * as value, and GetNext returns a successor of the start OID.
+ *
+ * Usage: variables_stress [writers [variables [requests]]]
+ *
+ * The program exits with status 1 if a response was inconsistent. Build 
+ * it with 'scons --sanitize=thread bench' to have data races between the 
+ * writers and the requests reported by ThreadSanitizer.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QAtomicInt>
+#include <QVector>
+#include <QPair>
+
+#include "MasterProxy.hpp"
+#include "LoopbackConnector.hpp"
+#include "IntegerVariable.hpp"
+#include "GetPDU.hpp"
+#include "GetNextPDU.hpp"
+#include "ResponsePDU.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief The subtree served by the subagent.
+     */
+    const char* subtree_oid = "1.3.6.1.4.1.42.5";
+
+    /**
+     * \brief The name of a variable.
+     */
+    Oid variable_name(int number)
+    {
+        Oid name(subtree_oid);
+        name.push_back(number);
+        return name;
+    }
+
+    /**
+     * \brief A linear congruential generator (one per thread).
+     */
+    class Random
+    {
+        private:
+            quint32 m_state;
+
+        public:
+            Random(quint32 seed) : m_state(seed) { }
+
+            int next(int range)
+            {
+                m_state = m_state * 1664525u + 1013904223u;
+                return int((m_state >> 16) % quint32(range));
+            }
+    };
+
+    /**
+     * \brief Adds and removes variables until told to stop.
+     */
+    class Writer : public QThread
+    {
+        private:
+            MasterProxy& m_proxy;
+            int m_variables;
+            quint32 m_seed;
+            QAtomicInt& m_stop;
+
+        public:
+            Writer(MasterProxy& proxy, int variables, quint32 seed,
+                   QAtomicInt& stop)
+                : m_proxy(proxy),
+                  m_variables(variables),
+                  m_seed(seed),
+                  m_stop(stop)
+            {
+            }
+
+        protected:
+            virtual void run()
+            {
+                Random random(m_seed);
+                while(m_stop.fetchAndAddOrdered(0) == 0)
+                {
+                    int number = random.next(m_variables);
+                    switch(random.next(4))
+                    {
+                        case 0:
+                            m_proxy.remove_variable(variable_name(number));
+                            break;
+                        case 1:
+                        {
+                            // A batch of neighbours
+                            QVector<Oid> ids;
+                            for(int i = number;
+                                i < m_variables && i < number + 8; i++)
+                            {
+                                ids.append(variable_name(i));
+                            }
+                            m_proxy.removeVariables(ids);
+                            break;
+                        }
+                        case 2:
+                        {
+                            QVector< QPair< Oid,
+                                QSharedPointer<AbstractVariable> > > vars;
+                            for(int i = number;
+                                i < m_variables && i < number + 8; i++)
+                            {
+                                vars.append(qMakePair(variable_name(i),
+                                    QSharedPointer<AbstractVariable>(
+                                        new IntegerVariable(i))));
+                            }
+                            m_proxy.addVariables(vars);
+                            break;
+                        }
+                        default:
+                            m_proxy.add_variable(variable_name(number),
+                                    QSharedPointer<AbstractVariable>(
+                                        new IntegerVariable(number)));
+                            break;
+                    }
+                }
+            }
+    };
+
+    /**
+     * \brief Check a varbind of a response.
+     *
+     * \param varbind The varbind.
+     *
+     * \param after If not NULL, the name of the varbind must be greater.
+     *
+     * \return False if the varbind is inconsistent.
+     */
+    bool check(const Varbind& varbind, const Oid* after)
+    {
+        QSharedPointer<AbstractVariable> var = varbind.get_var();
+        if( ! var )
+        {
+            // noSuchObject or endOfMibView
+            return true;
+        }
+        Oid name = varbind.get_name();
+        if(after && ! (*after < name))
+        {
+            return false;
+        }
+        QSharedPointer<IntegerVariable> integer;
+        integer = qSharedPointerDynamicCast<IntegerVariable>(var);
+        return integer && variable_name(integer->value()) == name;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int writers = (argc > 1) ? atoi(argv[1]) : 2;
+    int variables = (argc > 2) ? atoi(argv[2]) : 1000;
+    int requests = (argc > 3) ? atoi(argv[3]) : 10000;
+    if(writers < 1 || variables < 1 || requests < 1)
+    {
+        fprintf(stderr, "usage: %s [writers [variables [requests]]]\n",
+                argv[0]);
+        return 1;
+    }
+
+    LoopbackConnector* loop = new LoopbackConnector;
+    MasterProxy proxy(loop, "variables_stress");
+    proxy.register_subtree(Oid(subtree_oid));
+
+    QAtomicInt stop(0);
+    vector<Writer*> threads;
+    for(int i = 0; i < writers; i++)
+    {
+        threads.push_back(new Writer(proxy, variables, 4711 + i, stop));
+        threads.back()->start();
+    }
+
+    Random random(42);
+    int errors = 0;
+    for(int i = 0; i < requests; i++)
+    {
+        // Publishing is also triggered by events
+        if(i % 64 == 0)
+        {
+            QCoreApplication::processEvents();
+        }
+
+        Oid start = variable_name(random.next(variables));
+        QSharedPointer<ResponsePDU> response;
+        bool next = (i % 2 != 0);
+        if(next)
+        {
+            QSharedPointer<GetNextPDU> getnext(new GetNextPDU);
+            getnext->get_sr().push_back(make_pair(start, Oid()));
+            response = loop->inject(getnext);
+        }
+        else
+        {
+            QSharedPointer<GetPDU> get(new GetPDU);
+            get->get_sr().push_back(start);
+            response = loop->inject(get);
+        }
+
+        if( ! response
+            || response->get_error() != ResponsePDU::noAgentXError
+            || response->varbindlist.size() != 1
+            || ! check(response->varbindlist[0], next ? &start : 0) )
+        {
+            fprintf(stderr, "request %d: inconsistent response\n", i);
+            errors++;
+        }
+    }
+
+    stop.fetchAndStoreOrdered(1);
+    for(size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i]->wait();
+        delete threads[i];
+    }
+
+    printf("%d requests, %d writers, %d inconsistent responses\n",
+           requests, writers, errors);
+    return (errors == 0) ? 0 : 1;
+}
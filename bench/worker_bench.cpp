@@ -0,0 +1,179 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+/*
+ * Benchmark of the worker thread pool with slow variables.
+ *
+ * The subagent, a MasterProxy using a LoopbackConnector, serves variables 
+ * whose Get handler sleeps for a while, as if it had to query a device or 
+ * a file. Get requests addressing several of them are injected one after 
+ * the other, first with the variables evaluated in the MasterProxy's 
+ * thread, then with a pool of worker threads (see 
+ * MasterProxy::set_worker_threads()). The latency of each request is 
+ * measured.
+ *
+ * Usage: worker_bench [threads [varbinds [delay_us [requests]]]]
+ *
+ * The latency cannot fall below varbinds * delay_us without workers, nor 
+ * below varbinds / threads * delay_us with them. How close the runs come 
+ * to these bounds depends on the machine and the Qt build.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "MasterProxy.hpp"
+#include "LoopbackConnector.hpp"
+#include "IntegerVariable.hpp"
+#include "GetPDU.hpp"
+#include "ResponsePDU.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief The subtree served by the subagent.
+     */
+    const char* subtree_oid = "1.3.6.1.4.1.42.3";
+
+    /**
+     * \brief An IntegerVariable which takes long to obtain its value.
+     */
+    class SlowVariable : public IntegerVariable
+    {
+        private:
+            useconds_t m_delay;
+
+        public:
+            SlowVariable(qint32 value, useconds_t delay)
+                : IntegerVariable(value),
+                  m_delay(delay)
+            {
+            }
+
+            virtual void perform_get()
+            {
+                ::usleep(m_delay);
+            }
+    };
+
+    /**
+     * \brief Inject Get requests and report their latencies.
+     *
+     * \return False if a request failed.
+     */
+    bool run(LoopbackConnector* loop, int threads, int varbinds,
+             int requests)
+    {
+        vector<qint64> latencies;
+        QElapsedTimer clock;
+        clock.start();
+
+        for(int i = 0; i < requests; i++)
+        {
+            QSharedPointer<GetPDU> get(new GetPDU);
+            for(int v = 1; v <= varbinds; v++)
+            {
+                Oid name(subtree_oid);
+                name.push_back(v);
+                name.push_back(0);
+                get->get_sr().push_back(name);
+            }
+
+            qint64 start = clock.nsecsElapsed();
+            QSharedPointer<ResponsePDU> response = loop->inject(get);
+            qint64 now = clock.nsecsElapsed();
+
+            if( ! response
+                || response->get_error() != ResponsePDU::noAgentXError
+                || response->varbindlist.size() != size_t(varbinds) )
+            {
+                fprintf(stderr, "request %d failed\n", i);
+                return false;
+            }
+            latencies.push_back((now - start) / 1000);
+        }
+
+        sort(latencies.begin(), latencies.end());
+        double seconds = clock.nsecsElapsed() / 1e9;
+        printf("workers %2d varbinds %d: %.0f requests/s, "
+               "latency p50 %lld us, p99 %lld us, max %lld us\n",
+               threads, varbinds, requests / seconds,
+               (long long)latencies[latencies.size() / 2],
+               (long long)latencies[latencies.size() * 99 / 100],
+               (long long)latencies.back());
+        return true;
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int threads = (argc > 1) ? atoi(argv[1]) : 4;
+    int varbinds = (argc > 2) ? atoi(argv[2]) : 8;
+    int delay = (argc > 3) ? atoi(argv[3]) : 1000;
+    int requests = (argc > 4) ? atoi(argv[4]) : 200;
+    if(threads < 1 || varbinds < 1 || delay < 0 || requests < 1)
+    {
+        fprintf(stderr,
+                "usage: %s [threads [varbinds [delay_us [requests]]]]\n",
+                argv[0]);
+        return 1;
+    }
+
+    LoopbackConnector* loop = new LoopbackConnector;
+    MasterProxy proxy(loop, "worker_bench");
+
+    proxy.register_subtree(Oid(subtree_oid));
+    for(int v = 1; v <= varbinds; v++)
+    {
+        Oid name(subtree_oid);
+        name.push_back(v);
+        name.push_back(0);
+        proxy.add_variable(name,
+                           QSharedPointer<SlowVariable>(
+                                           new SlowVariable(v, delay)));
+    }
+
+    // The variables in the MasterProxy's thread, then on the pool
+    proxy.set_worker_threads(0);
+    if( ! run(loop, 0, varbinds, requests) )
+    {
+        return 1;
+    }
+    proxy.set_worker_threads(threads);
+    if( ! run(loop, threads, varbinds, requests) )
+    {
+        return 1;
+    }
+
+    return 0;
+}
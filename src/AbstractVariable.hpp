@@ -23,6 +23,7 @@
 
 #include "binary.hpp"
 #include "Oid.hpp"
+#include "GetCompletion.hpp"
 
 namespace agentxcpp
 {
@@ -66,6 +67,46 @@ namespace agentxcpp
              */
             virtual void handle_get() = 0;
 
+            /**
+             * \brief Handle AgentX Get request asynchronously.
+             *
+             * This method is called by the MasterProxy object instead of 
+             * handle_get(). It shall update the internal state and then call 
+             * done->finish(). The call to finish() may happen later and from 
+             * any thread, e.g. when the answer of a remote procedure call 
+             * arrived.  While the value is obtained, the MasterProxy 
+             * continues processing other requests; the response containing 
+             * the variable is sent when all its variables are finished.
+             *
+             * The default implementation calls handle_get() and then 
+             * finishes synchronously, reporting a failure if handle_get() 
+             * throws. Variables which obtain their value asynchronously 
+             * override this method.
+             *
+             * \note The value is serialized when the response is sent, i.e.
+             *       after done->finish() was called. It must not be modified 
+             *       from other threads at that time.
+             *
+             * \param done The completion handle. If it is destroyed without
+             *             calling finish(), the Get operation is regarded 
+             *             as failed.
+             *
+             * \exception None.
+             */
+            virtual void handle_get_async(QSharedPointer<GetCompletion> done)
+            {
+                try
+                {
+                    handle_get();
+                }
+                catch(...)
+                {
+                    done->finish(false);
+                    return;
+                }
+                done->finish(true);
+            }
+
 
             /**
              * \brief Result type for the TestSet validation.
@@ -243,6 +284,27 @@ namespace agentxcpp
              */
             virtual binary serialize() const = 0;
 
+            /**
+             * \internal
+             *
+             * \brief Serialize the variable into a buffer.
+             *
+             * Appends the serialized form of the variable to a buffer, so 
+             * that a whole %PDU is encoded into a single string instead of 
+             * one temporary string per variable. The default implementation 
+             * appends the result of serialize(); the variable types of the 
+             * library override it.
+             *
+             * \param serialized The buffer to which the serialized form is
+             *                   appended.
+             *
+             * \exception The function shall not throw.
+             */
+            virtual void serialize_into(binary& serialized) const
+            {
+                serialized += serialize();
+            }
+
             /**
              * \brief Convert an INDEX variable to an Oid part.
              *
@@ -0,0 +1,381 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include "Connector.hpp"
+#include "util.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+Connector::Connector()
+    : m_generation(0)
+{
+    // We want to deliver this type to the receivers of send_request():
+    qRegisterMetaType< QSharedPointer<ResponsePDU> >(
+                                        "QSharedPointer<ResponsePDU>");
+}
+
+
+Connector::~Connector()
+{
+}
+
+
+void Connector::dispatch(QSharedPointer<PDU> pdu)
+{
+    // Special case: ResponsePDU's
+    QSharedPointer<ResponsePDU> response;
+    response = qSharedPointerDynamicCast<ResponsePDU>(pdu);
+    if(response)
+    {
+        // The session lock keeps the receiver of a send_request() alive 
+        // (see cancel_request())
+        m_sessions_mutex.lock();
+        m_response_mutex.lock();
+        std::map<quint32, QObject*>::iterator r;
+        r = m_receivers.find(response->get_packetID());
+        if(r != m_receivers.end())
+        {
+            // Response to send_request()
+            QObject* receiver = r->second;
+            m_receivers.erase(r);
+            m_response_mutex.unlock();
+            invoke_receiver(receiver, "handle_response",
+                            Q_ARG(QSharedPointer<ResponsePDU>, response));
+            return;
+        }
+        m_sessions_mutex.unlock();
+
+        // Was a response
+        std::map< quint32, QSharedPointer<ResponsePDU> >::iterator i;
+        i = this->m_responses.find( response->get_packetID() );
+        if(i != this->m_responses.end())
+        {
+            // Someone is waiting for this response
+            i->second = response;
+            m_response_mutex.unlock();
+            m_response_arrived.wakeAll();
+        }
+        else
+        {
+            // Nobody was waiting for the response
+            // -> ignore it
+            m_response_mutex.unlock();
+        }
+    }
+    else
+    {
+        // Was not a Response
+        // -> pass to the session
+        m_sessions_mutex.lock();
+        std::map<quint32, QObject*>::iterator s;
+        s = m_sessions.find(pdu->get_sessionID());
+        if(s != m_sessions.end())
+        {
+            invoke_receiver(s->second, "handle_pdu",
+                            Q_ARG(QSharedPointer<PDU>, pdu));
+            return;
+        }
+        m_sessions_mutex.unlock();
+
+        // Unknown session
+        // -> emit signal
+        emit pduArrived(pdu);
+
+        // -> answer it (RFC 2741, 7.2.2. "Subagent Processing", step 3)
+        QSharedPointer<ResponsePDU> response(new ResponsePDU);
+        response->set_sessionID( pdu->get_sessionID() );
+        response->set_transactionID( pdu->get_transactionID() );
+        response->set_packetID( pdu->get_packetID() );
+        response->set_error( ResponsePDU::notOpen );
+        try
+        {
+            send(response);
+        }
+        catch(timeout_error) { /* connection loss. Ignore.*/ }
+        catch(disconnected) { /* connection loss. Ignore.*/ }
+    }
+}
+
+
+void Connector::invoke_receiver(QObject* receiver, const char* slot,
+                                QGenericArgument arg)
+{
+    if(receiver->thread() == QThread::currentThread())
+    {
+        // Not under the lock
+        m_sessions_mutex.unlock();
+        QMetaObject::invokeMethod(receiver, slot, Qt::DirectConnection, arg);
+    }
+    else
+    {
+        // Post under the lock
+        QMetaObject::invokeMethod(receiver, slot, Qt::QueuedConnection, arg);
+        m_sessions_mutex.unlock();
+    }
+}
+
+
+void Connector::abort_requests()
+{
+    QMutexLocker locker(&m_response_mutex);
+
+    m_generation++;
+    m_response_arrived.wakeAll();
+}
+
+
+unsigned long Connector::get_timeout() const
+{
+    return ULONG_MAX;
+}
+
+
+QSharedPointer<ResponsePDU> Connector::wait_for_response(quint32 packetID,
+                                                         quint32 generation,
+                                                         unsigned long timeout)
+{
+    QElapsedTimer waited;
+    waited.start();
+    while ( ! (m_responses[packetID]) )
+    {
+        if(m_generation != generation)
+        {
+            // The response is lost with the connection
+            m_responses.erase(packetID);
+            throw disconnected();
+        }
+        if(timeout == ULONG_MAX)
+        {
+            m_response_arrived.wait(&m_response_mutex);
+            continue;
+        }
+        qint64 elapsed = waited.elapsed();
+        if(elapsed >= qint64(timeout))
+        {
+            // Give up; a late response will be discarded
+            m_responses.erase(packetID);
+            throw timeout_error();
+        }
+        m_response_arrived.wait(&m_response_mutex, timeout - elapsed);
+    }
+
+    QSharedPointer<ResponsePDU> response = m_responses[packetID];
+    m_responses.erase(packetID);
+
+    return response;
+}
+
+
+std::vector< QSharedPointer<ResponsePDU> >
+Connector::request_batch(const std::vector< QSharedPointer<PDU> >& pdus,
+                         unsigned long timeout)
+{
+    // Announce all responses before sending
+    m_response_mutex.lock();
+    quint32 generation = m_generation;
+    for(size_t i = 0; i < pdus.size(); i++)
+    {
+        m_responses[pdus[i]->get_packetID()] = QSharedPointer<ResponsePDU>();
+    }
+    m_response_mutex.unlock();
+
+    // Send all (without holding m_response_mutex, because send() may block)
+    try
+    {
+        for(size_t i = 0; i < pdus.size(); i++)
+        {
+            send(pdus[i]);
+        }
+    }
+    catch(...)
+    {
+        m_response_mutex.lock();
+        for(size_t i = 0; i < pdus.size(); i++)
+        {
+            m_responses.erase(pdus[i]->get_packetID());
+        }
+        m_response_mutex.unlock();
+        throw;
+    }
+
+    // Collect the responses
+    std::vector< QSharedPointer<ResponsePDU> > responses;
+    responses.reserve(pdus.size());
+    QMutexLocker locker(&m_response_mutex);
+    size_t i = 0;
+    try
+    {
+        for( ; i < pdus.size(); i++)
+        {
+            responses.push_back(wait_for_response(pdus[i]->get_packetID(),
+                                                  generation, timeout));
+        }
+    }
+    catch(...)
+    {
+        // Discard the remaining entries
+        for(i++; i < pdus.size(); i++)
+        {
+            m_responses.erase(pdus[i]->get_packetID());
+        }
+        throw;
+    }
+
+    return responses;
+}
+
+
+bool Connector::send_request(QSharedPointer<PDU> pdu, QObject* receiver)
+{
+    // Announce the request before sending, because the response may arrive 
+    // at any time after that
+    m_response_mutex.lock();
+    m_receivers[pdu->get_packetID()] = receiver;
+    m_response_mutex.unlock();
+
+    try
+    {
+        return trySend(pdu);
+    }
+    catch(...)
+    {
+        cancel_request(pdu->get_packetID());
+        throw;
+    }
+}
+
+
+void Connector::cancel_request(quint32 packetID)
+{
+    // Waits for dispatch() if it is passing the response right now
+    QMutexLocker sessions_locker(&m_sessions_mutex);
+    QMutexLocker locker(&m_response_mutex);
+
+    m_receivers.erase(packetID);
+}
+
+
+void Connector::add_session(quint32 sessionID, QObject* receiver)
+{
+    QMutexLocker locker(&m_sessions_mutex);
+
+    m_sessions[sessionID] = receiver;
+}
+
+
+void Connector::remove_session(quint32 sessionID)
+{
+    QMutexLocker locker(&m_sessions_mutex);
+
+    m_sessions.erase(sessionID);
+}
+
+
+size_t Connector::session_count()
+{
+    QMutexLocker locker(&m_sessions_mutex);
+
+    return m_sessions.size();
+}
+
+
+bool Connector::dispatch_buffer(binary& buf)
+{
+    size_t pos = 0;
+    while(buf.size() - pos >= 20)
+    {
+        // Extract endianness flag
+        bool big_endian = ( buf[pos + 2] & (1<<4) ) ? true : false;
+
+        // Extract payload length
+        binary::const_iterator p = buf.begin() + pos + 16;
+        quint32 payload_length = read32(p, big_endian);
+        if( payload_length % 4 != 0 )
+        {
+            // payload length must be a multiple of 4!
+            // See RFC 2741, 6.1. "AgentX PDU Header"
+            // We don't know where next PDU starts within the byte stream.
+            buf.erase(0, pos);
+            return false;
+        }
+        if(buf.size() - pos - 20 < payload_length)
+        {
+            // Payload did not completely arrive
+            break;
+        }
+
+        // Parse PDU (malformed ones are dropped). The PDU keeps its buffer 
+        // (see PDU::parse_pdu()).
+        QSharedPointer<binary> pdu_data(new binary);
+        pdu_data->assign(buf, pos, 20 + payload_length);
+        int error;
+        QSharedPointer<PDU> pdu = PDU::parse_pdu(pdu_data, error);
+        pos += 20 + payload_length;
+
+        // Deliver it
+        if(error == 0)
+        {
+            dispatch(pdu);
+        }
+    }
+
+    // Keep the incomplete rest
+    buf.erase(0, pos);
+
+    return true;
+}
+
+
+QSharedPointer<ResponsePDU> Connector::request(QSharedPointer<PDU> pdu,
+                                               unsigned long timeout)
+{
+    // Announce that we await a response. This is done before sending, 
+    // because the response may arrive at any time after that.
+    m_response_mutex.lock();
+    quint32 generation = m_generation;
+    m_responses[pdu->get_packetID()] = QSharedPointer<ResponsePDU>();
+    m_response_mutex.unlock();
+
+    // Send (without holding m_response_mutex, because send() may block)
+    try
+    {
+        send(pdu);
+    }
+    catch(...)
+    {
+        m_response_mutex.lock();
+        m_responses.erase(pdu->get_packetID());
+        m_response_mutex.unlock();
+        throw;
+    }
+
+    QMutexLocker locker(&m_response_mutex);
+    QSharedPointer<ResponsePDU> response;
+    // throws timeout_error and disconnected:
+    response = wait_for_response(pdu->get_packetID(), generation, timeout);
+
+    return response;
+}
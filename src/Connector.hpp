@@ -0,0 +1,484 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _CONNECTOR_H_
+#define _CONNECTOR_H_
+
+#include <map>
+#include <vector>
+#include <climits>
+
+#include <QSharedPointer>
+
+#include <QObject>
+#include <QWaitCondition>
+#include <QMutex>
+
+#include "PDU.hpp"
+#include "ResponsePDU.hpp"
+#include "binary.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief The transport interface between a MasterProxy and the master
+     *        agent.
+     *
+     * A connector transports %PDU's between the subagent and the master 
+     * agent. It provides the following services:
+     * - Methods to connect and disconnect, and a method to obtain the
+     *   current state,
+     * - A QT signal which is emitted when a PDU arrives (except for 
+     *   %ResponsePDU's),
+     * - A request service which sends a PDU and then blocks until the 
+     *   corresponding ResponsePDU arrived,
+     * - A send service which just sends a PDU, with a bounded outbound
+     *   queue.
+     *
+     * All public methods can be called from any thread. 
+     *
+     * The request service is implemented by this class. Received 
+     * %ResponsePDU's are transmitted via the m_responses map, which assigns 
+     * a packetID a ResponsePDU. request() adds an entry to the map with the 
+     * packetID of the request and a NULL ResponsePDU (i.e. a NULL pointer), 
+     * indicating that a ResponsePDU with the same packetID is awaited. 
+     * Subclasses pass each received %PDU to dispatch(), which adds awaited 
+     * %ResponsePDU's to the map, discards unexpected ones and delivers all 
+     * other %PDU's.
+     *
+     * A connector can carry several AgentX sessions (RFC 2741, 7.1.1 
+     * "Processing the agentx-Open-PDU"). Each session registers a receiver 
+     * with add_session(). dispatch() looks up the receiver by the sessionID 
+     * of the %PDU and invokes its handle_pdu() slot. %PDU's for unknown 
+     * sessions are delivered via the pduArrived() signal and answered with a 
+     * notOpen error. The packetID's of 
+     * the sessions do not collide, because they are drawn from a single 
+     * counter (see PDU::PDU()).
+     *
+     * Subclasses implement the actual transport, e.g. UnixDomainConnector 
+     * (based on QLocalSocket) or EpollConnector (based on a raw socket and 
+     * epoll).
+     */
+    class Connector : public QObject
+    {
+        Q_OBJECT
+
+	private:
+
+            /**
+             * \brief Storage for ResponsePDU's.
+             *
+             * This map contains entries with packetID as key and 
+             * %ResponsePDU's as values. An entry with a NULL pointer value 
+             * means that a %ResponsePDU with the given packetID is awaited.
+             *
+             * This member is protected by m_response_mutex.
+             */
+	    std::map< quint32, QSharedPointer<ResponsePDU> > m_responses;
+
+            /**
+             * \brief Used to protect m_responses and for m_response_arrived.
+             */
+	    QMutex m_response_mutex;
+
+            /**
+             * \brief A waitcondition to inform waiters of ResponsePDU's.
+             *
+             * The m_response_mutex is used for synchronization.
+             */
+	    QWaitCondition m_response_arrived;
+
+            /**
+             * \brief Counts the losses of the connection.
+             *
+             * A waiter of a %ResponsePDU gives up when this number changes, 
+             * because the response cannot arrive anymore (see 
+             * abort_requests()).
+             *
+             * This member is protected by m_response_mutex.
+             */
+            quint32 m_generation;
+
+            /**
+             * \brief The receivers of the responses to send_request(), by 
+             *        packetID.
+             *
+             * This member is protected by m_response_mutex.
+             */
+            std::map<quint32, QObject*> m_receivers;
+
+            /**
+             * \brief Wait for a %ResponsePDU.
+             *
+             * m_response_mutex must be locked by the caller. The entry of 
+             * the packetID is removed from m_responses in any case.
+             *
+             * \param packetID The packetID of the awaited %ResponsePDU.
+             *
+             * \param generation The value of m_generation when the request 
+             *                   was announced.
+             *
+             * \param timeout How long to wait, in milliseconds. ULONG_MAX
+             *                means forever.
+             *
+             * \exception timeout_error If the response did not arrive in time.
+             *
+             * \exception disconnected If the connection was lost meanwhile.
+             */
+            QSharedPointer<ResponsePDU> wait_for_response(quint32 packetID,
+                                                          quint32 generation,
+                                                          unsigned long timeout);
+
+            /**
+             * \brief The receivers of the sessions, by sessionID.
+             *
+             * This member is protected by m_sessions_mutex.
+             */
+            std::map<quint32, QObject*> m_sessions;
+
+            /**
+             * \brief Used to protect m_sessions.
+             *
+             * It is also held while dispatch() posts a %PDU or a response 
+             * to a receiver in another thread, see invoke_receiver(). If 
+             * both mutexes are needed, it is locked before 
+             * m_response_mutex.
+             */
+            QMutex m_sessions_mutex;
+
+            /**
+             * \brief Pass a %PDU or a response to a receiver.
+             *
+             * m_sessions_mutex must be locked by the caller and is unlocked 
+             * by this function.
+             *
+             * If the receiver lives in the current thread, the lock is 
+             * released before the slot is called directly. Thus, the slot 
+             * is not run under the lock and may add or remove sessions. The 
+             * receiver cannot be destroyed meanwhile, because it is only 
+             * destroyed in its own thread.
+             *
+             * Otherwise, the call is queued while the lock is held, so that 
+             * the receiver is not destroyed while the event is posted (its 
+             * destructor calls remove_session() or cancel_request()).
+             *
+             * \param receiver The receiver.
+             *
+             * \param slot The name of the slot.
+             *
+             * \param arg The argument of the slot.
+             */
+            void invoke_receiver(QObject* receiver, const char* slot,
+                                 QGenericArgument arg);
+
+	protected:
+
+            /**
+             * \brief Deliver a received %PDU.
+             *
+             * %ResponsePDU's to send_request() are passed to the receiver.  
+             * Other %ResponsePDU's are stored to the m_responses map, if the 
+             * map has an entry for the packetID of the received 
+             * %ResponsePDU. Otherwise, the %ResponsePDU is discarded. All other %PDU's are 
+             * passed to the handle_pdu() slot of the receiver registered for 
+             * their sessionID (using an automatic connection, i.e. a queued 
+             * one if the receiver lives in another thread). If no receiver 
+             * is registered, pduArrived() is emitted and the %PDU is 
+             * answered with a notOpen error, as required by RFC 2741, 7.2.2.  
+             * "Subagent Processing", step 3.
+             *
+             * This function is called by subclasses for each received %PDU.
+             */
+            void dispatch(QSharedPointer<PDU> pdu);
+
+            /**
+             * \brief Fail all pending requests.
+             *
+             * Wakes all threads waiting in request() or request_batch(), 
+             * which then throw disconnected. Subclasses call this function 
+             * when the connection is lost, before emitting connectionLost().
+             */
+            void abort_requests();
+
+            /**
+             * \brief Deliver the complete %PDU's of a receive buffer.
+             *
+             * Takes all complete %PDU's from the beginning of the buffer, 
+             * parses them and passes them to dispatch(). Malformed %PDU's are 
+             * discarded. An incomplete %PDU at the end stays in the buffer 
+             * until more data arrives. The buffer keeps its capacity.
+             *
+             * This function is used by connectors which read the byte 
+             * stream into their own buffer (e.g. EpollConnector).
+             *
+             * \param buf The received data.
+             *
+             * \return False if the byte stream is corrupted (i.e. the start
+             *         of the next %PDU cannot be determined). The connection 
+             *         should be closed in that case.
+             */
+            bool dispatch_buffer(binary& buf);
+
+	signals:
+	    /**
+	     * \brief Emitted when a PDU arrived.
+             *
+             * This signal is emitted once for every arrived PDU, except for 
+             * %ResponsePDU's.
+	     */
+	    void pduArrived(QSharedPointer<PDU>);
+
+	    /**
+	     * \brief Emitted when the connection to the master agent broke.
+	     *
+	     * The signal is not emitted if the connection is closed with 
+	     * disconnect(). It may be emitted from any thread.
+	     */
+	    void connectionLost();
+
+        public:
+            /**
+             * \brief Constructor.
+             */
+            Connector();
+
+            /**
+             * \brief Destructor.
+             */
+            virtual ~Connector();
+
+            /**
+             * \brief Connect to the remote entity.
+             *
+             * This function connects to the remote entity and starts receiving
+             * %PDU's.  If the object is already connected, the function does
+             * nothing.
+             *
+             * \return True on success (i.e. if the object is in connected
+             *         state), false otherwise.
+             */
+            virtual bool connect() = 0;
+
+            /**
+             * \brief Disconnect from the remote entity.
+             *
+             * Stops receiving %PDU's and disconnects the remote entity. The 
+             * object will be in disconnected state after this method.
+             */
+            virtual void disconnect() = 0;
+
+            /**
+	     * \brief Find out whether the object is currently connected.
+	     *
+	     * \return True if the object is connected, false otherwise.
+	     */
+	    virtual bool is_connected() = 0;
+
+            /**
+             * \brief Get the timeout of the connector.
+             *
+             * This is the timeout used for connecting and sending, which 
+             * also suits to wait for the response of the master agent.
+             *
+             * \return The timeout in milliseconds. The default 
+             *         implementation returns ULONG_MAX, i.e. no timeout.
+             */
+            virtual unsigned long get_timeout() const;
+
+            /**
+             * \brief Send a %PDU.
+             *
+             * The function may return before the %PDU is actually sent. If 
+             * the outbound queue is full (see set_high_water_mark()), it 
+             * blocks until there is enough space, or the timeout of the 
+             * connector expires.
+             *
+             * \exception timeout_error If the outbound queue stays full.
+             *
+             * \exception disconnected If the connector is not connected, or
+             *                         the connection is lost while 
+             *                         waiting for space.
+             */
+	    virtual void send(QSharedPointer<PDU> pdu) = 0;
+
+            /**
+             * \brief Send a %PDU without blocking.
+             *
+             * Like send(), but fails immediately if the outbound queue is 
+             * full.
+             *
+             * \return True if the %PDU was enqueued, false if the queue is
+             *         full.
+             *
+             * \exception disconnected If the connector is not connected.
+             */
+            virtual bool trySend(QSharedPointer<PDU> pdu) = 0;
+
+            /**
+             * \brief Set the high-water mark of the outbound queue.
+             *
+             * The high-water mark limits the number of bytes which were 
+             * passed to send() or trySend(), but not yet written to the 
+             * master agent.
+             *
+             * \param bytes The high-water mark in bytes. A single %PDU
+             *              exceeding it is still sent if nothing else is 
+             *              buffered.
+             */
+            virtual void set_high_water_mark(qint64 bytes) = 0;
+
+            /**
+             * \brief Get the high-water mark of the outbound queue.
+             */
+            virtual qint64 high_water_mark() = 0;
+
+            /**
+             * \brief Get the number of %PDU's waiting in the outbound
+             *        queue.
+             */
+            virtual size_t queue_depth() = 0;
+
+            /**
+             * \brief Get the number of bytes not yet written to the master
+             *        agent.
+             */
+            virtual qint64 bytes_buffered() = 0;
+
+            /**
+             * \brief Send a PDU and wait for the response.
+             *
+             * This method adds an entry to m_responses to indicate that a 
+             * ResponsePDU is awaited, then sends the %PDU using send(). 
+             * Finally, it waits until that ResponsePDU arrives and returns 
+             * it (it is removed from m_responses).
+             *
+             * \param pdu The %PDU to send.
+             *
+             * \param timeout How long to wait for the response, in
+             *                milliseconds. By default, the method waits 
+             *                forever. A response arriving after the timeout 
+             *                is discarded.
+             *
+             * \exception timeout_error If the outbound queue stays full (see
+             *                          send()), or if the response did not 
+             *                          arrive in time.
+             *
+             * \exception disconnected If the connection was lost before the 
+             *                         response arrived.
+             */
+	    QSharedPointer<ResponsePDU> request(QSharedPointer<PDU> pdu,
+						unsigned long timeout = ULONG_MAX);
+
+            /**
+             * \brief Send several %PDU's and wait for all responses.
+             *
+             * Like request(), but all %PDU's are sent before the first 
+             * response is awaited, so that the master agent processes them 
+             * while the following ones are still being sent.
+             *
+             * \param pdus The %PDU's to send.
+             *
+             * \param timeout How long to wait for each response, in 
+             *                milliseconds, counted from the arrival of the 
+             *                previous one (or from the end of sending). By 
+             *                default, the method waits forever.
+             *
+             * \return The responses, in the order of the requests.
+             *
+             * \exception timeout_error If the outbound queue stays full (see
+             *                          send()), or if a response did not 
+             *                          arrive in time.
+             *
+             * \exception disconnected If the connection was lost before all 
+             *                         responses arrived.
+             */
+            std::vector< QSharedPointer<ResponsePDU> >
+                request_batch(const std::vector< QSharedPointer<PDU> >& pdus,
+                              unsigned long timeout = ULONG_MAX);
+
+            /**
+             * \brief Send a %PDU without waiting for the response.
+             *
+             * The %PDU is sent with trySend(). When the response arrives, 
+             * it is passed to the slot 
+             * <tt>handle_response(QSharedPointer<ResponsePDU>)</tt> of the 
+             * receiver (using an automatic connection, like the %PDU's of a 
+             * session). There is no timeout; the caller uses 
+             * cancel_request() if it gives up.
+             *
+             * \param pdu The %PDU to send.
+             *
+             * \param receiver The receiver of the response. It must call
+             *                 cancel_request() before it is destroyed.
+             *
+             * \return True if the %PDU was enqueued, false if the outbound 
+             *         queue is full. The response is awaited in both cases.
+             *
+             * \exception disconnected If trySend() throws it (e.g. 
+             *                         LoopbackConnector when not 
+             *                         connected).
+             */
+            bool send_request(QSharedPointer<PDU> pdu, QObject* receiver);
+
+            /**
+             * \brief Stop waiting for the response of a send_request().
+             *
+             * A response arriving later is discarded. When the function 
+             * returns, the response is not being passed to the receiver 
+             * anymore (but may still be queued for it, if the receiver lives 
+             * in another thread).
+             *
+             * \param packetID The packetID of the request.
+             */
+            void cancel_request(quint32 packetID);
+
+            /**
+             * \brief Route the %PDU's of a session to a receiver.
+             *
+             * After this call, received %PDU's (except %ResponsePDU's) with 
+             * the given sessionID are passed to the receiver's slot 
+             * <tt>handle_pdu(QSharedPointer<PDU>)</tt> instead of being 
+             * emitted via pduArrived(). A previous receiver of the session 
+             * is replaced.
+             *
+             * \param sessionID The sessionID assigned by the master agent.
+             *
+             * \param receiver The receiver. It must stay valid until
+             *                 remove_session() is called.
+             */
+            void add_session(quint32 sessionID, QObject* receiver);
+
+            /**
+             * \brief Stop routing the %PDU's of a session.
+             *
+             * Does nothing if the session has no receiver.
+             */
+            void remove_session(quint32 sessionID);
+
+            /**
+             * \brief The number of sessions with a receiver.
+             */
+            size_t session_count();
+    };
+
+}
+
+#endif  //_CONNECTOR_H_
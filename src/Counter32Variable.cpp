@@ -26,11 +26,15 @@ using namespace agentxcpp;
 binary Counter32Variable::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void Counter32Variable::serialize_into(binary& serialized) const
+{
     // encode value (big endian)
     write32(serialized, v);
-
-    return serialized;
 }
 
 
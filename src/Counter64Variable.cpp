@@ -26,11 +26,15 @@ using namespace agentxcpp;
 binary Counter64Variable::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void Counter64Variable::serialize_into(binary& serialized) const
+{
     // encode value (big endian)
     write64(serialized, v);
-
-    return serialized;
 }
 
 
@@ -0,0 +1,463 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "EpollConnector.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+EpollConnector::EpollConnector(const std::string& _unix_domain_socket,
+                               unsigned _timeout)
+: Connector(),
+  m_fd(-1),
+  m_epoll(-1),
+  m_wakeup(-1),
+  m_reader(this),
+  m_high_water_mark(256*1024),
+  m_filename(_unix_domain_socket),
+  m_timeout(_timeout)
+{
+    // We want to deliver this types within a signal:
+    qRegisterMetaType< QSharedPointer<PDU> >("QSharedPointer<PDU>");
+}
+
+
+EpollConnector::~EpollConnector()
+{
+    disconnect();
+}
+
+
+bool EpollConnector::connect()
+{
+    QMutexLocker connection_locker(&m_connection_mutex);
+
+    if(is_connected())
+    {
+        return true;
+    }
+
+    // A reader thread which terminated on connection loss
+    m_reader.wait();
+    close_fds();
+
+    // Create and connect the socket
+    int fd = open_socket();
+    if(fd == -1)
+    {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // Create the epoll instance
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_epoll == -1 || m_wakeup == -1)
+    {
+        ::close(fd);
+        close_fds();
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeup;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+
+    {
+        QMutexLocker locker(&m_send_mutex);
+        m_fd = fd;
+        m_outbuf.clear();
+        m_outbuf_pdus.clear();
+    }
+    m_inbuf.clear();
+
+    // Start receiving
+    m_reader.start();
+
+    return true;
+}
+
+
+int EpollConnector::open_socket()
+{
+    struct sockaddr_un addr;
+    if(m_filename.size() >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, m_filename.c_str());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        return -1;
+    }
+    if(::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                 sizeof(addr)) == -1)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+void EpollConnector::disconnect()
+{
+    QMutexLocker connection_locker(&m_connection_mutex);
+
+    if(m_wakeup != -1)
+    {
+        // Stop the reader thread
+        quint64 one = 1;
+        if(::write(m_wakeup, &one, sizeof(one)) != sizeof(one))
+        {
+            // Cannot happen for an eventfd
+        }
+    }
+    m_reader.wait();
+
+    close_fds();
+}
+
+
+void EpollConnector::close_fds()
+{
+    {
+        QMutexLocker locker(&m_send_mutex);
+        if(m_fd != -1)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+
+        // Data not yet written is lost
+        m_outbuf.clear();
+        m_outbuf_pdus.clear();
+        m_outbuf_space.wakeAll();
+    }
+
+    if(m_epoll != -1)
+    {
+        ::close(m_epoll);
+        m_epoll = -1;
+    }
+    if(m_wakeup != -1)
+    {
+        ::close(m_wakeup);
+        m_wakeup = -1;
+    }
+}
+
+
+bool EpollConnector::is_connected()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_fd != -1;
+}
+
+
+unsigned long EpollConnector::get_timeout() const
+{
+    return m_timeout;
+}
+
+
+void EpollConnector::run()
+{
+    struct epoll_event events[4];
+    while(true)
+    {
+        int n = epoll_wait(m_epoll, events, 4, -1);
+        if(n == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        bool lost = false;
+        for(int i = 0; i < n; i++)
+        {
+            if(events[i].data.fd == m_wakeup)
+            {
+                // disconnect() was called
+                return;
+            }
+
+            if(events[i].events & EPOLLOUT)
+            {
+                // Socket is writable again
+                QMutexLocker locker(&m_send_mutex);
+                write_locked(0, 0);
+            }
+            if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                if( ! receive() )
+                {
+                    lost = true;
+                }
+            }
+        }
+        if(lost)
+        {
+            break;
+        }
+    }
+
+    // Connection lost. Mark as disconnected; the file descriptors are closed 
+    // by the next connect() or disconnect().
+    {
+        QMutexLocker locker(&m_send_mutex);
+        if(m_fd != -1)
+        {
+            ::shutdown(m_fd, SHUT_RDWR);
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        m_outbuf.clear();
+        m_outbuf_pdus.clear();
+        m_outbuf_space.wakeAll();
+    }
+    abort_requests();
+    emit connectionLost();
+}
+
+
+bool EpollConnector::receive()
+{
+    // Read until EAGAIN (the socket is edge-triggered)
+    const size_t chunk = 16*1024;
+    while(true)
+    {
+        size_t old_size = m_inbuf.size();
+        m_inbuf.resize(old_size + chunk);
+        ssize_t bytes = ::read(m_fd, &m_inbuf[old_size], chunk);
+        if(bytes > 0)
+        {
+            m_inbuf.resize(old_size + bytes);
+            continue;
+        }
+        m_inbuf.resize(old_size);
+
+        if(bytes == 0)
+        {
+            // Closed by the master agent
+            return false;
+        }
+        if(errno == EINTR)
+        {
+            continue;
+        }
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+        return false;   // error
+    }
+
+    // Process all complete PDU's
+    return dispatch_buffer(m_inbuf);
+}
+
+
+void EpollConnector::write_locked(const quint8* data, size_t size)
+{
+    if(m_fd == -1)
+    {
+        return;
+    }
+
+    // Buffered data is written first
+    size_t flushed = 0;
+    while(flushed < m_outbuf.size())
+    {
+        ssize_t bytes = ::send(m_fd, m_outbuf.data() + flushed,
+                               m_outbuf.size() - flushed, MSG_NOSIGNAL);
+        if(bytes == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;  // EAGAIN or error
+        }
+        flushed += bytes;
+    }
+    if(flushed != 0)
+    {
+        m_outbuf.erase(0, flushed);
+        while( ! m_outbuf_pdus.empty() && m_outbuf_pdus.front() <= flushed)
+        {
+            m_outbuf_pdus.pop_front();
+        }
+        std::deque<size_t>::iterator i;
+        for(i = m_outbuf_pdus.begin(); i != m_outbuf_pdus.end(); i++)
+        {
+            *i -= flushed;
+        }
+        m_outbuf_space.wakeAll();
+    }
+
+    if(data == 0)
+    {
+        return;
+    }
+
+    // Write the new data directly, if nothing is pending
+    size_t written = 0;
+    while(m_outbuf.empty() && written < size)
+    {
+        ssize_t bytes = ::send(m_fd, data + written, size - written,
+                               MSG_NOSIGNAL);
+        if(bytes == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;  // EAGAIN or error
+        }
+        written += bytes;
+    }
+
+    // Keep the rest until the socket is writable
+    if(written < size)
+    {
+        m_outbuf.append(data + written, size - written);
+        m_outbuf_pdus.push_back(m_outbuf.size());
+    }
+}
+
+
+bool EpollConnector::enqueue(const binary& data)
+{
+    if(m_fd == -1)
+    {
+        throw(disconnected());
+    }
+    qint64 buffered = m_outbuf.size();
+    if(buffered != 0 && buffered + qint64(data.size()) > m_high_water_mark)
+    {
+        // Buffer is full
+        return false;
+    }
+
+    write_locked(data.data(), data.size());
+    return true;
+}
+
+
+void EpollConnector::send(QSharedPointer<PDU> pdu)
+{
+    binary data = pdu->serialize();
+
+    QMutexLocker locker(&m_send_mutex);
+    if(enqueue(data))
+    {
+        return;
+    }
+
+    // Buffer is full. We must not wait within the reader thread, because 
+    // the buffer is flushed there.
+    if(QThread::currentThread() == &m_reader)
+    {
+        throw(timeout_error());
+    }
+
+    // Wait for space
+    QElapsedTimer timer;
+    timer.start();
+    while( ! enqueue(data) )
+    {
+        qint64 left = qint64(m_timeout) - timer.elapsed();
+        if(left <= 0)
+        {
+            throw(timeout_error());
+        }
+        m_outbuf_space.wait(&m_send_mutex, left);
+    }
+}
+
+
+bool EpollConnector::trySend(QSharedPointer<PDU> pdu)
+{
+    binary data = pdu->serialize();
+
+    QMutexLocker locker(&m_send_mutex);
+    return enqueue(data);
+}
+
+
+void EpollConnector::set_high_water_mark(qint64 bytes)
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    m_high_water_mark = bytes;
+    m_outbuf_space.wakeAll();
+}
+
+
+qint64 EpollConnector::high_water_mark()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_high_water_mark;
+}
+
+
+size_t EpollConnector::queue_depth()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_outbuf_pdus.size();
+}
+
+
+qint64 EpollConnector::bytes_buffered()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_outbuf.size();
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _EPOLL_CONNECTOR_H_
+#define _EPOLL_CONNECTOR_H_
+
+#include <string>
+#include <deque>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "Connector.hpp"
+#include "binary.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \brief Connect to a unix domain socket using epoll.
+     *
+     * This connector can be passed to 
+     * MasterProxy::MasterProxy(Connector*, std::string, quint8, Oid) to 
+     * communicate with the master agent without QLocalSocket and without a 
+     * Qt event loop for the connection. It uses a raw \c AF_UNIX socket and 
+     * a reader thread which waits for events with \c epoll. It is available 
+     * on Linux only.
+     *
+     * \code
+     * MasterProxy master(new EpollConnector("/var/agentx/master"),
+     *                    "my subagent");
+     * \endcode
+     *
+     * \internal
+     *
+     * Unlike UnixDomainConnector, an EpollConnector object must \e not be 
+     * moved to another thread; it starts its own reader thread on connect().
+     *
+     * \par Receiving
+     *
+     * The socket is registered edge-triggered. When the socket becomes 
+     * readable, the reader thread reads until \c EAGAIN into m_inbuf, which 
+     * keeps its capacity between reads. Then all complete %PDU's are taken 
+     * from the buffer, parsed and passed to Connector::dispatch(). An 
+     * incomplete %PDU stays in the buffer until more data arrives. The 
+     * pduArrived() signal is therefore emitted from the reader thread.
+     *
+     * \par Sending
+     *
+     * send() and trySend() serialize the %PDU in the calling thread and 
+     * write it directly to the socket, without invoking any slot. If the 
+     * socket does not accept all data, the remainder is kept in m_outbuf and 
+     * written by the reader thread when the socket becomes writable again.  
+     * m_outbuf is limited by the high-water mark; data in m_outbuf is always 
+     * written before new data. All sending members are protected by 
+     * m_send_mutex.
+     *
+     * \par Connection handling
+     *
+     * connect() creates and connects the socket, creates the epoll instance 
+     * and starts the reader thread. disconnect() wakes the reader thread via 
+     * an eventfd (m_wakeup), waits until it terminated and closes the file 
+     * descriptors. If the reader thread detects a connection loss, it 
+     * terminates on its own and the object is in disconnected state.
+     *
+     * \endinternal
+     */
+    class EpollConnector : public Connector
+    {
+	private:
+
+            /**
+             * \brief The reader thread.
+             *
+             * Runs EpollConnector::run().
+             */
+            class ReaderThread : public QThread
+            {
+                private:
+                    /**
+                     * \brief The connector.
+                     */
+                    EpollConnector* m_connector;
+
+                protected:
+                    /**
+                     * \brief The thread function.
+                     */
+                    virtual void run()
+                    {
+                        m_connector->run();
+                    }
+
+                public:
+                    /**
+                     * \brief Constructor.
+                     */
+                    ReaderThread(EpollConnector* connector)
+                        : m_connector(connector)
+                    {
+                    }
+            };
+
+            /**
+             * \brief The socket, or -1 if disconnected.
+             *
+             * Protected by m_send_mutex.
+             */
+            int m_fd;
+
+            /**
+             * \brief The epoll instance, or -1 if disconnected.
+             */
+            int m_epoll;
+
+            /**
+             * \brief An eventfd to stop the reader thread, or -1 if
+             *        disconnected.
+             */
+            int m_wakeup;
+
+            /**
+             * \brief The reader thread.
+             */
+            ReaderThread m_reader;
+
+            /**
+             * \brief Received data which is not yet processed.
+             *
+             * Only accessed by the reader thread.
+             */
+            binary m_inbuf;
+
+            /**
+             * \brief Data not yet accepted by the socket.
+             *
+             * Protected by m_send_mutex.
+             */
+            binary m_outbuf;
+
+            /**
+             * \brief Where the %PDU's in m_outbuf end.
+             *
+             * One entry per %PDU which is (partially) contained in m_outbuf, 
+             * holding the offset behind its last byte. Protected by 
+             * m_send_mutex.
+             */
+            std::deque<size_t> m_outbuf_pdus;
+
+            /**
+             * \brief The maximum size of m_outbuf.
+             *
+             * Protected by m_send_mutex.
+             */
+            qint64 m_high_water_mark;
+
+            /**
+             * \brief Protects the sending members.
+             */
+            QMutex m_send_mutex;
+
+            /**
+             * \brief Triggered when m_outbuf shrinks.
+             *
+             * Used in conjunction with m_send_mutex.
+             */
+            QWaitCondition m_outbuf_space;
+
+            /**
+             * \brief Serializes connect() and disconnect().
+             */
+            QMutex m_connection_mutex;
+
+            /**
+             * \brief The reader loop.
+             *
+             * Waits for events until the socket is closed by the master 
+             * agent, an error occurs or m_wakeup is signaled.
+             */
+            void run();
+
+            /**
+             * \brief Read all available data and process complete %PDU's.
+             *
+             * \return False if the connection was lost.
+             */
+            bool receive();
+
+            /**
+             * \brief Write data to the socket.
+             *
+             * Writes m_outbuf, then the given data, as far as the socket 
+             * accepts them. The rest is appended to m_outbuf. 
+             * m_send_mutex must be locked by the caller.
+             *
+             * \param data The data to write, or 0 to only flush m_outbuf.
+             *
+             * \param size The size of data.
+             */
+            void write_locked(const quint8* data, size_t size);
+
+            /**
+             * \brief Close all file descriptors.
+             *
+             * The reader thread must not be running.
+             */
+            void close_fds();
+
+            /**
+             * \brief Enqueue a serialized %PDU if there is enough space.
+             *
+             * m_send_mutex must be locked by the caller.
+             *
+             * \return True if the %PDU was written or buffered, false if
+             *         m_outbuf is full.
+             *
+             * \exception disconnected If the connector is not connected.
+             */
+            bool enqueue(const binary& data);
+
+            friend class ReaderThread;
+
+	protected:
+
+            /**
+             * \brief The filename of the unix domain socket.
+             */
+	    std::string m_filename;
+
+	    /**
+	     * \brief The timeout in milliseconds.
+	     */
+	    unsigned m_timeout;
+
+            /**
+             * \brief Create a connected socket.
+             *
+             * Called by connect(). The default implementation connects to 
+             * the unix domain socket m_filename. Subclasses override this 
+             * function to use other kinds of stream sockets (e.g. 
+             * TcpConnector).
+             *
+             * \return The socket, or -1 on error. The socket may be
+             *         blocking; it is switched to non-blocking mode by the 
+             *         caller.
+             */
+            virtual int open_socket();
+
+        public:
+            /**
+             * \brief Constructor.
+             *
+             * This constructor initializes the connector object to be in
+             * disconnected state.
+             *
+             * \param unix_domain_socket The path to the unix_domain_socket.
+             *
+             * \param timeout The timeout, in milliseconds, used for sending 
+             *                when the outbound buffer is full.
+             */
+            EpollConnector(const std::string& unix_domain_socket
+                                              = "/var/agentx/master",
+                           unsigned timeout = 1000);
+
+            /**
+             * \brief Destructor.
+             *
+             * Disconnects.
+             */
+            virtual ~EpollConnector();
+
+            virtual bool connect();
+            virtual void disconnect();
+            virtual bool is_connected();
+            virtual unsigned long get_timeout() const;
+	    virtual void send(QSharedPointer<PDU> pdu);
+            virtual bool trySend(QSharedPointer<PDU> pdu);
+            virtual void set_high_water_mark(qint64 bytes);
+            virtual qint64 high_water_mark();
+            virtual size_t queue_depth();
+            virtual qint64 bytes_buffered();
+    };
+
+}
+
+#endif  //_EPOLL_CONNECTOR_H_
@@ -80,6 +80,13 @@ namespace agentxcpp
 	     */
 	    virtual binary serialize() const;
 
+	    /**
+	     * \internal
+	     *
+	     * \copydoc agentxcpp::AbstractVariable::serialize_into()
+	     */
+	    virtual void serialize_into(binary& serialized) const;
+
             /**
              * \copydoc agentxcpp::IntegerVariable::setValue()
              */
@@ -76,7 +76,7 @@ binary GetBulkPDU::serialize() const
     }
 
     // Add header
-    add_header(PDU::agentxGetNextPDU, serialized);
+    add_header(PDU::agentxGetBulkPDU, serialized);
 
     // return serialized form of PDU
     return serialized;
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include "GetCompletion.hpp"
+#include "PendingResponse.hpp"
+
+using namespace agentxcpp;
+
+
+GetCompletion::GetCompletion(QSharedPointer<PendingResponse> response,
+                             size_t variable)
+    : m_response(response),
+      m_variable(variable),
+      m_finished(0)
+{
+}
+
+
+GetCompletion::~GetCompletion()
+{
+    // Don't leave the response pending forever
+    finish(false);
+}
+
+
+void GetCompletion::finish(bool success)
+{
+    // Only the first call counts
+    if( ! m_finished.testAndSetOrdered(0, 1) )
+    {
+        return;
+    }
+
+    m_response->finish(m_variable, success);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _GETCOMPLETION_H_
+#define _GETCOMPLETION_H_
+
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+namespace agentxcpp
+{
+    class PendingResponse;
+
+    /**
+     * \brief Completion handle for asynchronous Get requests.
+     *
+     * A GetCompletion object is handed to 
+     * AbstractVariable::handle_get_async() when the value of a variable is 
+     * needed for a response. The variable calls finish() when its value is 
+     * up-to-date, which may happen later and from any thread. The response 
+     * to the master agent is sent when all variables of the request have 
+     * finished. Meanwhile, the MasterProxy continues to process other 
+     * requests.
+     *
+     * Only the first call to finish() has an effect. If the last reference 
+     * to a GetCompletion object is dropped without calling finish(), the Get 
+     * operation is regarded as failed, so that a response is sent in any 
+     * case.
+     *
+     * \internal
+     *
+     * A GetCompletion refers to one variable of a PendingResponse. It 
+     * reports the result to the PendingResponse, which in turn informs the 
+     * MasterProxy when the last variable finished.
+     *
+     * \endinternal
+     */
+    class GetCompletion
+    {
+        private:
+
+            /**
+             * \brief The response waiting for the variable.
+             */
+            QSharedPointer<PendingResponse> m_response;
+
+            /**
+             * \brief The number of the variable within m_response.
+             */
+            size_t m_variable;
+
+            /**
+             * \brief Whether finish() was already called (1) or not (0).
+             */
+            QAtomicInt m_finished;
+
+            /**
+             * \brief Copying is not allowed.
+             */
+            GetCompletion(const GetCompletion&);
+
+            /**
+             * \brief Copying is not allowed.
+             */
+            GetCompletion& operator=(const GetCompletion&);
+
+        public:
+
+            /**
+             * \internal
+             *
+             * \brief Constructor.
+             *
+             * \param response The response waiting for the variable.
+             *
+             * \param variable The number of the variable within the
+             *                 response (see PendingResponse::variables).
+             */
+            GetCompletion(QSharedPointer<PendingResponse> response,
+                          size_t variable);
+
+            /**
+             * \brief Destructor.
+             *
+             * Reports a failure if finish() was never called.
+             */
+            ~GetCompletion();
+
+            /**
+             * \brief Report that the Get operation is finished.
+             *
+             * This function may be called from any thread.
+             *
+             * \param success True if the value of the variable is
+             *                up-to-date, false if obtaining the value 
+             *                failed. In the latter case, a genErr is 
+             *                reported to the master agent.
+             *
+             * \exception None.
+             */
+            void finish(bool success = true);
+    };
+}
+
+#endif // _GETCOMPLETION_H_
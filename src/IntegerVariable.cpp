@@ -25,11 +25,15 @@ using namespace agentxcpp;
 binary IntegerVariable::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void IntegerVariable::serialize_into(binary& serialized) const
+{
     // encode value (big endian)
     write32(serialized, v);
-
-    return serialized;
 }
 
 
@@ -25,7 +25,13 @@ using namespace agentxcpp;
 binary IpAddressVariable::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void IpAddressVariable::serialize_into(binary& serialized) const
+{
     // encode size (big endian) (size is always 4)
     serialized.push_back(0);
     serialized.push_back(0);
@@ -37,8 +43,6 @@ binary IpAddressVariable::serialize() const
     serialized.push_back(v[1]);
     serialized.push_back(v[2]);
     serialized.push_back(v[3]);
-
-    return serialized;
 }
 
 
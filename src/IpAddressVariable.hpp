@@ -77,6 +77,13 @@ namespace agentxcpp
 	     */
 	    binary serialize() const;
 
+	    /**
+	     * \internal
+	     *
+	     * \copydoc agentxcpp::AbstractVariable::serialize_into()
+	     */
+	    virtual void serialize_into(binary& serialized) const;
+
 	    /**
              * \brief Construct an IpAddressValue object.
              *
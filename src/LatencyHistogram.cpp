@@ -0,0 +1,112 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include "LatencyHistogram.hpp"
+
+using namespace agentxcpp;
+
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+
+void LatencyHistogram::clear()
+{
+    for(int i = 0; i < bucket_count; i++)
+    {
+        m_buckets[i] = 0;
+    }
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+
+void LatencyHistogram::add(qint64 usec)
+{
+    if(usec < 0)
+    {
+        usec = 0;
+    }
+
+    // The bucket index is the position of the highest set bit
+    int i = 0;
+    for(quint64 v = quint64(usec) >> 1; v != 0 && i < bucket_count-1; v >>= 1)
+    {
+        i++;
+    }
+    m_buckets[i]++;
+
+    if(m_count == 0 || usec < m_min)
+    {
+        m_min = usec;
+    }
+    if(usec > m_max)
+    {
+        m_max = usec;
+    }
+    m_sum += usec;
+    m_count++;
+}
+
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    if(m_count == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the percentile (1-based)
+    quint64 rank = quint64(p / 100.0 * m_count + 0.5);
+    if(rank < 1)
+    {
+        rank = 1;
+    }
+
+    quint64 seen = 0;
+    for(int i = 0; i < bucket_count; i++)
+    {
+        seen += m_buckets[i];
+        if(seen >= rank)
+        {
+            return qMin(bucket_upper_bound(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+
+quint64 LatencyHistogram::bucket(int i) const
+{
+    if(i < 0 || i >= bucket_count)
+    {
+        return 0;
+    }
+    return m_buckets[i];
+}
+
+
+qint64 LatencyHistogram::bucket_upper_bound(int i)
+{
+    return (qint64(2) << i) - 1;
+}
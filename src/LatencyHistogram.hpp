@@ -0,0 +1,160 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include <QtGlobal>
+
+namespace agentxcpp
+{
+    /**
+     * \brief A histogram of round-trip times.
+     *
+     * The histogram counts durations in logarithmic buckets: bucket 0 
+     * holds durations below 2 microseconds, and bucket i (i > 0) holds 
+     * durations from 2^i up to 2^(i+1)-1 microseconds. The last bucket 
+     * also holds all longer durations. This gives a relative resolution of 
+     * a factor of two over the whole range, with constant memory.
+     *
+     * Additionally, the exact minimum, maximum and mean are kept.
+     *
+     * The class is not thread-safe. MasterProxy::get_ping_latency() 
+     * returns a copy, which can be inspected freely.
+     */
+    class LatencyHistogram
+    {
+	public:
+	    /**
+	     * \brief The number of buckets.
+	     */
+	    static const int bucket_count = 32;
+
+	private:
+	    /**
+	     * \brief The number of durations per bucket.
+	     */
+	    quint64 m_buckets[bucket_count];
+
+	    /**
+	     * \brief The number of durations added.
+	     */
+	    quint64 m_count;
+
+	    /**
+	     * \brief The sum of all durations, in microseconds.
+	     */
+	    quint64 m_sum;
+
+	    /**
+	     * \brief The shortest duration, in microseconds.
+	     */
+	    qint64 m_min;
+
+	    /**
+	     * \brief The longest duration, in microseconds.
+	     */
+	    qint64 m_max;
+
+	public:
+	    /**
+	     * \brief Create an empty histogram.
+	     */
+	    LatencyHistogram();
+
+	    /**
+	     * \brief Add a duration.
+	     *
+	     * \param usec The duration in microseconds. Negative values are
+	     *             counted as 0.
+	     */
+	    void add(qint64 usec);
+
+	    /**
+	     * \brief Remove all durations.
+	     */
+	    void clear();
+
+	    /**
+	     * \brief The number of durations added.
+	     */
+	    quint64 count() const
+	    {
+		return m_count;
+	    }
+
+	    /**
+	     * \brief The shortest duration in microseconds, or 0 if the
+	     *        histogram is empty.
+	     */
+	    qint64 min() const
+	    {
+		return m_count ? m_min : 0;
+	    }
+
+	    /**
+	     * \brief The longest duration in microseconds, or 0 if the
+	     *        histogram is empty.
+	     */
+	    qint64 max() const
+	    {
+		return m_max;
+	    }
+
+	    /**
+	     * \brief The mean duration in microseconds, or 0 if the
+	     *        histogram is empty.
+	     */
+	    qint64 mean() const
+	    {
+		return m_count ? qint64(m_sum / m_count) : 0;
+	    }
+
+	    /**
+	     * \brief Estimate a percentile.
+	     *
+	     * \param p The percentile, between 0 and 100 (e.g. 99 for the
+	     *          99th percentile).
+	     *
+	     * \return The upper bound of the bucket containing the
+	     *         percentile, but at most max(). 0 if the histogram is 
+	     *         empty.
+	     */
+	    qint64 percentile(double p) const;
+
+	    /**
+	     * \brief The number of durations in a bucket.
+	     *
+	     * \param i The bucket index, from 0 to bucket_count-1.
+	     *
+	     * \return The number of durations, or 0 if i is out of range.
+	     */
+	    quint64 bucket(int i) const;
+
+	    /**
+	     * \brief The longest duration counted in a bucket.
+	     *
+	     * \param i The bucket index, from 0 to bucket_count-1.
+	     *
+	     * \return 2^(i+1)-1 microseconds.
+	     */
+	    static qint64 bucket_upper_bound(int i);
+    };
+}
+
+#endif  //_LATENCYHISTOGRAM_H_
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include "LoopbackConnector.hpp"
+#include "OpenPDU.hpp"
+#include "ClosePDU.hpp"
+#include "RegisterPDU.hpp"
+#include "UnregisterPDU.hpp"
+#include "IndexAllocatePDU.hpp"
+#include "IndexDeallocatePDU.hpp"
+#include "AddAgentCapsPDU.hpp"
+#include "RemoveAgentCapsPDU.hpp"
+#include "NotifyPDU.hpp"
+#include "PingPDU.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+LoopbackConnector::LoopbackConnector()
+: Connector(),
+  m_connected(false),
+  m_encoding(true),
+  m_sessionID(0),
+  m_next_sessionID(1)
+{
+}
+
+
+void LoopbackConnector::set_encoding(bool enable)
+{
+    m_encoding = enable;
+}
+
+
+bool LoopbackConnector::encoding() const
+{
+    return m_encoding;
+}
+
+
+QSharedPointer<PDU> LoopbackConnector::transit(QSharedPointer<PDU> pdu)
+{
+    if( ! m_encoding )
+    {
+        return pdu;
+    }
+
+    return PDU::parse_pdu(pdu->serialize());
+}
+
+
+QSharedPointer<ResponsePDU> LoopbackConnector::answer(QSharedPointer<PDU> pdu)
+{
+    QSharedPointer<ResponsePDU> response;
+    quint32 sessionID = pdu->get_sessionID();
+
+    if( qSharedPointerDynamicCast<OpenPDU>(pdu) )
+    {
+        // New session
+        sessionID = m_next_sessionID++;
+        m_sessionID = sessionID;
+    }
+    else if( qSharedPointerDynamicCast<ClosePDU>(pdu) )
+    {
+        // Session ends after the response
+    }
+    else if( ! qSharedPointerDynamicCast<RegisterPDU>(pdu)
+             && ! qSharedPointerDynamicCast<UnregisterPDU>(pdu)
+             && ! qSharedPointerDynamicCast<IndexAllocatePDU>(pdu)
+             && ! qSharedPointerDynamicCast<IndexDeallocatePDU>(pdu)
+             && ! qSharedPointerDynamicCast<AddAgentCapsPDU>(pdu)
+             && ! qSharedPointerDynamicCast<RemoveAgentCapsPDU>(pdu)
+             && ! qSharedPointerDynamicCast<NotifyPDU>(pdu)
+             && ! qSharedPointerDynamicCast<PingPDU>(pdu) )
+    {
+        // Not answered by a master agent
+        return response;
+    }
+
+    // Successful response (RFC 2741, 7.2.2 "Subagent Processing of 
+    // Administrative PDUs")
+    response = QSharedPointer<ResponsePDU>(new ResponsePDU);
+    response->set_sessionID(sessionID);
+    response->set_transactionID(pdu->get_transactionID());
+    response->set_packetID(pdu->get_packetID());
+    response->set_error(ResponsePDU::noAgentXError);
+    response->set_index(0);
+    return response;
+}
+
+
+bool LoopbackConnector::connect()
+{
+    m_connected = true;
+    return true;
+}
+
+
+void LoopbackConnector::disconnect()
+{
+    m_connected = false;
+    m_sessionID = 0;
+    m_sent.clear();
+}
+
+
+bool LoopbackConnector::is_connected()
+{
+    return m_connected;
+}
+
+
+void LoopbackConnector::send(QSharedPointer<PDU> pdu)
+{
+    if( ! m_connected )
+    {
+        throw(disconnected());
+    }
+
+    QSharedPointer<PDU> received;
+    try
+    {
+        received = transit(pdu);
+    }
+    catch(version_error)
+    {
+        return; // a master agent would ignore it, too
+    }
+    catch(parse_error)
+    {
+        return; // a master agent would ignore it, too
+    }
+
+    QSharedPointer<ResponsePDU> response = answer(received);
+    if( ! response )
+    {
+        m_sent.push_back(received);
+        return;
+    }
+
+    bool closed = ! qSharedPointerDynamicCast<ClosePDU>(received).isNull();
+    dispatch(transit(response));
+    if(closed && received->get_sessionID() == m_sessionID)
+    {
+        m_sessionID = 0;
+    }
+}
+
+
+bool LoopbackConnector::trySend(QSharedPointer<PDU> pdu)
+{
+    send(pdu);
+    return true;
+}
+
+
+void LoopbackConnector::deliver(QSharedPointer<PDU> pdu)
+{
+    if( ! m_connected )
+    {
+        throw(disconnected());
+    }
+
+    if(pdu->get_sessionID() == 0)
+    {
+        pdu->set_sessionID(m_sessionID);
+    }
+    dispatch(transit(pdu));
+}
+
+
+QSharedPointer<ResponsePDU> LoopbackConnector::inject(QSharedPointer<PDU> pdu)
+{
+    size_t old_count = m_sent.size();
+    deliver(pdu);
+
+    // Find the response among the newly sent PDU's
+    std::deque< QSharedPointer<PDU> >::iterator i;
+    for(i = m_sent.begin() + old_count; i != m_sent.end(); i++)
+    {
+        QSharedPointer<ResponsePDU> response;
+        response = qSharedPointerDynamicCast<ResponsePDU>(*i);
+        if(response && response->get_packetID() == pdu->get_packetID())
+        {
+            m_sent.erase(i);
+            return response;
+        }
+    }
+
+    // No response (yet)
+    return QSharedPointer<ResponsePDU>();
+}
+
+
+QSharedPointer<PDU> LoopbackConnector::take_sent()
+{
+    QSharedPointer<PDU> pdu;
+    if( ! m_sent.empty() )
+    {
+        pdu = m_sent.front();
+        m_sent.pop_front();
+    }
+    return pdu;
+}
+
+
+size_t LoopbackConnector::sent_count() const
+{
+    return m_sent.size();
+}
+
+
+quint32 LoopbackConnector::sessionID() const
+{
+    return m_sessionID;
+}
+
+
+void LoopbackConnector::set_high_water_mark(qint64)
+{
+}
+
+
+qint64 LoopbackConnector::high_water_mark()
+{
+    return 0;
+}
+
+
+size_t LoopbackConnector::queue_depth()
+{
+    return 0;
+}
+
+
+qint64 LoopbackConnector::bytes_buffered()
+{
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _LOOPBACK_CONNECTOR_H_
+#define _LOOPBACK_CONNECTOR_H_
+
+#include <deque>
+
+#include "Connector.hpp"
+#include "ResponsePDU.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \brief Connect to an in-process master agent stub.
+     *
+     * This connector does not talk to a real master agent. Instead, it 
+     * contains a minimal master agent which runs synchronously within the 
+     * calling thread: no socket, no thread and no event loop is involved.  
+     * It is intended for benchmarks and profiling of a subagent (e.g. of 
+     * the %PDU handling in MasterProxy, the variables and the %PDU 
+     * encoding), and for environments without a master agent.
+     *
+     * The stub accepts all administrative %PDU's (e.g. OpenPDU, 
+     * RegisterPDU, ClosePDU) and answers them immediately. Requests are 
+     * passed to the subagent with inject(), which returns the response of 
+     * the subagent:
+     *
+     * \code
+     * LoopbackConnector* loop = new LoopbackConnector;
+     * MasterProxy master(loop, "benchmark");
+     * master.add_variable(oid, variable);
+     *
+     * QSharedPointer<GetPDU> get(new GetPDU);
+     * get->get_sr().push_back(oid);
+     * QSharedPointer<ResponsePDU> response = loop->inject(get);
+     * \endcode
+     *
+     * By default, every %PDU is serialized and parsed again on its way, so 
+     * that measurements include the encoding cost as with a real 
+     * connection. This can be switched off with set_encoding().
+     *
+     * The connector must only be used from a single thread. Variables which 
+     * complete asynchronously (see AbstractVariable::handle_get_async()) 
+     * need a Qt event loop to deliver their response.
+     *
+     * \internal
+     *
+     * %PDU's sent by the subagent are passed to answer(). If it returns a 
+     * ResponsePDU, the ResponsePDU is delivered back to the subagent via 
+     * Connector::dispatch() before send() returns. This is how 
+     * Connector::request() completes without waiting. All other %PDU's 
+     * (i.e. the responses of the subagent and notifications) are stored in 
+     * m_sent.
+     *
+     * \endinternal
+     */
+    class LoopbackConnector : public Connector
+    {
+	private:
+	    /**
+	     * \brief Whether the connector is connected.
+	     */
+	    bool m_connected;
+
+	    /**
+	     * \brief Whether %PDU's are serialized and parsed in transit.
+	     */
+	    bool m_encoding;
+
+	    /**
+	     * \brief The sessionID of the most recently opened session, or 0.
+	     */
+	    quint32 m_sessionID;
+
+	    /**
+	     * \brief The sessionID for the next OpenPDU.
+	     */
+	    quint32 m_next_sessionID;
+
+	    /**
+	     * \brief %PDU's sent by the subagent and not answered by the stub.
+	     */
+	    std::deque< QSharedPointer<PDU> > m_sent;
+
+	    /**
+	     * \brief Pass a %PDU through the encoder and parser, if enabled.
+	     *
+	     * \exception parse_error If the %PDU cannot be parsed again.
+	     */
+	    QSharedPointer<PDU> transit(QSharedPointer<PDU> pdu);
+
+	protected:
+	    /**
+	     * \brief The master agent stub.
+	     *
+	     * Called for every %PDU sent by the subagent. The default 
+	     * implementation answers OpenPDU, ClosePDU, RegisterPDU, 
+	     * UnregisterPDU, IndexAllocatePDU, IndexDeallocatePDU, 
+	     * AddAgentCapsPDU, RemoveAgentCapsPDU, NotifyPDU and PingPDU with a 
+	     * successful response, and returns NULL for all other %PDU's. 
+	     * Subclasses may override it, e.g. to simulate errors.
+	     *
+	     * \param pdu The %PDU sent by the subagent.
+	     *
+	     * \return The response, or NULL if the %PDU is not answered.
+	     */
+	    virtual QSharedPointer<ResponsePDU> answer(QSharedPointer<PDU> pdu);
+
+	public:
+	    /**
+	     * \brief Constructor.
+	     *
+	     * This constructor initializes the connector object to be in
+	     * disconnected state.
+	     */
+	    LoopbackConnector();
+
+	    /**
+	     * \brief Enable or disable encoding of %PDU's in transit.
+	     *
+	     * If enabled (the default), each %PDU is serialized and parsed 
+	     * again on its way between the subagent and the stub.
+	     */
+	    void set_encoding(bool enable);
+
+	    /**
+	     * \brief Whether %PDU's are encoded in transit.
+	     */
+	    bool encoding() const;
+
+	    /**
+	     * \brief Deliver a %PDU to the subagent.
+	     *
+	     * The %PDU is processed completely before the function returns; 
+	     * %PDU's sent by the subagent meanwhile can be obtained with 
+	     * take_sent(). If the sessionID of the %PDU is 0, it is set to 
+	     * the most recently opened session. Several sessions may share 
+	     * the connector (see MasterProxy::MasterProxy(QSharedPointer<
+	     * Connector>, std::string, quint8, Oid)); the %PDU is passed to 
+	     * the session it belongs to.
+	     *
+	     * \exception disconnected If the connector is not connected.
+	     */
+	    void deliver(QSharedPointer<PDU> pdu);
+
+	    /**
+	     * \brief Deliver a request to the subagent and return its
+	     *        response.
+	     *
+	     * Like deliver(), but returns the ResponsePDU with the packetID of 
+	     * the request which the subagent sent meanwhile. Other sent %PDU's 
+	     * stay available via take_sent().
+	     *
+	     * \return The response, or NULL if the subagent did not respond
+	     *         (e.g. because an asynchronous variable did not yet 
+	     *         complete).
+	     *
+	     * \exception disconnected If the connector is not connected.
+	     */
+	    QSharedPointer<ResponsePDU> inject(QSharedPointer<PDU> pdu);
+
+	    /**
+	     * \brief Remove and return the oldest %PDU sent by the subagent.
+	     *
+	     * Only %PDU's which were not answered by the stub are returned.
+	     *
+	     * \return The %PDU, or NULL if there is none.
+	     */
+	    QSharedPointer<PDU> take_sent();
+
+	    /**
+	     * \brief The number of %PDU's available via take_sent().
+	     */
+	    size_t sent_count() const;
+
+	    /**
+	     * \brief The sessionID of the most recently opened session, or 0.
+	     */
+	    quint32 sessionID() const;
+
+	    virtual bool connect();
+	    virtual void disconnect();
+	    virtual bool is_connected();
+	    virtual void send(QSharedPointer<PDU> pdu);
+	    virtual bool trySend(QSharedPointer<PDU> pdu);
+
+	    /**
+	     * \brief Does nothing; the connector has no outbound queue.
+	     */
+	    virtual void set_high_water_mark(qint64 bytes);
+
+	    /**
+	     * \brief Always 0; the connector has no outbound queue.
+	     */
+	    virtual qint64 high_water_mark();
+
+	    /**
+	     * \brief Always 0; the connector has no outbound queue.
+	     */
+	    virtual size_t queue_depth();
+
+	    /**
+	     * \brief Always 0; the connector has no outbound queue.
+	     */
+	    virtual qint64 bytes_buffered();
+    };
+
+}
+
+#endif  //_LOOPBACK_CONNECTOR_H_
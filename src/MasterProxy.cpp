@@ -16,7 +16,14 @@
  * See the AgentXcpp library license in the LICENSE file of this package 
  * for more details.
  */
+#include <set>
+
 #include <QtGlobal>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <QDateTime>
+#include <QElapsedTimer>
 
 #include "MasterProxy.hpp"
 #include "OpenPDU.hpp"
@@ -26,8 +33,11 @@
 #include "GetPDU.hpp"
 #include "GetNextPDU.hpp"
 #include "NotifyPDU.hpp"
+#include "PingPDU.hpp"
 #include "util.hpp"
 #include "OidVariable.hpp"
+#include "GetCompletion.hpp"
+#include "OidFilter.hpp"
 
 
 using namespace std;
@@ -35,7 +45,60 @@ using namespace agentxcpp;
 
 
 
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief Job which evaluates a single variable on a worker thread.
+     *
+     * Used by MasterProxy::evaluate(). The job calls the asynchronous Get 
+     * handler of the variable. If the handler throws, the Get operation is 
+     * regarded as failed.
+     */
+    class GetJob : public QRunnable
+    {
+        private:
+            /**
+             * \brief The variable to evaluate.
+             */
+            QSharedPointer<AbstractVariable> m_var;
+
+            /**
+             * \brief The completion handle for the variable.
+             */
+            QSharedPointer<GetCompletion> m_done;
+
+        public:
+            /**
+             * \brief Constructor.
+             *
+             * \param var The variable to evaluate.
+             *
+             * \param done The completion handle passed to the variable.
+             */
+            GetJob(QSharedPointer<AbstractVariable> var,
+                   QSharedPointer<GetCompletion> done)
+                : m_var(var), m_done(done)
+            {
+            }
 
+            /**
+             * \brief Evaluate the variable.
+             */
+            virtual void run()
+            {
+                try
+                {
+                    m_var->handle_get_async(m_done);
+                }
+                catch(...)
+                {
+                    m_done->finish(false);
+                }
+            }
+    };
+}
 
 
 
@@ -48,7 +111,28 @@ MasterProxy::MasterProxy(std::string _description,
     sessionID(0),
     description(_description),
     default_timeout(_default_timeout),
-    id(_id)
+    id(_id),
+    variables(new variable_map_t),
+    m_filter(new OidFilter(0)),
+    m_worker_threads(0),
+    m_next_cursor(0),
+    m_cursor_hits(0),
+    m_cursor_misses(0),
+    m_late_responses(0),
+    m_auto_reconnect(false),
+    m_reconnect_min_delay(10),
+    m_reconnect_max_delay(30000),
+    m_reconnect_delay(10),
+    m_reconnects(0),
+    m_reconnect_timer(this),
+    m_ping_interval(0),
+    m_ping_timeout(1000),
+    m_ping_failures(0),
+    m_ping_timer(this),
+    m_ping_packetID(0),
+    m_ping_deadline(this),
+    m_walk_lifetime(0),
+    m_max_pinned_variables(100000)
 {
     // Initialize connector (never use timeout=0)
     quint8 timeout;
@@ -56,8 +140,10 @@ MasterProxy::MasterProxy(std::string _description,
     connection = new UnixDomainConnector(
 			       _filename.c_str(),
 			       timeout*1000);
+    m_connector = QSharedPointer<Connector>(connection);
     connection->moveToThread(&m_thread);
     m_thread.start();
+    init_reconnect();
 
 
     // Register this object as %PDU handler
@@ -81,6 +167,129 @@ MasterProxy::MasterProxy(std::string _description,
 }
 
 
+MasterProxy::MasterProxy(Connector* connector,
+			 std::string _description,
+			 quint8 _default_timeout,
+			 Oid _id) :
+    sessionID(0),
+    description(_description),
+    default_timeout(_default_timeout),
+    id(_id),
+    variables(new variable_map_t),
+    m_filter(new OidFilter(0)),
+    m_worker_threads(0),
+    m_next_cursor(0),
+    m_cursor_hits(0),
+    m_cursor_misses(0),
+    m_late_responses(0),
+    m_auto_reconnect(false),
+    m_reconnect_min_delay(10),
+    m_reconnect_max_delay(30000),
+    m_reconnect_delay(10),
+    m_reconnects(0),
+    m_reconnect_timer(this),
+    m_ping_interval(0),
+    m_ping_timeout(1000),
+    m_ping_failures(0),
+    m_ping_timer(this),
+    m_ping_packetID(0),
+    m_ping_deadline(this),
+    m_walk_lifetime(0),
+    m_max_pinned_variables(100000)
+{
+    connection = connector;
+    m_connector = QSharedPointer<Connector>(connector);
+    init_reconnect();
+
+    // Try to connect
+    try
+    {
+	// throws disconnected:
+	this->connect();
+    }
+    catch(disconnected)
+    {
+	// Ignore, stay disconnected
+    }
+    catch(...)
+    {
+	// Ignore, stay disconnected
+    }
+
+}
+
+
+MasterProxy::MasterProxy(QSharedPointer<Connector> connector,
+			 std::string _description,
+			 quint8 _default_timeout,
+			 Oid _id) :
+    connection(connector.data()),
+    m_connector(connector),
+    sessionID(0),
+    description(_description),
+    default_timeout(_default_timeout),
+    id(_id),
+    variables(new variable_map_t),
+    m_filter(new OidFilter(0)),
+    m_worker_threads(0),
+    m_next_cursor(0),
+    m_cursor_hits(0),
+    m_cursor_misses(0),
+    m_late_responses(0),
+    m_auto_reconnect(false),
+    m_reconnect_min_delay(10),
+    m_reconnect_max_delay(30000),
+    m_reconnect_delay(10),
+    m_reconnects(0),
+    m_reconnect_timer(this),
+    m_ping_interval(0),
+    m_ping_timeout(1000),
+    m_ping_failures(0),
+    m_ping_timer(this),
+    m_ping_packetID(0),
+    m_ping_deadline(this),
+    m_walk_lifetime(0),
+    m_max_pinned_variables(100000)
+{
+    init_reconnect();
+
+    // Try to connect
+    try
+    {
+	// throws disconnected:
+	this->connect();
+    }
+    catch(disconnected)
+    {
+	// Ignore, stay disconnected
+    }
+    catch(...)
+    {
+	// Ignore, stay disconnected
+    }
+
+}
+
+
+void MasterProxy::init_reconnect()
+{
+    m_reconnect_timer.setSingleShot(true);
+    QObject::connect(&m_reconnect_timer, SIGNAL(timeout()),
+                     this, SLOT(try_reconnect()));
+    QObject::connect(connection, SIGNAL(connectionLost()),
+                     this, SLOT(connection_lost()));
+    QObject::connect(&m_ping_timer, SIGNAL(timeout()),
+                     this, SLOT(do_ping()));
+    m_ping_deadline.setSingleShot(true);
+    QObject::connect(&m_ping_deadline, SIGNAL(timeout()),
+                     this, SLOT(ping_timed_out()));
+
+    // Subagents started together shall not draw the same delays
+    m_reconnect_random = quint32(QDateTime::currentDateTime().toTime_t())
+                         ^ quint32(quintptr(this));
+}
+
+
 void MasterProxy::connect()
 {
 //    if( this->connection->is_connected() )
@@ -90,11 +299,31 @@ void MasterProxy::connect()
 //    }
 
     // Clear registrations and variables
+    m_registrations_mutex.lock();
     registrations.clear();
-    variables.clear();
+    update_timeouts();
+    m_registrations_mutex.unlock();
+    m_update_mutex.lock();
+    QSharedPointer<const variable_map_t> empty(new variable_map_t);
+    QSharedPointer<OidFilter> empty_filter(new OidFilter(0));
+    m_unpublished.clear();
+    m_variables_mutex.lock();
+    variables = empty;
+    m_filter = empty_filter;
+    m_variables_mutex.unlock();
+    m_update_mutex.unlock();
+
+    open_session();
+}
+
 
+void MasterProxy::open_session()
+{
     // Connect to endpoint
-    this->connection->connect();
+    if( ! this->connection->connect() )
+    {
+	throw disconnected();
+    }
 
     // The response we expect from the master
     QSharedPointer<ResponsePDU> response;
@@ -106,7 +335,8 @@ void MasterProxy::connect()
 	openpdu->set_timeout(default_timeout);
 	openpdu->set_id(id);
 	// throws disconnected and timeout_error:
-	response = this->connection->request(openpdu);
+	response = this->connection->request(openpdu,
+					     connection->get_timeout());
 
 //	// Wait for response
 //	// throws disconnected and timeout_error:
@@ -132,10 +362,151 @@ void MasterProxy::connect()
     // All went fine, we are connected now
     this->sessionID = response->get_sessionID();
 
-    QObject::connect(connection,
-                     SIGNAL(pduArrived(QSharedPointer<PDU>)),
-                     this,
-                     SLOT(handle_pdu(QSharedPointer<PDU>)));
+    // Receive the PDU's of our session
+    connection->add_session(this->sessionID, this);
+
+    // Resume pinging if stopped by disconnect()
+    if(m_ping_interval != 0 && ! m_ping_timer.isActive())
+    {
+	m_ping_timer.start(m_ping_interval);
+    }
+}
+
+
+void MasterProxy::resume()
+{
+    open_session();
+
+    // Send all registrations at once
+    std::vector< QSharedPointer<PDU> > pdus;
+    m_registrations_mutex.lock();
+    pdus.reserve(registrations.size());
+    std::list< QSharedPointer<RegisterPDU> >::iterator r;
+    for(r = registrations.begin(); r != registrations.end(); r++)
+    {
+	(*r)->set_sessionID(this->sessionID);
+	pdus.push_back(*r);
+    }
+    m_registrations_mutex.unlock();
+    if(pdus.empty())
+    {
+	return;
+    }
+    std::vector< QSharedPointer<ResponsePDU> > responses;
+    try
+    {
+	// throws disconnected and timeout_error:
+	responses = connection->request_batch(pdus, connection->get_timeout());
+    }
+    catch(timeout_error)
+    {
+	throw disconnected();
+    }
+
+    // Forget the registrations which the master agent refused (the list
+    // may have changed meanwhile)
+    QMutexLocker locker(&m_registrations_mutex);
+    for(size_t i = 0; i < pdus.size(); i++)
+    {
+	if(responses[i]->get_error() != ResponsePDU::noAgentXError)
+	{
+	    registrations.remove(qSharedPointerCast<RegisterPDU>(pdus[i]));
+	}
+    }
+    update_timeouts();
+}
+
+
+void MasterProxy::reconnect()
+{
+    m_reconnect_timer.stop();
+
+    // Close the session; the registrations are kept
+    try
+    {
+	QSharedPointer<ClosePDU> closepdu(
+			new ClosePDU(this->sessionID, ClosePDU::reasonOther));
+	this->connection->request(closepdu, connection->get_timeout());
+    }
+    catch(...)
+    {
+	// We disconnect anyway -> ignore all errors
+    }
+    close_session();
+
+    // throws disconnected, which is forwarded:
+    resume();
+}
+
+
+void MasterProxy::set_auto_reconnect(bool enable, int min_delay, int max_delay)
+{
+    if(min_delay < 1 || max_delay < min_delay)
+    {
+	throw inval_param();
+    }
+
+    m_auto_reconnect = enable;
+    m_reconnect_min_delay = min_delay;
+    m_reconnect_max_delay = max_delay;
+    m_reconnect_delay = min_delay;
+
+    if( ! enable )
+    {
+	m_reconnect_timer.stop();
+    }
+    else if( ! is_connected() && ! m_reconnect_timer.isActive() )
+    {
+	schedule_reconnect();
+    }
+}
+
+
+void MasterProxy::schedule_reconnect()
+{
+    // "Equal jitter": half the delay is fixed, the other half random
+    int half = m_reconnect_delay / 2;
+    // LCG of Numerical Recipes; the upper bits are the most random ones
+    m_reconnect_random = m_reconnect_random * 1664525u + 1013904223u;
+    int random = int(m_reconnect_random >> 16);
+    m_reconnect_timer.start(half + random % (m_reconnect_delay - half + 1));
+}
+
+
+void MasterProxy::connection_lost()
+{
+    // The session is gone
+    connection->remove_session(this->sessionID);
+    cancel_ping();
+
+    if(m_auto_reconnect && ! m_reconnect_timer.isActive())
+    {
+	schedule_reconnect();
+    }
+}
+
+
+void MasterProxy::try_reconnect()
+{
+    if( ! m_auto_reconnect )
+    {
+	return;
+    }
+
+    try
+    {
+	resume();
+    }
+    catch(...)
+    {
+	// Try again later, waiting twice as long
+	m_reconnect_delay = qMin(2 * m_reconnect_delay, m_reconnect_max_delay);
+	schedule_reconnect();
+	return;
+    }
+
+    m_reconnect_delay = m_reconnect_min_delay;
+    m_reconnects++;
 }
 
 
@@ -153,16 +524,25 @@ void MasterProxy::disconnect(ClosePDU::reason_t reason)
     // master agent unregisters all MIB regions, frees all index values and all 
     // sysORID are removed. Thus no need to clean up before ClosePDU is sent.
 
+    // Don't come back
+    m_reconnect_timer.stop();
+    m_ping_timer.stop();
+    cancel_ping();
+
     // The response we expect from the master
     QSharedPointer<ResponsePDU> response;
 
     // Try clean shutdown (ignore errors)
     try
     {
-	// Unregister stuff if any
+	// Unregister stuff if any (from a copy: the lock is not held while
+	// talking to the master)
+	m_registrations_mutex.lock();
+	std::list< QSharedPointer<RegisterPDU> > regs = this->registrations;
+	m_registrations_mutex.unlock();
 	std::list< QSharedPointer<RegisterPDU> >::const_iterator r;
-	r = this->registrations.begin();
-	while (r != this->registrations.end())
+	r = regs.begin();
+	while (r != regs.end())
 	{
 	    this->undo_registration(create_unregister_pdu(*r));
 	    r++;
@@ -191,6 +571,9 @@ void MasterProxy::disconnect(ClosePDU::reason_t reason)
 	// -> ignore all errors
     }
 
+    // The session is gone; the connector may serve other sessions
+    connection->remove_session(this->sessionID);
+
     // Finally: disconnect
 //    this->connection->disconnect();
 }
@@ -200,9 +583,23 @@ MasterProxy::~MasterProxy()
     // Disconnect from master agent
     this->disconnect(ClosePDU::reasonShutdown);
 
-    // Destroy connection
-    // Unregistering this object as %PDU handler is unneeded.
-    delete this->connection;
+    // Variables which finish later must not inform us. The requests are 
+    // detached without holding m_pending_mutex, because a finishing 
+    // variable holds the lock of its request while calling 
+    // response_ready().
+    map< PendingResponse*, QSharedPointer<PendingResponse> > pending;
+    {
+        QMutexLocker locker(&m_pending_mutex);
+        pending.swap(m_pending);
+    }
+    map< PendingResponse*, QSharedPointer<PendingResponse> >::iterator p;
+    for(p = pending.begin(); p != pending.end(); p++)
+    {
+        p->second->detach();
+    }
+
+    // Release the connection. It is destroyed if no other session uses it.
+    m_connector.clear();
 }
 
 
@@ -303,7 +700,9 @@ void MasterProxy::register_subtree(Oid subtree,
     }
 
     // Success: store registration
+    QMutexLocker locker(&m_registrations_mutex);
     this->registrations.push_back(pdu);
+    update_timeouts();
 
 }
 
@@ -316,6 +715,7 @@ void MasterProxy::unregister_subtree(Oid subtree,
     QSharedPointer<UnregisterPDU> pdu;
 
     // Remove the registration from registrations list
+    m_registrations_mutex.lock();
     std::list< QSharedPointer<RegisterPDU> >::iterator r;
     r = this->registrations.begin();
     while (r != this->registrations.end())
@@ -339,6 +739,8 @@ void MasterProxy::unregister_subtree(Oid subtree,
 	    r++;
 	}
     }
+    update_timeouts();
+    m_registrations_mutex.unlock();
 
     // Sent PDU
     try
@@ -437,77 +839,149 @@ QSharedPointer<UnregisterPDU> MasterProxy::create_unregister_pdu(
 }
 
 
-void MasterProxy::handle_getpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<GetPDU> get_pdu)
+void MasterProxy::handle_getpdu(QSharedPointer<PendingResponse> request, QSharedPointer<GetPDU> get_pdu)
 {
         // Handling according to
 	// RFC 2741, 7.2.3.1 "Subagent Processing of the agentx-Get-PDU"
 
 	// Extract searchRange list
-	vector<Oid> sr = get_pdu->get_sr();
+	const vector<Oid>& sr = get_pdu->get_sr();
+
+	// The variables; unaffected by concurrent updates
+	QSharedPointer<OidFilter> filter;
+	QSharedPointer<const variable_map_t> vars = variables_snapshot(filter);
+
+	// The varbinds of the response (Step (1): each one includes the
+	// requested name)
+	vector<pending_varbind>& varbinds = request->varbinds;
+	varbinds.reserve(sr.size());
 
 	// Iterate over list and handle each Oid separately
 	vector<Oid>::const_iterator i;
-        quint16 index = 1;  // Index is 1-based (RFC 2741,
-                             // 5.4. "Value Representation"):
 	for(i = sr.begin(); i != sr.end(); i++)
 	{
 	    // The name
 	    const Oid& name = *i;
 
 	    // Find variable for current OID
-	    map< Oid, QSharedPointer<AbstractVariable> >::const_iterator var;
-	    var = variables.find(name);
-	    if(var != variables.end())
+	    // (unknown names are rejected by the filter without searching)
+	    variable_map_t::const_iterator var = vars->end();
+	    if(filter->may_contain(name))
 	    {
-		// Step (2): We have a variable for this Oid
-
-		// update variable
-                try
-                {
-                    // Add variable to response (Step (1): include name)
-                    var->second->handle_get();
-                    response->varbindlist.push_back( Varbind(name, var->second) );
-                }
-                catch(...)
-                {
-                    // An error occurred
-                    response->set_error( ResponsePDU::genErr );
-                    response->set_index( index );
-                    // Leave response.varbindlist empty
-                }
-
+		var = vars->find(name);
+	    }
+	    if(var != vars->end())
+	    {
+		// Step (2): We have a variable for this Oid. It is evaluated
+		//           below.
+		varbinds.push_back( pending_varbind(name, var->second.var,
+						    var->second.encoded_name) );
 	    }
 	    else
 	    {
 		// Interpret 'name' as prefix:
 		// append .0 and check whether we have a variable
 		// with this name
-		Oid name_copy(name, 0);
-
-		var = variables.find(name_copy);
-		if(var != variables.end())
+		if(filter->may_contain(name, 0))
+		{
+		    Oid name_copy(name, 0);
+		    var = vars->find(name_copy);
+		}
+		if(var != vars->end())
 		{
 		    // Step (4): We have a variable with the object
 		    //           identifier prefix 'name': Send noSuchInstance 
-		    //           error (Step (1): include name)
-		    response->varbindlist.push_back( Varbind(name, Varbind::noSuchInstance) );
+		    //           error
+		    varbinds.push_back( pending_varbind(name, Varbind::noSuchInstance) );
 		}
 		else
 		{
 		    // Step (3): we have no variable with the object
 		    //           identifier prefix 'name': Send noSuchObject 
-		    //           error (Step (1): include name)
-		    response->varbindlist.push_back( Varbind(name, Varbind::noSuchObject) );
+		    //           error
+		    varbinds.push_back( pending_varbind(name, Varbind::noSuchObject) );
 		}
 	    }
-
-            index++;
 	}
+
+}
+
+
+
+MasterProxy::variable_map_t::const_iterator
+MasterProxy::find_next(const QSharedPointer<const variable_map_t>& vars,
+                       const Oid& starting_oid, const Oid& ending_oid) const
+{
+    variable_map_t::const_iterator next_var;
+    if( ! starting_oid.include())
+    {
+        QMutexLocker locker(&m_cursor_mutex);
+
+        // Does a walk continue at a variable found before?
+        int c;
+        for(c = 0; c < cursor_count; c++)
+        {
+            if(m_cursors[c].vars == vars
+               && m_cursors[c].pos->first == starting_oid)
+            {
+                break;
+            }
+        }
+
+        if(c != cursor_count)
+        {
+            // Yes: its successor is the next variable
+            next_var = m_cursors[c].pos;
+            next_var++;
+            m_cursor_hits++;
+        }
+        else
+        {
+            // Find the closest lexicographical successor to the starting 
+            // OID (excluding the starting OID itself)
+            next_var = vars->upper_bound(starting_oid);
+            m_cursor_misses++;
+
+            c = m_next_cursor;
+            m_next_cursor = (m_next_cursor + 1) % cursor_count;
+        }
+
+        // Remember the position for the next request of the walk
+        if(next_var != vars->end())
+        {
+            m_cursors[c].vars = vars;
+            m_cursors[c].pos = next_var;
+        }
+        else
+        {
+            m_cursors[c].vars.clear();
+        }
+    }
+    else
+    {
+        // Find the exact variable or, if not present, find the 
+        // lexicographical successor of it
+        next_var = vars->lower_bound(starting_oid);
+    }
+    if(next_var != vars->end() && ! ending_oid.is_null() )
+    {
+        // The "next" variable must precede the ending OID (it must not 
+        // be greater or equal than the ending OID)
+        if( next_var->first >= ending_oid )
+        {
+            // The found "next" variable doesn't precede the ending 
+            // OID, which means that we didn't found a suitable 
+            // variable.
+            next_var = vars->end(); // indicate "not found"
+        }
+    }
+
+    return next_var;
 }
 
 
 
-void MasterProxy::handle_getnextpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<GetNextPDU> getnext_pdu)
+void MasterProxy::handle_getnextpdu(QSharedPointer<PendingResponse> request, QSharedPointer<GetNextPDU> getnext_pdu)
 {
         // Handling according to
 	// RFC 2741, 7.2.3.2 "Subagent Processing of the agentx-GetNext-PDU"
@@ -515,114 +989,919 @@ void MasterProxy::handle_getnextpdu(QSharedPointer<ResponsePDU> response, QShare
 	// Extract searchRange list
 	vector< pair<Oid,Oid> >& sr = getnext_pdu->get_sr();
 
+	// The variables; unaffected by concurrent updates and, if this
+	// request continues a walk, the ones the walk started with
+	QSharedPointer<const variable_map_t> vars = walk_snapshot(sr);
+
+	// The varbinds of the response
+	vector<pending_varbind>& varbinds = request->varbinds;
+	varbinds.reserve(sr.size());
+
 	// Iterate over list and handle each SearchRange separately
 	vector< pair<Oid,Oid> >::const_iterator i;
-        quint16 index = 1;  // Index is 1-based (RFC 2741,
-                             // 5.4. "Value Representation"):
 	for(i = sr.begin(); i != sr.end(); i++)
 	{
-	    // The names
-	    const Oid& starting_oid = i->first;
-            const Oid& ending_oid   = i->second;
-
             // Find "next" variable
-	    map< Oid, QSharedPointer<AbstractVariable> >::const_iterator next_var;
-	    if( ! starting_oid.include())
-            {
-                // Find the closest lexicographical successor to the starting 
-                // OID (excluding the starting OID itself)
-                next_var = variables.upper_bound(starting_oid);
-            }
-            else
-            {
-                // Find the exact variable or, if not present, find the 
-                // lexicographical successor of it
-                next_var = variables.lower_bound(starting_oid);
-            }
-            if(next_var != variables.end() && ! ending_oid.is_null() )
-            {
-                // The "next" variable must precede the ending OID (it must not 
-                // be greater or equal than the ending OID)
-                if( next_var->first >= ending_oid )
-                {
-                    // The found "next" variable doesn't precede the ending 
-                    // OID, which means that we didn't found a suitable 
-                    // variable.
-                    next_var = variables.end(); // indicate "not found"
-                }
-            }
+	    variable_map_t::const_iterator next_var;
+	    next_var = find_next(vars, i->first, i->second);
 
-	    if(next_var != variables.end())
+	    if(next_var != vars->end())
 	    {
-                // "Next" variable was found
-
-		// update variable
-                try
-                {
-                    next_var->second->handle_get();
-                    response->varbindlist.push_back( Varbind(next_var->first, next_var->second) );
-                }
-                catch(...)
-                {
-                    // An error occurred
-                    response->set_error( ResponsePDU::genErr );
-                    response->set_index( index );
-                    // Leave response.varbindlist empty
-                }
-
+                // "Next" variable was found. It is evaluated below.
+		varbinds.push_back( pending_varbind(next_var->first,
+						    next_var->second.var,
+						    next_var->second.encoded_name) );
 	    }
 	    else
 	    {
                 // "Next" variable was NOT found
-		response->varbindlist.push_back( Varbind(starting_oid, Varbind::endOfMibView) );
+		varbinds.push_back( pending_varbind(i->first, Varbind::endOfMibView) );
 	    }
+	}
 
-            index++;
+	// The walk continues behind the last varbind
+	if( ! varbinds.empty() && varbinds.back().var )
+	{
+	    pin_walk(vars, vector<Oid>(1, varbinds.back().name));
 	}
 }
 
 
 
-void MasterProxy::handle_testsetpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<TestSetPDU> testset_pdu)
+void MasterProxy::handle_getbulkpdu(QSharedPointer<PendingResponse> request, QSharedPointer<GetBulkPDU> getbulk_pdu)
 {
     // Handling according to
-    // RFC 2741, 7.2.4.1 "Subagent Processing of the agentx-TestSet-PDU"
+    // RFC 2741, 7.2.3.3 "Subagent Processing of the agentx-GetBulk-PDU"
 
-    // Extract Varbind list
-    vector<Varbind>& vb = testset_pdu->get_vb();
+    // Extract searchRange list
+    vector< pair<Oid,Oid> >& sr = getbulk_pdu->get_sr();
 
-    // Initially, no Varbind failed:
-    response->set_error(ResponsePDU::noAgentXError);
+    // The variables; unaffected by concurrent updates and, if this
+    // request continues a walk, the ones the walk started with
+    QSharedPointer<const variable_map_t> vars = walk_snapshot(sr);
 
-    // Iterate over list and handle each Varbind separately. Return on the 
-    // first varbind which doesn't validate correctly.
-    vector<Varbind>::const_iterator i;
-    quint16 index;
-    for(i = vb.begin(), index = 1; i != vb.end(); i++, index++)
+    // The number of non-repeaters (N) and repeaters (R)
+    size_t non_repeaters = getbulk_pdu->get_non_repeaters();
+    if( non_repeaters > sr.size() )
     {
-        // Find the associated variable
-        map< Oid, QSharedPointer<AbstractVariable> >::const_iterator var;
-	var = variables.find(i->get_name());
-        if(var == variables.end())
-        {
-            // error: variable unknown
-            response->set_error(ResponsePDU::notWritable);
-            response->set_index(index);
+        non_repeaters = sr.size();
+    }
+    size_t repeaters = sr.size() - non_repeaters;
 
-            // Some variables may have allocated resources, which must be
-            // released again. This is the same as handle_cleanupsetpdu() does, 
-            // so we are lazy here and call this function:
-            this->handle_cleanupsetpdu();
-            return;
+    // The varbinds of the response
+    vector<pending_varbind>& varbinds = request->varbinds;
+    varbinds.reserve(non_repeaters
+                     + repeaters * getbulk_pdu->get_max_repititions());
+
+    // The non-repeaters are processed like a GetNext request
+    for(size_t i = 0; i < non_repeaters; i++)
+    {
+        variable_map_t::const_iterator next_var;
+        next_var = find_next(vars, sr[i].first, sr[i].second);
+        if(next_var != vars->end())
+        {
+            varbinds.push_back( pending_varbind(next_var->first,
+                                                next_var->second.var,
+                                                next_var->second.encoded_name) );
+        }
+        else
+        {
+            varbinds.push_back( pending_varbind(sr[i].first, Varbind::endOfMibView) );
+        }
+    }
+
+    // The repeaters are processed up to max_repititions times. Each 
+    // repetition continues with the names found by the previous one. The
+    // lookups don't depend on the values of the variables, therefore all 
+    // repetitions are determined before any variable is evaluated.
+    vector<Oid> current(repeaters);
+    for(size_t i = 0; i < repeaters; i++)
+    {
+        current[i] = sr[non_repeaters + i].first;
+    }
+    for(quint16 rep = 0; rep < getbulk_pdu->get_max_repititions(); rep++)
+    {
+        bool all_done = true;   // whether each repeater hit endOfMibView
+        for(size_t i = 0; i < repeaters; i++)
+        {
+            const Oid& ending_oid = sr[non_repeaters + i].second;
+
+            variable_map_t::const_iterator next_var;
+            next_var = find_next(vars, current[i], ending_oid);
+            if(next_var != vars->end())
+            {
+                varbinds.push_back( pending_varbind(next_var->first,
+                                                    next_var->second.var,
+                                                    next_var->second.encoded_name) );
+
+                // The next repetition starts behind the found variable
+                current[i] = next_var->first;
+                current[i].setInclude(false);
+                all_done = false;
+            }
+            else
+            {
+                varbinds.push_back( pending_varbind(current[i], Varbind::endOfMibView) );
+            }
+        }
+
+        // Each repetition is evaluated in its own round (the first one 
+        // together with the non-repeaters), so that evaluate() can stop 
+        // before the deadline.
+        request->rounds.push_back(varbinds.size());
+
+        if(all_done)
+        {
+            // Further repetitions would only produce endOfMibView
+            // varbinds. RFC 2741 allows to stop here.
+            break;
+        }
+    }
+
+    // The walk continues behind the last varbind of the last repetition
+    // sent; the response may be truncated to any repetition.
+    if(repeaters != 0)
+    {
+        vector<Oid> next;
+        for(size_t r = 0; r < request->rounds.size(); r++)
+        {
+            const pending_varbind& last = varbinds[request->rounds[r] - 1];
+            if(last.var)
+            {
+                next.push_back(last.name);
+            }
+        }
+        pin_walk(vars, next);
+    }
+}
+
+
+
+bool MasterProxy::evaluate(QSharedPointer<PendingResponse> request)
+{
+    if(request->rounds_started() == 0)
+    {
+        request->prepare();
+    }
+    const vector< QSharedPointer<AbstractVariable> >& vars = request->variables;
+
+    size_t first, last;
+    while(true)
+    {
+        // Would the next round miss the deadline?
+        size_t started = request->rounds_started();
+        if(started > 0 && request->more_rounds())
+        {
+            qint64 per_round = request->evaluation_time() / started;
+            if(request->remaining() < per_round)
+            {
+                // Send what we have
+                request->truncate();
+            }
+        }
+
+        if( ! request->begin_round(first, last) )
+        {
+            // All rounds finished
+            return true;
+        }
+
+        // Register the request before any variable is started, because a 
+        // variable may finish (and call response_ready()) at any time.
+        {
+            QMutexLocker locker(&m_pending_mutex);
+            m_pending[request.data()] = request;
+        }
+
+        bool use_workers = (m_worker_threads != 0 && last - first >= 2);
+        for(size_t v = first; v < last; v++)
+        {
+            QSharedPointer<GetCompletion> done(new GetCompletion(request, v));
+            if(use_workers)
+            {
+                // Evaluate on a worker thread
+                m_workers.start(new GetJob(vars[v], done));
+            }
+            else
+            {
+                // Evaluate in this thread
+                try
+                {
+                    vars[v]->handle_get_async(done);
+                }
+                catch(...)
+                {
+                    done->finish(false);
+                }
+            }
+        }
+
+        if(use_workers)
+        {
+            // Wait until the handlers returned. Otherwise, the next request 
+            // could evaluate the same variables concurrently, or a response 
+            // could be serialized while a worker still changes a variable.  
+            // Only asynchronous variables may still be pending afterwards.
+            m_workers.waitForDone();
+        }
+
+        if( ! request->launched() )
+        {
+            // Still waiting for variables; response_ready() will be called
+            return false;
+        }
+
+        // All variables of the round finished
+        QMutexLocker locker(&m_pending_mutex);
+        m_pending.erase(request.data());
+    }
+}
+
+
+
+void MasterProxy::assemble(QSharedPointer<PendingResponse> request)
+{
+    QSharedPointer<ResponsePDU> response = request->response;
+    const vector<pending_varbind>& varbinds = request->varbinds;
+    response->varbindlist.reserve(varbinds.size());
+
+    quint16 index = 1;  // Index is 1-based (RFC 2741,
+                        // 5.4. "Value Representation"):
+    for(size_t i = 0; i < varbinds.size(); i++, index++)
+    {
+        const pending_varbind& vb = varbinds[i];
+        if( ! vb.var )
+        {
+            // Varbind without value (e.g. noSuchObject)
+            response->varbindlist.push_back( Varbind(vb.name, vb.type) );
+            continue;
+        }
+
+        try
+        {
+            if( ! request->failed(request->positions[i]) )
+            {
+                response->varbindlist.push_back(
+                                Varbind(vb.name, vb.encoded_name, vb.var) );
+                continue;
+            }
+        }
+        catch(...)
+        {
+            // Varbind could not be created; handled like a failed Get
+        }
+
+        // An error occurred
+        response->set_error( ResponsePDU::genErr );
+        response->set_index( index );
+        // Leave response.varbindlist empty
+    }
+
+    if(request->remaining() < 0)
+    {
+        // Too late; the master agent has probably given up
+        QMutexLocker locker(&m_stats_mutex);
+        m_late_responses++;
+        for(size_t i = 0; i < varbinds.size(); i++)
+        {
+            // Only the variables which were slow themselves
+            if(varbinds[i].var && request->overran(request->positions[i]))
+            {
+                m_overruns[varbinds[i].name]++;
+            }
+        }
+    }
+}
+
+
+
+void MasterProxy::send_response(QSharedPointer<ResponsePDU> response)
+{
+    try
+    {
+        connection->send(response);
+    }
+    catch(timeout_error)
+    {
+        // Connection loss. Ignore.
+    }
+    catch(disconnected)
+    {
+        // Connection loss. Ignore.
+    }
+}
+
+
+
+void MasterProxy::response_ready(PendingResponse* request)
+{
+    QMutexLocker locker(&m_pending_mutex);
+
+    map< PendingResponse*, QSharedPointer<PendingResponse> >::iterator r;
+    r = m_pending.find(request);
+    if(r == m_pending.end())
+    {
+        return;
+    }
+    m_completed.push_back(r->second);
+    m_pending.erase(r);
+
+    // Send the response from the thread of the MasterProxy
+    QMetaObject::invokeMethod(this, "send_completed_responses",
+                              Qt::QueuedConnection);
+}
+
+
+
+void MasterProxy::send_completed_responses()
+{
+    // Take the completed responses
+    list< QSharedPointer<PendingResponse> > completed;
+    {
+        QMutexLocker locker(&m_pending_mutex);
+        completed.swap(m_completed);
+    }
+
+    list< QSharedPointer<PendingResponse> >::iterator i;
+    for(i = completed.begin(); i != completed.end(); i++)
+    {
+        // Continue with the next round, if any
+        if( ! evaluate(*i) )
+        {
+            // Pending again
+            continue;
+        }
+
+        assemble(*i);
+        send_response((*i)->response);
+    }
+}
+
+
+
+void MasterProxy::update_timeouts()
+{
+    QSharedPointer<timeout_table> table(new timeout_table);
+
+    // The master agent's default is assumed to be 1 second (see 
+    // timeout_for())
+    table->fallback = (default_timeout != 0) ? default_timeout : 1;
+    table->uniform = table->fallback;
+
+    std::set<int> lengths;
+    std::list< QSharedPointer<RegisterPDU> >::const_iterator r;
+    for(r = registrations.begin(); r != registrations.end(); r++)
+    {
+        quint8 timeout = (*r)->get_timeout();
+        if(timeout == 0)
+        {
+            timeout = table->fallback;
+        }
+        if(timeout != table->fallback)
+        {
+            table->uniform = 0;
+        }
+        table->subtrees.insert(make_pair((*r)->get_subtree(), timeout));
+        lengths.insert((*r)->get_subtree().size());
+    }
+    table->lengths.assign(lengths.rbegin(), lengths.rend());
+
+    QMutexLocker locker(&m_variables_mutex);
+    m_timeouts = table;
+}
+
+
+
+quint8 MasterProxy::timeout_table::lookup(const Oid& name) const
+{
+    // Try the prefixes of name which are registered, longest first
+    Oid prefix(name);
+    vector<int>::const_iterator l;
+    for(l = lengths.begin(); l != lengths.end(); l++)
+    {
+        if(*l > name.size())
+        {
+            continue;
+        }
+        prefix.resize(*l);
+        map<Oid, quint8>::const_iterator s = subtrees.find(prefix);
+        if(s != subtrees.end())
+        {
+            return s->second;
+        }
+    }
+
+    return fallback;
+}
+
+
+
+quint8 MasterProxy::timeout_for(const Oid& name) const
+{
+    QSharedPointer<const timeout_table> table;
+    {
+        QMutexLocker locker(&m_variables_mutex);
+        table = m_timeouts;
+    }
+
+    return table->lookup(name);
+}
+
+
+
+qint64 MasterProxy::deadline_for(const vector<Oid>& names, qint64 age) const
+{
+    QSharedPointer<const timeout_table> table;
+    {
+        QMutexLocker locker(&m_variables_mutex);
+        table = m_timeouts;
+    }
+
+    // The shortest timeout of all names
+    quint8 timeout = table->uniform;
+    if(timeout == 0)
+    {
+        timeout = table->fallback;
+        vector<Oid>::const_iterator i;
+        for(i = names.begin(); i != names.end(); i++)
+        {
+            quint8 t = table->lookup(*i);
+            if(i == names.begin() || t < timeout)
+            {
+                timeout = t;
+            }
+        }
+    }
+
+    return qint64(timeout) * 1000 - age;
+}
+
+
+
+qint64 MasterProxy::deadline_for(const vector< pair<Oid,Oid> >& sr,
+                                 qint64 age) const
+{
+    QSharedPointer<const timeout_table> table;
+    {
+        QMutexLocker locker(&m_variables_mutex);
+        table = m_timeouts;
+    }
+
+    // The shortest timeout of all starting OID's
+    quint8 timeout = table->uniform;
+    if(timeout == 0)
+    {
+        timeout = table->fallback;
+        vector< pair<Oid,Oid> >::const_iterator i;
+        for(i = sr.begin(); i != sr.end(); i++)
+        {
+            quint8 t = table->lookup(i->first);
+            if(i == sr.begin() || t < timeout)
+            {
+                timeout = t;
+            }
+        }
+    }
+
+    return qint64(timeout) * 1000 - age;
+}
+
+
+
+map<Oid, quint32> MasterProxy::get_overruns() const
+{
+    QMutexLocker locker(&m_stats_mutex);
+
+    return m_overruns;
+}
+
+
+
+quint32 MasterProxy::get_late_responses() const
+{
+    QMutexLocker locker(&m_stats_mutex);
+
+    return m_late_responses;
+}
+
+
+
+void MasterProxy::reset_overruns()
+{
+    QMutexLocker locker(&m_stats_mutex);
+
+    m_overruns.clear();
+    m_late_responses = 0;
+}
+
+
+
+qint64 MasterProxy::ping(int timeout)
+{
+    QSharedPointer<PingPDU> pingpdu(new PingPDU);
+    pingpdu->set_sessionID(this->sessionID);
+
+    // throws timeout_error:
+    QElapsedTimer rtt;
+    rtt.start();
+    QSharedPointer<ResponsePDU> response;
+    response = this->connection->request(pingpdu, timeout);
+    qint64 usec = rtt.nsecsElapsed() / 1000;
+
+    if(response->get_error() != ResponsePDU::noAgentXError)
+    {
+	// notOpen: the master agent forgot our session
+	throw disconnected();
+    }
+
+    QMutexLocker locker(&m_stats_mutex);
+    m_ping_latency.add(usec);
+
+    return usec;
+}
+
+
+
+void MasterProxy::set_ping_interval(int interval, int timeout)
+{
+    if(interval < 0 || timeout < 1)
+    {
+	throw(inval_param());
+    }
+
+    m_ping_interval = interval;
+    m_ping_timeout = timeout;
+
+    if(interval == 0)
+    {
+	m_ping_timer.stop();
+    }
+    else
+    {
+	m_ping_timer.start(interval);
+    }
+}
+
+
+
+void MasterProxy::do_ping()
+{
+    if( ! is_connected() || m_reconnect_timer.isActive() )
+    {
+	// Nobody to ping
+	return;
+    }
+    if(m_ping_packetID != 0)
+    {
+	// The previous ping is still outstanding
+	return;
+    }
+
+    QSharedPointer<PingPDU> pingpdu(new PingPDU);
+    pingpdu->set_sessionID(this->sessionID);
+    m_ping_packetID = pingpdu->get_packetID();
+    m_ping_sent.start();
+    m_ping_deadline.start(m_ping_timeout);
+    try
+    {
+	// If the outbound queue is full, the ping is not sent and thus 
+	// times out, unless the queue drains meanwhile. Then the master 
+	// agent does not read our PDU's anyway.
+	this->connection->send_request(pingpdu, this);
+    }
+    catch(disconnected)
+    {
+	cancel_ping();
+    }
+}
+
+
+void MasterProxy::handle_response(QSharedPointer<ResponsePDU> response)
+{
+    if(response->get_packetID() != m_ping_packetID)
+    {
+	// Late response to a cancelled ping
+	return;
+    }
+    qint64 usec = m_ping_sent.nsecsElapsed() / 1000;
+    m_ping_deadline.stop();
+    m_ping_packetID = 0;
+
+    if(response->get_error() != ResponsePDU::noAgentXError)
+    {
+	// notOpen: the master agent forgot our session
+	ping_failed();
+	return;
+    }
+
+    QMutexLocker locker(&m_stats_mutex);
+    m_ping_latency.add(usec);
+}
+
+
+void MasterProxy::ping_timed_out()
+{
+    if(m_ping_packetID == 0)
+    {
+	// Completed meanwhile
+	return;
+    }
+    cancel_ping();
+    ping_failed();
+}
+
+
+void MasterProxy::ping_failed()
+{
+    {
+	QMutexLocker locker(&m_stats_mutex);
+	m_ping_failures++;
+    }
+
+    if(connection->session_count() > 1)
+    {
+	// The connector stays open for the other sessions -> close ours 
+	// without waiting for the response
+	try
+	{
+	    QSharedPointer<ClosePDU> closepdu(
+			new ClosePDU(this->sessionID, ClosePDU::reasonTimeouts));
+	    connection->trySend(closepdu);
+	}
+	catch(...)
+	{
+	    // The session is given up anyway -> ignore all errors
+	}
+    }
+    close_session();
+    connection_lost();
+}
+
+
+void MasterProxy::close_session()
+{
+    connection->remove_session(this->sessionID);
+
+    // Other sessions may share the connector; the last one disconnects it
+    if(connection->session_count() == 0)
+    {
+	this->connection->disconnect();
+    }
+}
+
+
+void MasterProxy::cancel_ping()
+{
+    m_ping_deadline.stop();
+    if(m_ping_packetID != 0)
+    {
+	connection->cancel_request(m_ping_packetID);
+	m_ping_packetID = 0;
+    }
+}
+
+
+
+LatencyHistogram MasterProxy::get_ping_latency() const
+{
+    QMutexLocker locker(&m_stats_mutex);
+
+    return m_ping_latency;
+}
+
+
+
+quint32 MasterProxy::get_ping_failures() const
+{
+    QMutexLocker locker(&m_stats_mutex);
+
+    return m_ping_failures;
+}
+
+
+
+void MasterProxy::reset_ping_latency()
+{
+    QMutexLocker locker(&m_stats_mutex);
+
+    m_ping_latency.clear();
+    m_ping_failures = 0;
+}
+
+
+
+void MasterProxy::set_walk_snapshots(int lifetime, size_t max_variables)
+{
+    if(lifetime < 0)
+    {
+	throw(inval_param());
+    }
+
+    QMutexLocker locker(&m_walks_mutex);
+    m_walk_lifetime = lifetime;
+    m_max_pinned_variables = max_variables;
+    m_walks.clear();
+    m_walk_clock.start();
+}
+
+
+
+QSharedPointer<const MasterProxy::variable_map_t>
+MasterProxy::walk_snapshot(const vector< pair<Oid,Oid> >& sr)
+{
+    if(m_walk_lifetime == 0 || sr.empty() || sr.back().first.include())
+    {
+	// Not pinned, or not the continuation of a walk
+	return variables_snapshot();
+    }
+
+    QMutexLocker locker(&m_walks_mutex);
+    map<Oid, pinned_walk>::iterator w = m_walks.find(sr.back().first);
+    if(w == m_walks.end() || w->second.expires < m_walk_clock.elapsed())
+    {
+	return variables_snapshot();
+    }
+
+    // Continue with the snapshot of the walk
+    QSharedPointer<const variable_map_t> vars = w->second.vars;
+    m_walks.erase(w);
+    return vars;
+}
+
+
+
+void MasterProxy::pin_walk(QSharedPointer<const variable_map_t> vars,
+                           const vector<Oid>& next)
+{
+    if(m_walk_lifetime == 0)
+    {
+	return;
+    }
+
+    QMutexLocker locker(&m_walks_mutex);
+    qint64 now = m_walk_clock.elapsed();
+
+    // Remove expired pins
+    map<Oid, pinned_walk>::iterator w = m_walks.begin();
+    while(w != m_walks.end())
+    {
+	if(w->second.expires < now)
+	{
+	    m_walks.erase(w++);
+	}
+	else
+	{
+	    w++;
+	}
+    }
+
+    // Pin
+    pinned_walk pin;
+    pin.vars = vars;
+    pin.expires = now + m_walk_lifetime;
+    for(size_t i = 0; i < next.size(); i++)
+    {
+	m_walks[next[i]] = pin;
+    }
+
+    // Release the pins expiring first while holding too much
+    while( ! m_walks.empty()
+	   && pinned_variables_locked(0) > m_max_pinned_variables )
+    {
+	map<Oid, pinned_walk>::iterator oldest = m_walks.begin();
+	for(w = m_walks.begin(); w != m_walks.end(); w++)
+	{
+	    if(w->second.expires < oldest->second.expires)
+	    {
+		oldest = w;
+	    }
+	}
+	m_walks.erase(oldest);
+    }
+}
+
+
+
+size_t MasterProxy::pinned_variables_locked(size_t* snapshots) const
+{
+    // Count each outdated snapshot once
+    QSharedPointer<const variable_map_t> current = variables_snapshot();
+    std::set<const variable_map_t*> seen;
+    size_t count = 0;
+    map<Oid, pinned_walk>::const_iterator w;
+    for(w = m_walks.begin(); w != m_walks.end(); w++)
+    {
+	const variable_map_t* vars = w->second.vars.data();
+	if(vars != current.data() && seen.insert(vars).second)
+	{
+	    count += vars->size();
+	}
+    }
+
+    if(snapshots)
+    {
+	*snapshots = seen.size();
+    }
+    return count;
+}
+
+
+
+size_t MasterProxy::get_pinned_snapshots() const
+{
+    QMutexLocker locker(&m_walks_mutex);
+    size_t snapshots;
+    pinned_variables_locked(&snapshots);
+    return snapshots;
+}
+
+
+
+size_t MasterProxy::get_pinned_variables() const
+{
+    QMutexLocker locker(&m_walks_mutex);
+    return pinned_variables_locked(0);
+}
+
+
+
+quint64 MasterProxy::get_cursor_hits() const
+{
+    QMutexLocker locker(&m_cursor_mutex);
+
+    return m_cursor_hits;
+}
+
+
+
+quint64 MasterProxy::get_cursor_misses() const
+{
+    QMutexLocker locker(&m_cursor_mutex);
+
+    return m_cursor_misses;
+}
+
+
+
+void MasterProxy::set_worker_threads(int count)
+{
+    if(count < 0)
+    {
+        throw(inval_param());
+    }
+
+    m_worker_threads = count;
+    if(count > 0)
+    {
+        m_workers.setMaxThreadCount(count);
+    }
+}
+
+
+
+void MasterProxy::handle_testsetpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<TestSetPDU> testset_pdu)
+{
+    // Handling according to
+    // RFC 2741, 7.2.4.1 "Subagent Processing of the agentx-TestSet-PDU"
+
+    // Extract Varbind list
+    vector<Varbind>& vb = testset_pdu->get_vb();
+
+    // Initially, no Varbind failed:
+    response->set_error(ResponsePDU::noAgentXError);
+
+    // The variables; unaffected by concurrent updates
+    QSharedPointer<const variable_map_t> vars = variables_snapshot();
+
+    // Iterate over list and handle each Varbind separately. Return on the 
+    // first varbind which doesn't validate correctly.
+    vector<Varbind>::const_iterator i;
+    quint16 index;
+    for(i = vb.begin(), index = 1; i != vb.end(); i++, index++)
+    {
+        // Find the associated variable
+        variable_map_t::const_iterator var;
+	var = vars->find(i->get_name());
+        if(var == vars->end())
+        {
+            // error: variable unknown
+            response->set_error(ResponsePDU::notWritable);
+            response->set_index(index);
+
+            // Some variables may have allocated resources, which must be
+            // released again. This is the same as handle_cleanupsetpdu() does, 
+            // so we are lazy here and call this function:
+            this->handle_cleanupsetpdu();
+            return;
         }
 
         // Remember the found variable for later operations
-        setlist.push_back(var->second);
+        setlist.push_back(var->second.var);
 
         // Perform validation, store result within response
         // Note: ResponsePDU::error_t and variable::testset_result_t are in 
         // sync, therefore the static cast works.
-        response->set_error(static_cast<ResponsePDU::error_t>(var->second->handle_testset(i->get_var())));
+        response->set_error(static_cast<ResponsePDU::error_t>(var->second.var->handle_testset(i->get_var())));
         if(response->get_error() != ResponsePDU::noAgentXError)
         {
             response->set_index(index);
@@ -738,6 +2017,9 @@ void MasterProxy::handle_pdu(QSharedPointer<PDU> pdu)
 	return;
     }
 
+    // The request sees all variables added or removed so far
+    publish_variables();
+
     // Here we process all PDU's except ResponsePDU's, according to RFC 2741, 
     // 7.2.2. "Subagent Processing".
 
@@ -763,7 +2045,9 @@ void MasterProxy::handle_pdu(QSharedPointer<PDU> pdu)
     //   - The flags are not copied, because they have
     //     other meanings in ResponsePDU's.
     //   - TODO: Context is not yet supported.
-    QSharedPointer<ResponsePDU> response(new ResponsePDU);
+    //   - The response comes from a pool and returns to it when it was
+    //     sent.
+    QSharedPointer<ResponsePDU> response = m_response_pool.acquire();
     response->set_sessionID( pdu->get_sessionID() );
     response->set_transactionID( pdu->get_transactionID() );
     response->set_packetID( pdu->get_packetID() );
@@ -796,16 +2080,51 @@ void MasterProxy::handle_pdu(QSharedPointer<PDU> pdu)
     QSharedPointer<GetPDU> get_pdu;
     if( (get_pdu = qSharedPointerDynamicCast<GetPDU>(pdu)) != 0 )
     {
+        qint64 deadline = deadline_for(get_pdu->get_sr(), pdu->get_age());
+        QSharedPointer<PendingResponse> request(
+                              new PendingResponse(this, response, deadline));
+        this->handle_getpdu(request, get_pdu);
+        if( ! this->evaluate(request) )
+        {
+            // Response is sent by send_completed_responses()
+            return;
+        }
         // (response is modified in-place)
-        this->handle_getpdu(response, get_pdu);
+        this->assemble(request);
     }
 
     // Is it a GetNextPDU?
     QSharedPointer<GetNextPDU> getnext_pdu;
     if( (getnext_pdu = qSharedPointerDynamicCast<GetNextPDU>(pdu)) != 0 )
     {
+        qint64 deadline = deadline_for(getnext_pdu->get_sr(), pdu->get_age());
+        QSharedPointer<PendingResponse> request(
+                              new PendingResponse(this, response, deadline));
+        this->handle_getnextpdu(request, getnext_pdu);
+        if( ! this->evaluate(request) )
+        {
+            // Response is sent by send_completed_responses()
+            return;
+        }
+        // (response is modified in-place)
+        this->assemble(request);
+    }
+
+    // Is it a GetBulkPDU?
+    QSharedPointer<GetBulkPDU> getbulk_pdu;
+    if( (getbulk_pdu = qSharedPointerDynamicCast<GetBulkPDU>(pdu)) != 0 )
+    {
+        qint64 deadline = deadline_for(getbulk_pdu->get_sr(), pdu->get_age());
+        QSharedPointer<PendingResponse> request(
+                              new PendingResponse(this, response, deadline));
+        this->handle_getbulkpdu(request, getbulk_pdu);
+        if( ! this->evaluate(request) )
+        {
+            // Response is sent by send_completed_responses()
+            return;
+        }
         // (response is modified in-place)
-        this->handle_getnextpdu(response, getnext_pdu);
+        this->assemble(request);
     }
 
     // Is it a TestSetPDU?
@@ -842,6 +2161,17 @@ void MasterProxy::handle_pdu(QSharedPointer<PDU> pdu)
         this->handle_undosetpdu(response, undoset_pdu);
     }
 
+    // Is it a ClosePDU?
+    QSharedPointer<ClosePDU> close_pdu;
+    if( (close_pdu = qSharedPointerDynamicCast<ClosePDU>(pdu)) != 0 )
+    {
+        // The master agent closed the session (RFC 2741, 7.1.8.)
+        connection_lost();
+
+        // Do not send a response:
+        return;
+    }
+
     // TODO: handle other PDU types
 
     // Finally: send the response
@@ -858,48 +2188,18 @@ void MasterProxy::handle_pdu(QSharedPointer<PDU> pdu)
 void MasterProxy::addVariables(QVector< QPair<
                             Oid, QSharedPointer<AbstractVariable> > > v)
 {
-    QVectorIterator<QPair< Oid,
-                           QSharedPointer<AbstractVariable> > > iter(v);
-    while(iter.hasNext())
-    {
-        QPair<Oid, QSharedPointer<AbstractVariable> > varPair;
-        varPair = iter.next();
-
-        add_variable(varPair.first, varPair.second);
-    }
+    update_variables(v, QVector<Oid>());
 }
 
 void MasterProxy::add_variable(const Oid& id, QSharedPointer<AbstractVariable> v)
 {
-    // Check whether id is contained in a registration
-    bool is_registered = false;
-    std::list< QSharedPointer<RegisterPDU> >::const_iterator r;
-    for(r = registrations.begin(); r != registrations.end(); r++)
-    {
-	if((*r)->get_instance_registration() == false &&
-	   (*r)->get_range_subid() == 0)
-	{
-	    // Registration is a simple subtree
-	    if( (*r)->get_subtree().contains(id) )
-	    {
-		// The ID lies within a registered area
-		is_registered = true;
-		break; // stop search
-	    }
-	}
-	// TODO: handle other registrations (e.g. instance registration)
-    }
-
-    if( ! is_registered )
-    {
-	// Not in a registered area
-	throw(unknown_registration());
-    }
-    variables[id] = v;
+    QVector< QPair< Oid, QSharedPointer<AbstractVariable> > > add;
+    add.append(qMakePair(id, v));
+    update_variables(add, QVector<Oid>());
 }
 
 
-bool MasterProxy::isRegistered(Oid id)
+bool MasterProxy::is_registered_locked(const Oid& id) const
 {
     // Check whether id is contained in a registration
     bool is_registered = false;
@@ -923,20 +2223,171 @@ bool MasterProxy::isRegistered(Oid id)
 }
 
 
+bool MasterProxy::isRegistered(Oid id)
+{
+    QMutexLocker locker(&m_registrations_mutex);
+    return is_registered_locked(id);
+}
+
+
 
 void MasterProxy::remove_variable(const Oid& id)
 {
-    // Remove variable
-    variables.erase(id); // If variable was not registered: ignore
+    // If variable was not registered: ignore
+    QVector<Oid> remove;
+    remove.append(id);
+    update_variables(QVector< QPair< Oid, QSharedPointer<AbstractVariable> > >(),
+                     remove);
 }
 
 void MasterProxy::removeVariables(const QVector<Oid>& ids)
 {
-    QVectorIterator<Oid> iter(ids);
-    while(iter.hasNext())
+    update_variables(QVector< QPair< Oid, QSharedPointer<AbstractVariable> > >(),
+                     ids);
+}
+
+
+
+QSharedPointer<const MasterProxy::variable_map_t>
+MasterProxy::variables_snapshot() const
+{
+    QMutexLocker locker(&m_variables_mutex);
+    return variables;
+}
+
+
+QSharedPointer<const MasterProxy::variable_map_t>
+MasterProxy::variables_snapshot(QSharedPointer<OidFilter>& filter) const
+{
+    QMutexLocker locker(&m_variables_mutex);
+    filter = m_filter;
+    return variables;
+}
+
+
+
+void MasterProxy::update_variables(
+    const QVector< QPair< Oid, QSharedPointer<AbstractVariable> > >& add,
+    const QVector<Oid>& remove)
+{
+    // Check that the variables lie within registrations
+    m_registrations_mutex.lock();
+    for(int i = 0; i < add.size(); i++)
+    {
+        if( ! is_registered_locked(add[i].first) )
+        {
+            // Not in a registered area
+            m_registrations_mutex.unlock();
+            throw(unknown_registration());
+        }
+    }
+    m_registrations_mutex.unlock();
+
+    // Queue the changes; the first one schedules publishing
+    QMutexLocker locker(&m_update_mutex);
+    bool scheduled = ! m_unpublished.empty();
+    for(int i = 0; i < add.size(); i++)
+    {
+        m_unpublished.push_back(variable_change(add[i].first, add[i].second));
+    }
+    for(int i = 0; i < remove.size(); i++)
+    {
+        m_unpublished.push_back(variable_change(remove[i]));
+    }
+    if( ! scheduled && ! m_unpublished.empty() )
+    {
+        QMetaObject::invokeMethod(this, "publish_variables",
+                                  Qt::QueuedConnection);
+    }
+}
+
+
+void MasterProxy::publish_variables()
+{
+    QMutexLocker locker(&m_update_mutex);
+    if(m_unpublished.empty())
+    {
+        return;
+    }
+
+    // Copy, modify and publish. Readers are not blocked meanwhile.
+    QSharedPointer<const variable_map_t> current = variables_snapshot();
+    QSharedPointer<variable_map_t> copy(new variable_map_t(*current));
+    std::set<Oid> touched;
+    for(size_t i = 0; i < m_unpublished.size(); i++)
+    {
+        const variable_change& change = m_unpublished[i];
+        touched.insert(change.name);
+        if( ! change.var )
+        {
+            copy->erase(change.name);
+            continue;
+        }
+        std::pair<variable_map_t::iterator, bool> result;
+        result = copy->insert(std::make_pair(change.name,
+                              registered_variable(change.name, change.var)));
+        if( ! result.second )
+        {
+            // Replace (the name stays the same)
+            result.first->second.var = change.var;
+        }
+    }
+    m_unpublished.clear();
+    QSharedPointer<const variable_map_t> updated(copy);
+
+    // Only the net changes matter for the filter
+    std::vector<Oid> added;
+    std::vector<Oid> removed;
+    std::set<Oid>::const_iterator t;
+    for(t = touched.begin(); t != touched.end(); t++)
+    {
+        bool before = current->find(*t) != current->end();
+        bool after = updated->find(*t) != updated->end();
+        if(after && ! before)
+        {
+            added.push_back(*t);
+        }
+        else if(before && ! after)
+        {
+            removed.push_back(*t);
+        }
+    }
+
+    // The filter must never reject a variable of the published map: 
+    // names are added before and removed after publishing. If the filter 
+    // became too small, a larger one is built and published together with 
+    // the map.
+    QSharedPointer<OidFilter> filter = m_filter;
+    if(updated->size() > filter->capacity())
+    {
+        filter = QSharedPointer<OidFilter>(new OidFilter(2 * updated->size()));
+        variable_map_t::const_iterator v;
+        for(v = updated->begin(); v != updated->end(); v++)
+        {
+            filter->insert(v->first);
+        }
+        removed.clear();
+    }
+    else
+    {
+        for(size_t i = 0; i < added.size(); i++)
+        {
+            filter->insert(added[i]);
+        }
+    }
+
+    m_variables_mutex.lock();
+    QSharedPointer<const variable_map_t> old = variables;
+    variables = updated;
+    m_filter = filter;
+    m_variables_mutex.unlock();
+
+    for(size_t i = 0; i < removed.size(); i++)
     {
-        remove_variable(iter.next());
+        filter->remove(removed[i]);
     }
+
+    // The old map is released (if unused) without holding the lock
 }
 
 void MasterProxy::send_notification(const Oid& snmpTrapOID,
@@ -22,29 +22,41 @@
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
 
 #include <QSharedPointer>
 #include <QtGlobal>
 
 #include <QObject>
 #include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QMap>
 #include <QVector>
 
 #include "Oid.hpp"
 #include "AbstractVariable.hpp"
 #include "TimeTicksVariable.hpp"
+#include "OidVariable.hpp"
 #include "ClosePDU.hpp"
 #include "ResponsePDU.hpp"
 #include "RegisterPDU.hpp"
 #include "UnregisterPDU.hpp"
 #include "GetPDU.hpp"
 #include "GetNextPDU.hpp"
+#include "GetBulkPDU.hpp"
 #include "TestSetPDU.hpp"
 #include "CleanupSetPDU.hpp"
 #include "CommitSetPDU.hpp"
 #include "UndoSetPDU.hpp"
+#include "Connector.hpp"
 #include "UnixDomainConnector.hpp"
+#include "PendingResponse.hpp"
+#include "LatencyHistogram.hpp"
+#include "OidFilter.hpp"
+#include "ResponsePDUPool.hpp"
 
 namespace agentxcpp
 {
@@ -74,7 +86,8 @@ namespace agentxcpp
      * and consequently become disconnected, without informing the user. It is 
      * possible to re-connect with the reconnect() function at any time (even 
      * if the session is currently established - it will be shut down and 
-     * re-established in this case).  When the object is destroyed, the session 
+     * re-established in this case). With set_auto_reconnect(), this is done 
+     * automatically whenever the connection breaks.  When the object is destroyed, the session 
      * will be cleanly shut down. The connection state can be inspected with 
      * the is_connected() function.  Some functions throw a disconnected 
      * exception if the session is not currently established.
@@ -160,12 +173,18 @@ namespace agentxcpp
      *
      * \internal
      *
-     * The variables are stored in the member variables, which is a 
+     * The variables are stored in the member variables, which points to a 
      * std::map<Oid, QSharedPointer<variable> >. The key is the OID for which the
      * variable was added. This allows easy lookup for the request 
      * dispatcher.
      *
-     * When removing a variable, it is removed from the variables member.
+     * The map is never modified once published. Added and removed 
+     * variables are queued (see update_variables()); the queued changes are 
+     * applied to a copy of the map, which then replaces the old map (see 
+     * publish_variables()). Thus, each request works on 
+     * the map it obtained when processing started (see 
+     * variables_snapshot()), without holding a lock while the map is 
+     * searched.
      *
      * The variables member becomes invalid on connection loss. Since a 
      * connection loss is not signaled, the member cannot be cleared in such
@@ -176,15 +195,118 @@ namespace agentxcpp
      * \endinternal
      *
      */
+    /**
+     * \par Thread Safety
+     *
+     * The methods register_subtree(), unregister_subtree(), 
+     * add_variable(), addVariables(), remove_variable(), 
+     * removeVariables() and isRegistered() may be called from any thread, 
+     * concurrently with each other and with the processing of requests.  
+     * Requests are processed in the thread of the MasterProxy. A request 
+     * sees either all or none of the effects of a concurrent 
+     * add_variable() or remove_variable() call; a variable removed while a 
+     * request is being processed may still be evaluated by that request.
+     *
+     * Added and removed variables are collected and applied to the 
+     * internal map of variables together, when the thread of the 
+     * MasterProxy processes its events or a request. Thus, filling a large 
+     * table with many add_variable() calls copies the map only once.  
+     * Each request sees all changes whose calls returned before the 
+     * request arrived.
+     *
+     * The remaining methods must be called from the thread of the 
+     * MasterProxy.
+     *
+     * \internal
+     *
+     * The variables member is updated in read-copy-update style: readers 
+     * take a reference to the current map under m_variables_mutex, which 
+     * is held only to copy the pointer, and then search the map without 
+     * locking. Writers queue their changes under m_update_mutex, so that no 
+     * update is lost. publish_variables() copies the map under the same 
+     * lock, without blocking readers.
+     *
+     * The registrations member is protected by m_registrations_mutex, 
+     * which is never held while communicating with the master agent. The 
+     * setlist member is only accessed while processing a request, i.e. in 
+     * the thread of the MasterProxy, and needs no lock.
+     *
+     * \endinternal
+     */
+    /**
+     * \par Parallel Evaluation of Variables
+     *
+     * By default, the Get handlers of the variables (i.e. their 
+     * perform_get() methods) are invoked one after the other within the 
+     * QApplication event loop. If some variables take long to obtain their 
+     * values, a pool of worker threads can be enabled using 
+     * set_worker_threads(). The variables addressed by a single Get, GetNext 
+     * or GetBulk request are then evaluated concurrently, and the response is 
+     * sent when all of them are finished. The varbinds in the response keep 
+     * the order of the request.
+     *
+     * Variables may also obtain their values asynchronously by overriding 
+     * AbstractVariable::handle_get_async(). The response is then sent when 
+     * the values are ready, and other requests are processed meanwhile.
+     *
+     * \note If worker threads are enabled, the perform_get() methods of
+     *       different variables may run at the same time in different 
+     *       threads. Variables which share data must protect it 
+     *       accordingly. The MasterProxy waits until the worker threads 
+     *       returned from all handlers of a request before it processes the 
+     *       next %PDU or sends a response. Therefore, a single variable is 
+     *       never evaluated by two threads at the same time, and a response 
+     *       is never serialized while a worker thread evaluates a variable.  
+     *       This does not hold for asynchronous variables which finish 
+     *       after their handle_get_async() returned: they must protect their 
+     *       value themselves until they call GetCompletion::finish().
+     *
+     * \internal
+     *
+     * Processing a Get, GetNext or GetBulk request is done in three steps:
+     * -# The varbinds of the response are determined by looking up the
+     *    requested OID's in the variables member. The result is stored in a 
+     *    PendingResponse object.
+     * -# The variables found in the first step are evaluated, i.e. their
+     *    handle_get_async() method is called, either in the current thread 
+     *    or on the m_workers thread pool. In the latter case, evaluate() 
+     *    waits until all jobs returned, so that worker threads never run 
+     *    while handle_pdu() or send_completed_responses() run. See 
+     *    evaluate().
+     * -# The response is filled from the PendingResponse and sent. See
+     *    assemble().
+     *
+     * The lookups of the first step do not depend on the values of the 
+     * variables, therefore all variables of a request can be evaluated 
+     * independently.
+     *
+     * If all variables finish synchronously, the third step is performed 
+     * immediately by handle_pdu(). Otherwise the PendingResponse is stored 
+     * in m_pending, and handle_pdu() returns without sending a response, so 
+     * that further PDU's can be processed. When the last variable finished, 
+     * response_ready() queues the response for send_completed_responses(), 
+     * which performs the third step within the thread of the MasterProxy.
+     *
+     * \endinternal
+     */
     /**
      * \internal
      *
      * \par Internals
      * 
-     * Receiving and processing PDU's coming from the master is done using the 
-     * UnixDomainConnector class. The MasterProxy implements the handle_pdu() 
-     * slot, which is connected to the UnixDomainConnector::pduArrived() 
-     * signal.
+     * Receiving and processing PDU's coming from the master is done using a 
+     * Connector, by default the UnixDomainConnector class. The MasterProxy 
+     * implements the handle_pdu() slot. After the session was opened, the 
+     * MasterProxy registers itself with Connector::add_session(), so that 
+     * the connector passes the %PDU's of this session to handle_pdu(). 
+     * Because of this routing, several MasterProxy objects can share a 
+     * single connector, each with its own session.
+     *
+     * Each received %PDU records its time of arrival (see PDU::get_age()).  
+     * For Get, GetNext and GetBulk requests, a deadline is derived from it 
+     * and the timeout the master agent applies (see timeout_for()). The 
+     * deadline is stored in the PendingResponse and used by evaluate() and 
+     * assemble().
      *
      * \endinternal
      *
@@ -201,7 +323,8 @@ namespace agentxcpp
              * \brief The thread running a UnixDomainConnector.
              *
              * The UnixDomainConnector object is moved into this thread after 
-             * creation.
+             * creation. Unused if the connector was given to the 
+             * constructor.
              */
             QThread m_thread;
 
@@ -213,9 +336,17 @@ namespace agentxcpp
 	    /**
 	     * \brief The connector object used for networking.
 	     *
-	     * Created by constructors, destroyed by destructor.
+	     * Created or passed by constructors. Owned by m_connector.
+	     */
+	    Connector* connection;
+
+	    /**
+	     * \brief The reference to the connector.
+	     *
+	     * Several sessions may share a connector; it is destroyed when 
+	     * the last of them is destroyed.
 	     */
-	    UnixDomainConnector* connection;
+	    QSharedPointer<Connector> m_connector;
 
 	    /**
 	     * \brief The session ID of the current session.
@@ -249,26 +380,741 @@ namespace agentxcpp
 	     *
              * Every time an registration is performed, the RegisterPDU is 
              * stored in this list. This allows to automatically re-register 
-             * these subtrees on reconnect.
+             * these subtrees on reconnect. Protected by 
+             * m_registrations_mutex.
 	     */
 	    std::list< QSharedPointer<RegisterPDU> > registrations;
 
+	    /**
+	     * \brief The timeouts the master agent applies to the registered
+	     *        subtrees.
+	     *
+	     * Built from the registrations by update_timeouts(), so that 
+	     * timeout_for() neither locks m_registrations_mutex nor scans all 
+	     * registrations for each varbind.
+	     */
+	    struct timeout_table
+	    {
+		/**
+		 * \brief The effective timeout of each registered subtree, in
+		 *        seconds.
+		 *
+		 * If a subtree is registered several times, the first 
+		 * registration counts.
+		 */
+		std::map<Oid, quint8> subtrees;
+
+		/**
+		 * \brief The lengths of the subtrees, longest first, without
+		 *        duplicates.
+		 */
+		std::vector<int> lengths;
+
+		/**
+		 * \brief The timeout of OID's outside all registrations and of
+		 *        registrations without timeout.
+		 */
+		quint8 fallback;
+
+		/**
+		 * \brief The timeout of all OID's, or 0 if it depends on the 
+		 *        OID.
+		 */
+		quint8 uniform;
+
+		/**
+		 * \brief Find the timeout of the most specific registration
+		 *        containing an OID.
+		 */
+		quint8 lookup(const Oid& name) const;
+	    };
+
+	    /**
+	     * \brief The current timeout table.
+	     *
+	     * Replaced as a whole by update_timeouts(), like variables. The 
+	     * pointer is protected by m_variables_mutex.
+	     */
+	    QSharedPointer<const timeout_table> m_timeouts;
+
+	    /**
+	     * \brief Rebuild m_timeouts from the registrations.
+	     *
+	     * Must be called with m_registrations_mutex held, whenever the 
+	     * registrations changed.
+	     */
+	    void update_timeouts();
+
+	    /**
+	     * \brief Protects registrations.
+	     */
+	    mutable QMutex m_registrations_mutex;
+
+	    /**
+	     * \brief A variable added with add_variable().
+	     */
+	    struct registered_variable
+	    {
+		/**
+		 * \brief The variable.
+		 */
+		QSharedPointer<AbstractVariable> var;
+
+		/**
+		 * \brief The serialized form of the name of the variable.
+		 *
+		 * Names never change, so they are encoded once when the 
+		 * variable is added, and copied into each response.
+		 */
+		QSharedPointer<const binary> encoded_name;
+
+		/**
+		 * \brief Create the entry, encoding the name.
+		 */
+		registered_variable(const Oid& name,
+				    QSharedPointer<AbstractVariable> _var)
+		    : var(_var),
+		      encoded_name(new binary(OidVariable(name).serialize()))
+		{
+		}
+	    };
+
+	    /**
+	     * \brief The type of the storage for SNMP variables.
+	     */
+	    typedef std::map< Oid, registered_variable > variable_map_t;
+
 	    /**
 	     * \brief Storage for all SNMP variables known to the MasterProxy.
+	     *
+	     * The map is never modified; it is replaced as a whole by 
+	     * publish_variables(). The pointer is protected by 
+	     * m_variables_mutex.
+	     */
+	    QSharedPointer<const variable_map_t> variables;
+
+	    /**
+	     * \brief A filter which contains the OID's of variables.
+	     *
+	     * Used by handle_getpdu() to reject unknown OID's without 
+	     * searching variables. It is updated in place by 
+	     * publish_variables() and replaced by a larger one when it becomes 
+	     * too small. The pointer is protected by m_variables_mutex.
+	     */
+	    QSharedPointer<OidFilter> m_filter;
+
+	    /**
+	     * \brief Protects the variables and m_filter pointers (not the
+	     *        objects).
+	     */
+	    mutable QMutex m_variables_mutex;
+
+	    /**
+	     * \brief Serializes the updates of variables and protects
+	     *        m_unpublished.
+	     */
+	    QMutex m_update_mutex;
+
+	    /**
+	     * \brief A change of variables which is not yet published.
+	     */
+	    struct variable_change
+	    {
+		/**
+		 * \brief The OID of the variable.
+		 */
+		Oid name;
+
+		/**
+		 * \brief The variable to add, or NULL to remove the variable.
+		 */
+		QSharedPointer<AbstractVariable> var;
+
+		/**
+		 * \brief Create the change.
+		 */
+		variable_change(const Oid& _name,
+				QSharedPointer<AbstractVariable> _var =
+				    QSharedPointer<AbstractVariable>())
+		    : name(_name),
+		      var(_var)
+		{
+		}
+	    };
+
+	    /**
+	     * \brief The changes of variables since the map was published
+	     *        last, in call order.
+	     *
+	     * Applied by publish_variables(). Protected by m_update_mutex.
 	     */
-	    std::map< Oid, QSharedPointer<AbstractVariable> > variables;
+	    std::vector<variable_change> m_unpublished;
+
+	    /**
+	     * \brief Get the current map of variables.
+	     *
+	     * The returned map stays valid (and unchanged) as long as the 
+	     * reference is held, even if variables are added or removed 
+	     * meanwhile.
+	     */
+	    QSharedPointer<const variable_map_t> variables_snapshot() const;
+
+	    /**
+	     * \brief Get the current map of variables and m_filter.
+	     *
+	     * The filter never rejects an OID of the returned map, except for 
+	     * variables which are removed meanwhile.
+	     *
+	     * \param filter Receives m_filter.
+	     */
+	    QSharedPointer<const variable_map_t>
+	    variables_snapshot(QSharedPointer<OidFilter>& filter) const;
+
+	    /**
+	     * \brief Add and remove variables.
+	     *
+	     * Queues the changes in m_unpublished. They are published by 
+	     * publish_variables(), which is invoked in the thread of the 
+	     * MasterProxy when the first change is queued. Added variables 
+	     * replace existing ones with the same OID.
+	     *
+	     * \exception unknown_registration If a variable to add is not
+	     *                                 within a registered subtree. 
+	     *                                 Nothing is queued then.
+	     *
+	     * \param add The variables to add.
+	     *
+	     * \param remove The OID's of the variables to remove. They are
+	     *               removed after adding.
+	     */
+	    void update_variables(
+		const QVector< QPair< Oid, QSharedPointer<AbstractVariable> > >& add,
+		const QVector<Oid>& remove);
+
+	    /**
+	     * \brief Check whether an OID lies within a registration.
+	     *
+	     * Like isRegistered(), but m_registrations_mutex must already be
+	     * held.
+	     */
+	    bool is_registered_locked(const Oid& id) const;
+
+            /**
+             * \brief The variables affected by the Set operation currently
+             *        in progress.
+             *
+             * The CommitSet, UndoSet and CleanupSet PDU's do not contain the 
+             * affected variables but operate on the variables denominated in 
+             * the preceding TestSet PDU.
+             *
+             * These are the variables denominated in that TestSet PDU.
+             */
+            std::list< QSharedPointer<AbstractVariable> > setlist;
+
+            /**
+             * \brief Worker threads for the evaluation of variables.
+             *
+             * Only used if m_worker_threads is not 0.
+             */
+            QThreadPool m_workers;
+
+            /**
+             * \brief The number of worker threads used to evaluate
+             *        variables.
+             *
+             * 0 means that variables are evaluated in the thread running 
+             * handle_pdu().
+             */
+            int m_worker_threads;
+
+            /**
+             * \brief Recycles the ResponsePDU's created by handle_pdu().
+             */
+            ResponsePDUPool m_response_pool;
+
+            /**
+             * \brief Find the lexicographical successor of an OID.
+             *
+             * This function searches a map of variables for the first 
+             * variable following the starting OID, according to the rules for 
+             * SearchRanges in RFC 2741, 5.2 "SearchRange".
+             *
+             * \param vars The variables to search (see
+             *             variables_snapshot()).
+             *
+             * If the starting OID is the name of a variable found by one of 
+             * the last calls (and its include field is not set), the search 
+             * continues from that position without searching the map (see 
+             * m_cursors).
+             *
+             * \param starting_oid The starting OID. If its include field is
+             *                     set, a variable with exactly this OID is 
+             *                     also a match.
+             *
+             * \param ending_oid The ending OID. The found variable must
+             *                   precede it. If it is the null OID, there is 
+             *                   no upper bound.
+             *
+             * \return The found variable, or vars.end() if there is
+             *         none.
+             */
+            variable_map_t::const_iterator
+            find_next(const QSharedPointer<const variable_map_t>& vars,
+                      const Oid& starting_oid, const Oid& ending_oid) const;
+
+            /**
+             * \brief A position within a map of variables, remembered by
+             *        find_next().
+             */
+            struct cursor
+            {
+                /**
+                 * \brief The map; held so that pos stays valid.
+                 */
+                QSharedPointer<const variable_map_t> vars;
+
+                /**
+                 * \brief A variable found by find_next().
+                 */
+                variable_map_t::const_iterator pos;
+            };
+
+            /**
+             * \brief The number of cursors in m_cursors.
+             *
+             * Sequential walks need one cursor each, so this is the number 
+             * of concurrent walks which are served without searching.
+             */
+            static const int cursor_count = 8;
+
+            /**
+             * \brief The positions of the last variables found by
+             *        find_next().
+             *
+             * A walk continues at the variable returned last, so the next 
+             * variable is found by incrementing the iterator, instead of 
+             * searching the map. Entries whose vars is NULL are unused.  
+             * An entry keeps its map alive, i.e. up to cursor_count outdated 
+             * maps may be held. Protected by m_cursor_mutex.
+             */
+            mutable cursor m_cursors[cursor_count];
+
+            /**
+             * \brief The entry of m_cursors to be replaced next.
+             */
+            mutable int m_next_cursor;
+
+            /**
+             * \brief The number of searches served by m_cursors.
+             */
+            mutable quint64 m_cursor_hits;
+
+            /**
+             * \brief The number of searches which were eligible for
+             *        m_cursors, but had to search the map.
+             */
+            mutable quint64 m_cursor_misses;
+
+            /**
+             * \brief Protects m_cursors, m_next_cursor, m_cursor_hits and
+             *        m_cursor_misses.
+             */
+            mutable QMutex m_cursor_mutex;
+
+            /**
+             * \brief Determine the timeout the master agent applies to
+             *        requests for an OID.
+             *
+             * The timeout is taken from the most specific registration 
+             * containing the OID. If there is none, or if its timeout is 0, 
+             * the default_timeout of the session is used. If that is 0, too, 
+             * the master agent uses its own default. RFC 2741 does not 
+             * specify it and the subagent cannot query it, so 1 second is 
+             * assumed, which is the default of Net-SNMP's master agent 
+             * (agentXTimeout). If the real timeout is longer, GetBulk 
+             * responses are cut shorter than necessary and overruns are 
+             * counted too early, but no response is lost.
+             *
+             * The timeout is looked up in m_timeouts.
+             *
+             * \note The range_subid and upper_bound fields of the
+             *       registrations are not evaluated.
+             *
+             * \param name The OID.
+             *
+             * \return The timeout in seconds.
+             */
+            quint8 timeout_for(const Oid& name) const;
+
+            /**
+             * \brief Determine the deadline of a response.
+             *
+             * \param names The OID's of the request. The shortest timeout
+             *              of them is used (see timeout_for()).
+             *
+             * \param age The time since the request was received, in
+             *            milliseconds.
+             *
+             * \return The time, in milliseconds from now, until which the
+             *         response should be sent.
+             */
+            qint64 deadline_for(const std::vector<Oid>& names,
+                                qint64 age) const;
+
+            /**
+             * \brief Determine the deadline of a response.
+             *
+             * Like deadline_for(const std::vector<Oid>&, qint64), but uses 
+             * the starting OID's of a SearchRange list.
+             */
+            qint64 deadline_for(const std::vector< std::pair<Oid,Oid> >& sr,
+                                qint64 age) const;
+
+            /**
+             * \brief The number of times a variable finished after the
+             *        deadline of its response, per varbind name.
+             *
+             * Protected by m_stats_mutex.
+             */
+            std::map<Oid, quint32> m_overruns;
+
+            /**
+             * \brief The number of responses sent after their deadline.
+             *
+             * Protected by m_stats_mutex.
+             */
+            quint32 m_late_responses;
+
+            /**
+             * \brief Protects m_overruns, m_late_responses, m_ping_failures
+             *        and m_ping_latency.
+             */
+            mutable QMutex m_stats_mutex;
+
+            /**
+             * \brief Responses waiting for their variables.
+             *
+             * Contains the PendingResponse objects whose variables did not 
+             * finish synchronously. Protected by m_pending_mutex.
+             */
+            std::map< PendingResponse*,
+                      QSharedPointer<PendingResponse> > m_pending;
+
+            /**
+             * \brief Responses whose variables finished.
+             *
+             * These are sent by send_completed_responses(). Protected by 
+             * m_pending_mutex.
+             */
+            std::list< QSharedPointer<PendingResponse> > m_completed;
+
+            /**
+             * \brief Protects m_pending and m_completed.
+             */
+            QMutex m_pending_mutex;
+
+            /**
+             * \brief Whether the session is re-established automatically.
+             */
+            bool m_auto_reconnect;
+
+            /**
+             * \brief The first delay before reconnecting, in milliseconds.
+             */
+            int m_reconnect_min_delay;
+
+            /**
+             * \brief The upper limit of the reconnect delay, in
+             *        milliseconds.
+             */
+            int m_reconnect_max_delay;
+
+            /**
+             * \brief The current reconnect delay, in milliseconds.
+             *
+             * Starts at m_reconnect_min_delay and is doubled after each 
+             * failed attempt, up to m_reconnect_max_delay.
+             */
+            int m_reconnect_delay;
+
+            /**
+             * \brief State of the random generator for the reconnect delay.
+             *
+             * A private linear congruential generator is used instead of 
+             * qrand(), so that the random sequence of the application is not 
+             * reseeded. It is seeded from the time and the address of the 
+             * object, so that subagents started together draw different 
+             * delays.
+             */
+            quint32 m_reconnect_random;
+
+            /**
+             * \brief The number of sessions re-established automatically.
+             */
+            quint32 m_reconnects;
+
+            /**
+             * \brief Timer for the next reconnect attempt.
+             *
+             * A child of the MasterProxy, so that it follows the object into 
+             * another thread.
+             */
+            QTimer m_reconnect_timer;
+
+            /**
+             * \brief The interval between pings, in milliseconds, or 0 if
+             *        pinging is disabled.
+             */
+            int m_ping_interval;
+
+            /**
+             * \brief How long to wait for the response to a ping, in
+             *        milliseconds.
+             */
+            int m_ping_timeout;
+
+            /**
+             * \brief The number of periodic pings which failed.
+             *
+             * Protected by m_stats_mutex.
+             */
+            quint32 m_ping_failures;
+
+            /**
+             * \brief The round-trip times of the pings.
+             *
+             * Protected by m_stats_mutex.
+             */
+            LatencyHistogram m_ping_latency;
+
+            /**
+             * \brief Timer for the periodic pings.
+             *
+             * A child of the MasterProxy, like m_reconnect_timer.
+             */
+            QTimer m_ping_timer;
+
+            /**
+             * \brief The packetID of the periodic ping awaiting its 
+             *        response, or 0.
+             */
+            quint32 m_ping_packetID;
+
+            /**
+             * \brief Started when the periodic ping was sent.
+             */
+            QElapsedTimer m_ping_sent;
+
+            /**
+             * \brief Expires when the periodic ping was not answered in 
+             *        time.
+             *
+             * A single-shot child of the MasterProxy, like m_ping_timer.
+             */
+            QTimer m_ping_deadline;
+
+            /**
+             * \brief How long a walk keeps its snapshot of the variables,
+             *        in milliseconds, or 0 if walks are not pinned.
+             */
+            int m_walk_lifetime;
+
+            /**
+             * \brief The maximum number of variables held by pinned
+             *        snapshots.
+             *
+             * See get_pinned_variables().
+             */
+            size_t m_max_pinned_variables;
+
+            /**
+             * \brief A snapshot pinned by a walk.
+             */
+            struct pinned_walk
+            {
+                /**
+                 * \brief The snapshot of the variables.
+                 */
+                QSharedPointer<const variable_map_t> vars;
+
+                /**
+                 * \brief When the pin expires (see m_walk_clock).
+                 */
+                qint64 expires;
+            };
+
+            /**
+             * \brief The snapshots pinned by walks.
+             *
+             * The key is the OID at which the walk is expected to continue, 
+             * i.e. the name of the last varbind of a GetNext response, or 
+             * the last name of each repetition of a GetBulk response.  
+             * Protected by m_walks_mutex.
+             */
+            std::map<Oid, pinned_walk> m_walks;
+
+            /**
+             * \brief Protects m_walks.
+             */
+            mutable QMutex m_walks_mutex;
+
+            /**
+             * \brief The clock for pinned_walk::expires.
+             */
+            QElapsedTimer m_walk_clock;
+
+            /**
+             * \brief Get the snapshot of the variables for a GetNext or
+             *        GetBulk request.
+             *
+             * If the request continues a walk (i.e. the starting OID of its 
+             * last SearchRange is a key of m_walks), the snapshot pinned by 
+             * that walk is returned and unpinned (it is pinned again by 
+             * pin_walk()). Otherwise, the current snapshot is returned.
+             *
+             * \param sr The SearchRange list of the request.
+             */
+            QSharedPointer<const variable_map_t>
+            walk_snapshot(const std::vector< std::pair<Oid,Oid> >& sr);
+
+            /**
+             * \brief Pin a snapshot for the continuation of a walk.
+             *
+             * Does nothing if walks are not pinned. Expired pins are 
+             * removed, and the pins expiring first are removed while the 
+             * pinned snapshots hold more than m_max_pinned_variables 
+             * variables.
+             *
+             * \param vars The snapshot used by the response.
+             *
+             * \param next The OID's at which the walk may continue.
+             */
+            void pin_walk(QSharedPointer<const variable_map_t> vars,
+                          const std::vector<Oid>& next);
+
+            /**
+             * \brief Count the snapshots held only by m_walks and their
+             *        variables.
+             *
+             * m_walks_mutex must be held.
+             *
+             * \return The number of variables.
+             */
+            size_t pinned_variables_locked(size_t* snapshots) const;
+
+            /**
+             * \brief Common initialization of the constructors.
+             *
+             * Prepares m_reconnect_timer and connects 
+             * Connector::connectionLost() to connection_lost().
+             */
+            void init_reconnect();
+
+            /**
+             * \brief Open a session.
+             *
+             * Connects the connector (if needed), sends an OpenPDU and 
+             * routes the %PDU's of the new session to this object. The 
+             * registrations and variables are not touched. The response is 
+             * awaited for Connector::get_timeout() at most.
+             *
+             * \exception disconnected If connecting or opening fails.
+             */
+            void open_session();
+
+            /**
+             * \brief Re-establish the session and its registrations.
+             *
+             * Opens a new session and replays the stored registrations. The 
+             * RegisterPDU's are sent back-to-back with 
+             * Connector::request_batch(), so that re-registering a large MIB 
+             * costs about one round trip instead of one per subtree.  
+             * Registrations the master agent refuses are dropped. The 
+             * variables are kept.
+             *
+             * \exception disconnected If the session cannot be opened, or the
+             *                         connection is lost or the master agent 
+             *                         stops answering (see 
+             *                         Connector::get_timeout()) while 
+             *                         re-registering.
+             */
+            void resume();
+
+            /**
+             * \brief Start m_reconnect_timer.
+             *
+             * The timer is started with a random delay between half and the 
+             * full m_reconnect_delay, so that many subagents losing their 
+             * master agent at the same time do not reconnect in lockstep.
+             */
+            void schedule_reconnect();
+
+            /**
+             * \brief Evaluate all variables of a response.
+             *
+             * Calls AbstractVariable::handle_get_async() for each distinct 
+             * variable of the response. If worker threads are enabled and 
+             * more than one variable is involved, this is done on the 
+             * m_workers thread pool, otherwise in the current thread. The 
+             * function waits until the worker jobs of a round returned, 
+             * because variables must not be evaluated concurrently by 
+             * several requests.
+             *
+             * \param request The response. Its varbinds member must be
+             *                filled.
+             *
+             * The variables are evaluated round by round (see 
+             * PendingResponse::rounds). Before a round is started, the 
+             * average duration of the previous rounds is compared with the 
+             * time left until the deadline of the response. If the next round 
+             * would probably miss the deadline, the remaining rounds are 
+             * dropped and the response is sent with the varbinds obtained so 
+             * far. This function is called again by 
+             * send_completed_responses() to continue with the next round 
+             * after a round finished asynchronously.
+             *
+             * \return True if all rounds finished synchronously; the
+             *         response can be assembled right away. False if the 
+             *         response is pending; it will be sent by 
+             *         send_completed_responses().
+             */
+            bool evaluate(QSharedPointer<PendingResponse> request);
+
+            /**
+             * \brief Fill a ResponsePDU with evaluated varbinds.
+             *
+             * The varbinds are added to request->response in the order of 
+             * the list. For each varbind whose variable failed, the error 
+             * genErr is set in the response along with the index of that 
+             * varbind, and no varbind is added.
+             *
+             * If the deadline of the response has passed, the overrun is 
+             * counted for each varbind whose variable finished after the 
+             * deadline (see get_overruns()).
+             *
+             * \param request The evaluated response.
+             */
+            void assemble(QSharedPointer<PendingResponse> request);
 
             /**
-             * \brief The variables affected by the Set operation currently
-             *        in progress.
+             * \brief Send a ResponsePDU to the master agent.
              *
-             * The CommitSet, UndoSet and CleanupSet PDU's do not contain the 
-             * affected variables but operate on the variables denominated in 
-             * the preceding TestSet PDU.
+             * Connection loss is ignored.
+             */
+            void send_response(QSharedPointer<ResponsePDU> response);
+
+            /**
+             * \brief Called when all variables of a pending response
+             *        finished.
              *
-             * These are the variables denominated in that TestSet PDU.
+             * Moves the response from m_pending to m_completed and invokes 
+             * send_completed_responses() within the thread of the 
+             * MasterProxy. This function is called by 
+             * PendingResponse::finish() and may run in any thread.
              */
-            std::list< QSharedPointer<AbstractVariable> > setlist;
+            void response_ready(PendingResponse* request);
+
+            friend class PendingResponse;
 
 	    /**
 	     * \brief Send a RegisterPDU to the master agent.
@@ -368,29 +1214,43 @@ namespace agentxcpp
              * \brief Handle incoming GetPDU's.
              *
              * This method is called by handle_pdu(). It processes the given 
-             * GetPDU and stores the results in the given ResponsePDU (i.e. it 
-             * adds varbinds to the ResponsePDU).
+             * GetPDU and stores the varbinds of the response in the given 
+             * PendingResponse. The variables are not yet evaluated.
              *
-             * \param response The pre-initialized ResponsePDU. Varbinds are
-             *                 added to this PDU during processing.
+             * \param request The pending response. Varbinds are added to it
+             *                during processing.
              *
              * \param get_pdu The GetPDU to be processed.
              */
-            void handle_getpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<GetPDU> get_pdu);
+            void handle_getpdu(QSharedPointer<PendingResponse> request, QSharedPointer<GetPDU> get_pdu);
 
             /**
              * \brief Handle incoming GetNextPDU's.
              *
              * This method is called by handle_pdu(). It processes the given 
-             * GetNextPDU and stores the results in the given ResponsePDU (i.e.  
-             * it adds Varbinds to the ResponsePDU).
+             * GetNextPDU and stores the varbinds of the response in the given 
+             * PendingResponse. The variables are not yet evaluated.
              *
-             * \param response The pre-initialized ResponsePDU. Varbinds are
-             *                 added to this PDU during processing.
+             * \param request The pending response. Varbinds are added to it
+             *                during processing.
              *
              * \param getnext_pdu The GetNextPDU to be processed.
              */
-            void handle_getnextpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<GetNextPDU> getnext_pdu);
+            void handle_getnextpdu(QSharedPointer<PendingResponse> request, QSharedPointer<GetNextPDU> getnext_pdu);
+
+            /**
+             * \brief Handle incoming GetBulkPDU's.
+             *
+             * This method is called by handle_pdu(). It processes the given 
+             * GetBulkPDU and stores the varbinds of the response in the given 
+             * PendingResponse. The variables are not yet evaluated.
+             *
+             * \param request The pending response. Varbinds are added to it
+             *                during processing.
+             *
+             * \param getbulk_pdu The GetBulkPDU to be processed.
+             */
+            void handle_getbulkpdu(QSharedPointer<PendingResponse> request, QSharedPointer<GetBulkPDU> getbulk_pdu);
 
             /**
              * \brief Handle incoming TestSetPDU's.
@@ -436,14 +1296,106 @@ namespace agentxcpp
              */
             void handle_undosetpdu(QSharedPointer<ResponsePDU> response, QSharedPointer<UndoSetPDU> undoset_pdu);
 
+            /**
+             * \brief Handle a failed periodic ping.
+             *
+             * The master agent is regarded as dead: the session is closed 
+             * (see close_session()) and handled like a lost connection (see 
+             * connection_lost()). If other sessions share the connector, a 
+             * ClosePDU is sent without waiting for the response.
+             */
+            void ping_failed();
+
+            /**
+             * \brief Detach the session from the connector.
+             *
+             * The connector is disconnected only if no other session uses 
+             * it; otherwise it is left open for the other MasterProxy 
+             * objects sharing it.
+             */
+            void close_session();
+
+            /**
+             * \brief Forget the periodic ping awaiting its response, if 
+             *        any.
+             */
+            void cancel_ping();
+
+        private slots:
+
+            /**
+             * \brief Send the responses whose variables finished.
+             *
+             * Assembles and sends all responses in m_completed. Invoked by 
+             * response_ready().
+             */
+            void send_completed_responses();
+
+            /**
+             * \brief Handle the loss of the connection.
+             *
+             * Connected to Connector::connectionLost(). Detaches the session 
+             * from the connector and, if enabled, schedules a reconnect.
+             */
+            void connection_lost();
+
+            /**
+             * \brief Try to re-establish the session.
+             *
+             * Invoked by m_reconnect_timer. On failure, the delay is doubled 
+             * and the next attempt is scheduled.
+             */
+            void try_reconnect();
+
+            /**
+             * \brief Send a periodic ping.
+             *
+             * Invoked by m_ping_timer. The PingPDU is sent with 
+             * Connector::send_request(), so that the thread is not blocked 
+             * while the response is awaited. The ping completes in 
+             * handle_response() or, if the master agent does not answer 
+             * within m_ping_timeout, in ping_timed_out(). No ping is sent 
+             * while the previous one is still outstanding.
+             */
+            void do_ping();
+
+            /**
+             * \brief Complete the periodic ping.
+             *
+             * Invoked by Connector::dispatch() with the response to the 
+             * PingPDU sent by do_ping(). Records the round-trip time, or 
+             * calls ping_failed() if the master agent does not know the 
+             * session.
+             */
+            void handle_response(QSharedPointer<ResponsePDU> response);
+
+            /**
+             * \brief Fail the periodic ping.
+             *
+             * Invoked by m_ping_deadline.
+             */
+            void ping_timed_out();
+
+            /**
+             * \brief Publish the queued changes of variables.
+             *
+             * Copies the current map once, applies all changes of 
+             * m_unpublished in order and publishes the copy. Invoked in the 
+             * thread of the MasterProxy after update_variables() queued the 
+             * first change, and by handle_pdu() before each request, so that 
+             * a request sees all changes made before it arrived.
+             */
+            void publish_variables();
+
 	public slots:
 	    /**
              * \internal
              *
 	     * \brief The dispatcher for incoming %PDU's.
 	     *
-             * This slot is connected to UnixDomainConnector::pduArrived() and 
-             * thus called for each incoming PDU (except ResponsePDU's).
+             * This slot is invoked by Connector::dispatch() for each 
+             * incoming PDU of this session (except ResponsePDU's), see 
+             * Connector::add_session().
              *
              * This method performs the steps described in RFC 2741, 7.2.2.  
              * "Subagent Processing" (except for the steps necessary for 
@@ -560,6 +1512,82 @@ namespace agentxcpp
 		   Oid ID=Oid(),
 		   std::string unix_domain_socket="/var/agentx/master");
 
+            /**
+	     * \brief Create a session object using a given connector.
+	     *
+	     * This constructor allows to choose the transport to the master 
+	     * agent, e.g. an EpollConnector instead of the 
+	     * UnixDomainConnector used by the other constructor. It tries to 
+	     * connect to the master agent. If that fails, the object is created 
+	     * nevertheless and will be in state disconnected.
+	     *
+	     * \param connector The connector. The MasterProxy takes ownership
+	     *                  and deletes it on destruction. The connector 
+	     *                  must be ready for use from the thread of the 
+	     *                  MasterProxy; e.g. a UnixDomainConnector must 
+	     *                  already live in a thread running an event loop.
+	     *
+             * \param description A string describing the subagent. This
+	     *                    description cannot be changed later.
+	     *
+             * \param default_timeout The length of time, in seconds, that
+             *                        the master agent should allow to elapse 
+             *                        before it regards the subagent as not 
+             *                        responding. Allowed values are 0-255, 
+             *                        with 0 meaning "no default for this 
+             *                        session".
+	     *
+	     * \param ID An Object Identifier that identifies the subagent.
+	     *           Default is the null OID (no ID).
+	     */
+	    MasterProxy(Connector* connector,
+		   std::string description="",
+		   quint8 default_timeout=0,
+		   Oid ID=Oid());
+
+            /**
+	     * \brief Create a session object sharing a connector with other
+	     *        sessions.
+	     *
+	     * RFC 2741 allows several sessions on a single connection to the 
+	     * master agent. Each MasterProxy created with the same connector 
+	     * opens its own session with its own registrations, default 
+	     * timeout and variables, while all of them use the same socket 
+	     * (and, depending on the connector, the same thread):
+	     *
+	     * \code
+	     * QSharedPointer<Connector> connection(new EpollConnector);
+	     * MasterProxy plugin1(connection, "plugin 1");
+	     * MasterProxy plugin2(connection, "plugin 2", 5);
+	     * \endcode
+	     *
+	     * The connector is connected if necessary. It is destroyed when the 
+	     * last MasterProxy using it is destroyed. Received %PDU's are 
+	     * passed to the session they belong to, in the thread of the 
+	     * respective MasterProxy.
+	     *
+	     * \param connector The shared connector. The same requirements 
+	     *                  as for MasterProxy(Connector*, std::string, 
+	     *                  quint8, Oid) apply.
+	     *
+             * \param description A string describing the subagent. This
+	     *                    description cannot be changed later.
+	     *
+             * \param default_timeout The length of time, in seconds, that
+             *                        the master agent should allow to elapse 
+             *                        before it regards the subagent as not 
+             *                        responding. Allowed values are 0-255, 
+             *                        with 0 meaning "no default for this 
+             *                        session".
+	     *
+	     * \param ID An Object Identifier that identifies the subagent.
+	     *           Default is the null OID (no ID).
+	     */
+	    MasterProxy(QSharedPointer<Connector> connector,
+		   std::string description="",
+		   quint8 default_timeout=0,
+		   Oid ID=Oid());
+
 	    /**
 	     * \brief Register a subtree with the master agent
 	     *
@@ -702,17 +1730,68 @@ namespace agentxcpp
 	    /**
 	     * \brief Reconnect to the master agent.
 	     *
-	     * Disconnects from the master (only if currently connected), then 
-	     * connects again.
+	     * Closes the session and the connection (only if currently 
+	     * connected), then connects again and opens a new session. If 
+	     * other sessions share the connector, the connection is left 
+	     * open and only the session is reopened.
+	     * Unlike connect(), the registrations and variables are kept: the 
+	     * registrations are sent to the master agent again.
 	     *
 	     * \exception disconnected If connecting fails.
 	     */
-	    void reconnect()
+	    void reconnect();
+
+	    /**
+	     * \brief Enable or disable automatic reconnection.
+	     *
+	     * If enabled, the MasterProxy re-establishes its session when the 
+	     * connection to the master agent is lost or the master agent 
+	     * closes the session, as reconnect() does. Failed attempts are 
+	     * repeated with exponential backoff: the delay starts at 
+	     * min_delay and doubles up to max_delay. Each delay is randomized 
+	     * to lie between half and the full value.
+	     *
+	     * Reconnecting happens in the thread of the MasterProxy, which 
+	     * therefore needs a running event loop.
+	     *
+	     * Automatic reconnection is disabled by default.
+	     *
+	     * \param enable Whether to reconnect automatically.
+	     *
+	     * \param min_delay The delay before the first attempt, in
+	     *                  milliseconds.
+	     *
+	     * \param max_delay The maximum delay between attempts, in
+	     *                  milliseconds.
+	     *
+	     * \exception inval_param If min_delay is less than 1 or
+	     *                        max_delay is less than min_delay.
+	     */
+	    void set_auto_reconnect(bool enable,
+				    int min_delay = 10,
+				    int max_delay = 30000);
+
+	    /**
+	     * \brief Whether automatic reconnection is enabled.
+	     *
+	     * \exception None.
+	     */
+	    bool auto_reconnect() const
+	    {
+		return m_auto_reconnect;
+	    }
+
+	    /**
+	     * \brief Get the number of automatic reconnects.
+	     *
+	     * \return How often the session was re-established automatically
+	     *         since the MasterProxy was created.
+	     *
+	     * \exception None.
+	     */
+	    quint32 get_reconnects() const
 	    {
-		this->connection->disconnect();
-	
-                // throws disconnected, which is forwarded:
-		this->connection->connect();
+		return m_reconnects;
 	    }
 
 	    /**
@@ -826,6 +1905,316 @@ namespace agentxcpp
 	     * \exception None.
 	     */
 	    bool isRegistered(Oid id);
+
+	    /**
+	     * \brief Set the number of worker threads used to evaluate
+	     *        variables.
+	     *
+	     * If count is greater than 0, the variables addressed by a Get, 
+	     * GetNext or GetBulk request are evaluated concurrently by up to 
+	     * count worker threads. See \ref agentxcpp::MasterProxy "Parallel
+	     * Evaluation of Variables" for details.
+	     *
+	     * \param count The number of worker threads. 0 (the default)
+	     *              disables the worker threads, so that all 
+	     *              variables are evaluated one after the other.
+	     *
+	     * \exception inval_param If count is negative.
+	     */
+	    void set_worker_threads(int count);
+
+	    /**
+	     * \brief Get the number of worker threads used to evaluate
+	     *        variables.
+	     *
+	     * \return The value set with set_worker_threads().
+	     *
+	     * \exception None.
+	     */
+	    int worker_threads() const
+	    {
+		return m_worker_threads;
+	    }
+
+	    /**
+	     * \brief Get the deadline overruns per variable.
+	     *
+	     * Each Get, GetNext and GetBulk request received from the master 
+	     * agent is stamped with a deadline, which is derived from the 
+	     * timeout of the registration serving the request (or, if not 
+	     * given, from the default timeout of the session). When the 
+	     * response is sent after that deadline, the master agent has 
+	     * probably already given up waiting. This is counted for each 
+	     * variable in the response which finished its evaluation after the 
+	     * deadline, so that slow variables can be identified. Variables 
+	     * which finished in time are not counted, even if the response was 
+	     * delayed by others.
+	     *
+	     * GetBulk requests stop adding repetitions when the deadline 
+	     * approaches, and the response then contains fewer repetitions than 
+	     * requested.
+	     *
+	     * \return The number of overruns, per OID of a variable.
+	     *         Variables which were never late are not contained.
+	     *
+	     * \exception None.
+	     */
+	    std::map<Oid, quint32> get_overruns() const;
+
+	    /**
+	     * \brief Get the number of responses sent after their deadline.
+	     *
+	     * See get_overruns() for details.
+	     *
+	     * \exception None.
+	     */
+	    quint32 get_late_responses() const;
+
+	    /**
+	     * \brief Reset the counters of get_overruns() and
+	     *        get_late_responses().
+	     *
+	     * \exception None.
+	     */
+	    void reset_overruns();
+
+	    /**
+	     * \brief Ping the master agent.
+	     *
+	     * Sends an agentx-Ping-PDU and waits for the response. The 
+	     * round-trip time is added to the histogram returned by 
+	     * get_ping_latency().
+	     *
+	     * \param timeout How long to wait for the response, in
+	     *                milliseconds.
+	     *
+	     * \return The round-trip time in microseconds.
+	     *
+	     * \exception timeout_error If the master agent did not answer in
+	     *                          time.
+	     *
+	     * \exception disconnected If the master agent does not know the
+	     *                         session.
+	     */
+	    qint64 ping(int timeout = 1000);
+
+	    /**
+	     * \brief Ping the master agent periodically.
+	     *
+	     * Every interval milliseconds, the master agent is pinged (see 
+	     * ping()). If it does not answer within timeout milliseconds, it is 
+	     * regarded as dead and the connection is closed. Thus, a dead 
+	     * master agent is detected after at most interval + timeout 
+	     * milliseconds. If automatic reconnection is enabled (see 
+	     * set_auto_reconnect()), the session is then re-established.
+	     *
+	     * If other MasterProxy objects share the connector, only this 
+	     * session is closed; the connection is closed together with the 
+	     * last session.
+	     *
+	     * The periodic pings do not block the thread of the MasterProxy: 
+	     * the response is processed when it arrives. The thread needs a 
+	     * running event loop.
+	     *
+	     * disconnect() stops the pings; they are resumed when the session 
+	     * is opened again. Pinging is disabled by default.
+	     *
+	     * \param interval The interval in milliseconds. 0 disables the
+	     *                 pings.
+	     *
+	     * \param timeout How long to wait for a response, in milliseconds.
+	     *
+	     * \exception inval_param If interval is negative or timeout is
+	     *                        less than 1.
+	     */
+	    void set_ping_interval(int interval, int timeout = 1000);
+
+	    /**
+	     * \brief Get the interval of the periodic pings.
+	     *
+	     * \return The interval in milliseconds, or 0 if disabled.
+	     *
+	     * \exception None.
+	     */
+	    int ping_interval() const
+	    {
+		return m_ping_interval;
+	    }
+
+	    /**
+	     * \brief Get the round-trip times of the pings.
+	     *
+	     * Contains the round-trip times of all successful pings, periodic 
+	     * or not, since the MasterProxy was created or 
+	     * reset_ping_latency() was called. It can be used to detect a slow 
+	     * master agent before the managers see timeouts.
+	     *
+	     * \return A copy of the histogram.
+	     *
+	     * \exception None.
+	     */
+	    LatencyHistogram get_ping_latency() const;
+
+	    /**
+	     * \brief Get the number of failed periodic pings.
+	     *
+	     * Each failure closed the session (and the connection, unless it 
+	     * was shared with other sessions).
+	     *
+	     * \exception None.
+	     */
+	    quint32 get_ping_failures() const;
+
+	    /**
+	     * \brief Reset the counters of get_ping_latency() and
+	     *        get_ping_failures().
+	     *
+	     * \exception None.
+	     */
+	    void reset_ping_latency();
+
+	    /**
+	     * \brief Let walks see a consistent set of variables.
+	     *
+	     * A walk (e.g. of a table) consists of many GetNext or GetBulk 
+	     * requests. Variables added or removed meanwhile (e.g. with 
+	     * Table::addEntry() or Table::removeEntry()) normally affect the 
+	     * rest of the walk, so that the manager may see rows skipped, 
+	     * duplicated, or from different instants.
+	     *
+	     * With this method enabled, each walk sees the set of variables 
+	     * which existed when its first request arrived. A request is 
+	     * regarded as the continuation of a walk if the starting OID of its 
+	     * last SearchRange is the name of the last varbind of a recent 
+	     * response (for GetBulk: of any of its repetitions). The set of 
+	     * variables is kept for at most lifetime milliseconds after the 
+	     * last response of the walk; a walk which pauses longer continues 
+	     * with the current set.
+	     *
+	     * The values are always current; only adding and removing 
+	     * variables is hidden from a walk. Updates are not delayed.
+	     *
+	     * Each set kept for a walk is a copy of the internal map of 
+	     * variables (see get_pinned_variables()). If more than 
+	     * max_variables variables are kept in total, the sets kept 
+	     * longest are released early.
+	     *
+	     * Disabled by default.
+	     *
+	     * \param lifetime How long to keep the set of variables of a walk
+	     *                 after its last response, in milliseconds. 0 
+	     *                 disables the feature.
+	     *
+	     * \param max_variables The maximum number of variables kept for
+	     *                      walks.
+	     *
+	     * \exception inval_param If lifetime is negative.
+	     */
+	    void set_walk_snapshots(int lifetime, size_t max_variables = 100000);
+
+	    /**
+	     * \brief Get the lifetime of the walk snapshots.
+	     *
+	     * \return The lifetime in milliseconds, or 0 if disabled.
+	     *
+	     * \exception None.
+	     */
+	    int walk_snapshot_lifetime() const
+	    {
+		return m_walk_lifetime;
+	    }
+
+	    /**
+	     * \brief Get the number of outdated variable sets kept for walks.
+	     *
+	     * \exception None.
+	     */
+	    size_t get_pinned_snapshots() const;
+
+	    /**
+	     * \brief Get the number of variables in the outdated sets kept for
+	     *        walks.
+	     *
+	     * This is the memory held by walks: each variable costs a map 
+	     * node with its OID, but the variable objects themselves are 
+	     * shared with the current set.
+	     *
+	     * \exception None.
+	     */
+	    size_t get_pinned_variables() const;
+
+	    /**
+	     * \brief Get the number of GetNext lookups served by the cursor
+	     *        cache.
+	     *
+	     * Walks usually continue at the variable returned last. The 
+	     * positions of the last few variables returned by GetNext and 
+	     * GetBulk requests are remembered, so that such a request finds 
+	     * the next variable without searching. This counts the lookups 
+	     * (one per SearchRange and repetition) which found their starting 
+	     * position in the cache.
+	     *
+	     * \exception None.
+	     */
+	    quint64 get_cursor_hits() const;
+
+	    /**
+	     * \brief Get the number of GetNext lookups not served by the
+	     *        cursor cache.
+	     *
+	     * Counts the lookups which had to search, except those whose 
+	     * starting OID is to be included in the search (these never 
+	     * continue a walk). See get_cursor_hits().
+	     *
+	     * \exception None.
+	     */
+	    quint64 get_cursor_misses() const;
+
+	    /**
+	     * \brief Limit the data buffered for sending.
+	     *
+	     * Responses and notifications are buffered until they are written 
+	     * to the master agent. If the master agent stalls, the buffer would 
+	     * grow without limit, e.g. when notifications are sent in bursts.  
+	     * Therefore the buffer is limited by a high-water mark. When the 
+	     * limit is reached, sending blocks until data was written or the 
+	     * timeout of the session expires; in the latter case, the %PDU is 
+	     * not sent and the operation fails with timeout_error.
+	     *
+	     * \param bytes The high-water mark in bytes. The default is
+	     *              256 KiB.
+	     *
+	     * \exception None.
+	     */
+	    void set_send_queue_limit(qint64 bytes)
+	    {
+		connection->set_high_water_mark(bytes);
+	    }
+
+	    /**
+	     * \brief Get the number of PDU's waiting to be sent.
+	     *
+	     * See set_send_queue_limit().
+	     *
+	     * \exception None.
+	     */
+	    size_t send_queue_depth()
+	    {
+		return connection->queue_depth();
+	    }
+
+	    /**
+	     * \brief Get the number of bytes not yet written to the master
+	     *        agent.
+	     *
+	     * See set_send_queue_limit().
+	     *
+	     * \exception None.
+	     */
+	    qint64 send_queue_bytes()
+	    {
+		return connection->bytes_buffered();
+	    }
     };
 }
 
@@ -24,13 +24,27 @@ using namespace agentxcpp;
 
 NotifyPDU::NotifyPDU(binary::const_iterator& pos,
 		     const binary::const_iterator& end,
-		     bool big_endian)
+		     bool big_endian,
+		     const QSharedPointer<const binary>& buf)
     : PDUwithContext(pos, end, big_endian)
 {
+    // Keep the VarBind's, so that their values can be decoded when needed.  
+    // A shared buffer is referenced, otherwise the VarBind's are copied.
+    QSharedPointer<const binary> payload = buf;
+    binary::const_iterator payload_pos = pos;
+    if( ! payload || end != payload->end() )
+    {
+	QSharedPointer<binary> copy(new binary);
+	copy->assign(pos, end);
+	payload = copy;
+	payload_pos = payload->begin();
+    }
+    pos = end;
+
     // Get VarBind's until the PDU is completely parsed
-    while( pos < end )
+    while( payload_pos < payload->end() )
     {
-	vb.push_back(Varbind(pos, end, big_endian));
+	vb.push_back(Varbind(payload_pos, payload, big_endian));
     }
 }
 	    
@@ -40,16 +54,17 @@ NotifyPDU::NotifyPDU(binary::const_iterator& pos,
 binary NotifyPDU::serialize() const
 {
     binary serialized;
+    begin_payload(serialized);
 
     // Add VarBind's
     vector<Varbind>::const_iterator i;
     for(i = vb.begin(); i < vb.end(); i++)
     {
-	serialized += i->serialize();
+	i->serialize_into(serialized);
     }
 
     // Add header
-    add_header(PDU::agentxNotifyPDU, serialized);
+    write_header(PDU::agentxNotifyPDU, serialized);
 
     // return serialized form of PDU
     return serialized;
@@ -60,13 +60,20 @@ namespace agentxcpp
 	     * \param big_endian Whether the serialized form of the %PDU is
 	     *                   in big_endian format.
 	     *
+	     * \param buf The buffer holding the stream, if it is shared and
+	     *            ends at end. The varbinds then keep a reference to 
+	     *            it for decoding their values later (see Varbind). 
+	     *            Otherwise, they keep a copy of the payload.
+	     *
 	     * \exception parse_error If parsing fails, for example because
 	     *			      reading the stream fails or the %PDU is 
 	     *			      malformed.
 	     */
 	    NotifyPDU(binary::const_iterator& pos,
 		      const binary::const_iterator& end,
-		      bool big_endian);
+		      bool big_endian,
+		      const QSharedPointer<const binary>& buf =
+		          QSharedPointer<const binary>());
 
 	    /**
 	     * \brief Default Constructor
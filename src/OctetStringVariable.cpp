@@ -75,7 +75,13 @@ QString OctetStringVariable::toString() const
 binary OctetStringVariable::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void OctetStringVariable::serialize_into(binary& serialized) const
+{
     // encode size (big endian)
     write32(serialized, v.size());
 
@@ -85,12 +91,7 @@ binary OctetStringVariable::serialize() const
     // Padding bytes
     int padsize = 4 - (v.size() % 4);
     if( padsize == 4 ) padsize = 0; // avoid adding 4 padding bytes
-    while( padsize-- )
-    {
-	serialized.push_back(0);
-    }
-
-    return serialized;
+    serialized.append(padsize, 0);
 }
 
 
@@ -162,3 +163,28 @@ Oid OctetStringVariable::toOid() const
     }
     return oid;
 }
+
+
+
+bool OctetStringVariable::skip(binary::const_iterator& pos,
+			       const binary::const_iterator& end,
+			       bool big_endian,
+			       quint32* size)
+{
+    if(end - pos < 4)
+    {
+	return false;
+    }
+    quint32 length = read32(pos, big_endian);
+    if(size)
+    {
+	*size = length;
+    }
+    quint64 padded = (quint64(length) + 3) & ~quint64(3);
+    if(quint64(end - pos) < padded)
+    {
+	return false;
+    }
+    pos += padded;
+    return true;
+}
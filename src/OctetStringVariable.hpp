@@ -40,6 +40,13 @@ namespace agentxcpp
              */
             binary serialize() const;
 
+            /**
+             * \internal
+             *
+             * \copydoc agentxcpp::AbstractVariable::serialize_into()
+             */
+            virtual void serialize_into(binary& serialized) const;
+
             /**
              * \brief (Default) constructor.
              *
@@ -65,6 +72,36 @@ namespace agentxcpp
                                 const binary::const_iterator& end,
                                 bool big_endian=true);
 
+            /**
+             * \internal
+             *
+             * \brief Skip the serialized form of an octet string.
+             *
+             * Checks the structure like the parse constructor does, but 
+             * without creating an object. This also works for Opaque and 
+             * IpAddress values, which are encoded the same way.
+             *
+             * \param pos Iterator pointing to the octet string. It is
+             *            advanced behind the string (including padding) on 
+             *            success, and undefined otherwise.
+             *
+             * \param end Iterator pointing one element past the end of the
+             *            buffer.
+             *
+             * \param big_endian Whether the input stream is in big endian
+             *                   format.
+             *
+             * \param size Receives the length of the string, if not NULL.
+             *
+             * \return false if the octet string is malformed.
+             *
+             * \exception None.
+             */
+            static bool skip(binary::const_iterator& pos,
+                             const binary::const_iterator& end,
+                             bool big_endian,
+                             quint32* size = 0);
+
             /**
              * \copydoc agentxcpp::IntegerVariable::setValue()
              */
@@ -65,6 +65,7 @@ void Oid::parseString(std::string s)
 
 
 Oid::Oid(std::string s)
+    : mInclude(false)
 {
     // parse the string. Forward all exceptions.
     parseString(s);
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include "OidFilter.hpp"
+
+using namespace agentxcpp;
+
+
+OidFilter::OidFilter(size_t capacity)
+: m_capacity(capacity)
+{
+    // About 8 counters per OID (rounded up to a power of two) give a false 
+    // positive rate of about 2% with 4 hashes.
+    size_t size = 64;
+    while(size < capacity * 8)
+    {
+        size *= 2;
+    }
+    m_counters.resize(size, 0);
+    m_mask = quint32(size - 1);
+}
+
+
+quint64 OidFilter::hash(const Oid& oid)
+{
+    quint64 h = Q_UINT64_C(0xcbf29ce484222325);
+    for(Oid::const_iterator i = oid.begin(); i != oid.end(); i++)
+    {
+        h = hash_step(h, *i);
+    }
+    return h;
+}
+
+
+bool OidFilter::may_contain_hash(quint64 h) const
+{
+    // Double hashing: the counters are h1, h1+h2, h1+2*h2, ...
+    quint32 h1 = quint32(h);
+    quint32 h2 = quint32(h >> 32) | 1;
+    for(int i = 0; i < hash_count; i++)
+    {
+        const quint8* counter = &m_counters[(h1 + i*h2) & m_mask];
+        if(__atomic_load_n(counter, __ATOMIC_RELAXED) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void OidFilter::update(const Oid& oid, int delta)
+{
+    quint64 h = hash(oid);
+    quint32 h1 = quint32(h);
+    quint32 h2 = quint32(h >> 32) | 1;
+    for(int i = 0; i < hash_count; i++)
+    {
+        quint8* counter = &m_counters[(h1 + i*h2) & m_mask];
+        quint8 value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+        if(value == 0xff)
+        {
+            // Saturated: the true count is unknown, keep it forever
+            continue;
+        }
+        __atomic_store_n(counter, quint8(value + delta), __ATOMIC_RELAXED);
+    }
+}
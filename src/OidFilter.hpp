@@ -0,0 +1,165 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _OIDFILTER_H_
+#define _OIDFILTER_H_
+
+#include <vector>
+
+#include <QtGlobal>
+
+#include "Oid.hpp"
+
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief A counting Bloom filter for OID's.
+     *
+     * The filter answers whether an OID may be contained in a set, without 
+     * storing the OID's. The answer "no" is always correct; the answer 
+     * "maybe" is wrong with a small probability (about 2% if no more OID's 
+     * than the capacity are inserted). Thus, the filter can reject unknown 
+     * OID's cheaply, before a map is searched.
+     *
+     * Each OID is mapped to a few counters, which are incremented on 
+     * insertion and decremented on removal. A counter which reaches its 
+     * maximum stays there (it is never decremented), so that no OID is 
+     * ever lost from the filter.
+     *
+     * Changes must be serialized by the caller, but may_contain() may be 
+     * called concurrently with them: the counters are accessed atomically.
+     */
+    class OidFilter
+    {
+	private:
+	    /**
+	     * \brief The number of counters per OID.
+	     */
+	    static const int hash_count = 4;
+
+	    /**
+	     * \brief The counters.
+	     *
+	     * The size is a power of two.
+	     */
+	    std::vector<quint8> m_counters;
+
+	    /**
+	     * \brief The size of m_counters minus one.
+	     */
+	    quint32 m_mask;
+
+	    /**
+	     * \brief The number of OID's the filter was sized for.
+	     */
+	    size_t m_capacity;
+
+	    /**
+	     * \brief Continue a hash with one more subidentifier.
+	     */
+	    static quint64 hash_step(quint64 hash, quint32 subid)
+	    {
+		// FNV-1a, one subidentifier at a time
+		return (hash ^ subid) * Q_UINT64_C(0x100000001b3);
+	    }
+
+	    /**
+	     * \brief Hash an OID.
+	     */
+	    static quint64 hash(const Oid& oid);
+
+	    /**
+	     * \brief Whether an OID with the given hash may be contained.
+	     */
+	    bool may_contain_hash(quint64 h) const;
+
+	    /**
+	     * \brief Change the counters of an OID.
+	     *
+	     * \param oid The OID.
+	     *
+	     * \param delta +1 or -1.
+	     */
+	    void update(const Oid& oid, int delta);
+
+	public:
+	    /**
+	     * \brief Create an empty filter.
+	     *
+	     * \param capacity The number of OID's the filter is sized for.
+	     *                 More OID's can be inserted, but the probability 
+	     *                 of wrong "maybe" answers grows.
+	     */
+	    OidFilter(size_t capacity);
+
+	    /**
+	     * \brief The number of OID's the filter was sized for.
+	     */
+	    size_t capacity() const
+	    {
+		return m_capacity;
+	    }
+
+	    /**
+	     * \brief Add an OID.
+	     *
+	     * An OID must not be inserted again before it was removed.
+	     */
+	    void insert(const Oid& oid)
+	    {
+		update(oid, +1);
+	    }
+
+	    /**
+	     * \brief Remove an OID.
+	     *
+	     * Only OID's which were inserted may be removed.
+	     */
+	    void remove(const Oid& oid)
+	    {
+		update(oid, -1);
+	    }
+
+	    /**
+	     * \brief Whether an OID may be contained.
+	     *
+	     * \return false if the OID is certainly not contained, true
+	     *         otherwise.
+	     */
+	    bool may_contain(const Oid& oid) const
+	    {
+		return may_contain_hash(hash(oid));
+	    }
+
+	    /**
+	     * \brief Whether an OID with an additional subidentifier may be
+	     *        contained.
+	     *
+	     * Same as may_contain(Oid(prefix, subid)), without creating the 
+	     * OID.
+	     */
+	    bool may_contain(const Oid& prefix, quint32 subid) const
+	    {
+		return may_contain_hash(hash_step(hash(prefix), subid));
+	    }
+    };
+}
+
+#endif  //_OIDFILTER_H_
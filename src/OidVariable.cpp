@@ -20,6 +20,7 @@
 #include <sstream>
 #include "OidVariable.hpp"
 #include "exceptions.hpp"
+#include "util.hpp"
 
 
 using namespace agentxcpp;
@@ -33,6 +34,14 @@ OidVariable::OidVariable(const Oid& o)
 
 
 binary OidVariable::serialize() const
+{
+    binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
+
+void OidVariable::serialize_into(binary& serialized) const
 {
     // The serial representation of an OID is as follows (RFC 2741, section 
     // 5.1):
@@ -46,25 +55,25 @@ binary OidVariable::serialize() const
     // |                       sub-identifier #n_subid                 |
     // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
     //
-    // We use a string here to represent the serial stream, and we use some 
-    // constants as indexes:
+    // We append to the serial stream, and we use some constants as indexes 
+    // (relative to the start of the OID):
     const int n_subid_idx = 0;
     const int prefix_idx = 1;
     const int include_idx = 2;
     const int reserved_idx = 3;
 
     // This is our binary data:
-    binary serialized;
-    serialized.resize(4);	// we will need at least the header
+    binary::size_type start = serialized.size();
+    serialized.resize(start + 4);	// we will need at least the header
 
     // Set reserved field to 0
-    serialized[reserved_idx] = 0;
+    serialized[start + reserved_idx] = 0;
 
     // Set include field
-    serialized[include_idx] = v.include() ? 1 : 0;
+    serialized[start + include_idx] = v.include() ? 1 : 0;
 
-    // Iterator for the subid's
-    Oid::const_iterator subid = v.begin();
+    // Index of the first subid to store
+    int first = 0;
 
     // Check whether we can use the prefix (RFC 2741, section 5.1)
     if( v.size() >= 5 &&
@@ -72,35 +81,27 @@ binary OidVariable::serialize() const
 	v[1] == 3 &&
 	v[2] == 6 &&
 	v[3] == 1 &&
+	v[4] != 0 &&	// prefix 0 means "no prefix"
 	v[4] <= 0xff)	// we have only one byte for the prefix!
     {
 	// store the first integer after 1.3.6.1 to prefix field
-	serialized[prefix_idx] = v[4];
-	subid += 5; // point to the subid behind prefix
+	serialized[start + prefix_idx] = v[4];
+	first = 5; // point to the subid behind prefix
 
 	// 5 elements are represented by prefix
-	serialized[n_subid_idx] = v.size() - 5;
+	serialized[start + n_subid_idx] = v.size() - 5;
     }
     else
     {
 	// don't use prefix field
-	serialized[prefix_idx] = 0;
+	serialized[start + prefix_idx] = 0;
 
 	// All subid's are stored in the stream explicitly
-	serialized[n_subid_idx] = v.size();
+	serialized[start + n_subid_idx] = v.size();
     }
 
     // copy subids to serialized
-    while( subid != v.end() )
-    {
-	serialized.push_back( (*subid) >> 24 & 0xff );
-	serialized.push_back( (*subid) >> 16 & 0xff );
-	serialized.push_back( (*subid) >> 8 & 0xff );
-	serialized.push_back( (*subid) >> 0 & 0xff );
-	subid++;
-    }
-
-    return serialized;
+    write32_array(serialized, v.constData() + first, v.size() - first);
 }
 
 OidVariable::OidVariable(binary::const_iterator& pos,
@@ -143,32 +144,40 @@ OidVariable::OidVariable(binary::const_iterator& pos,
     // skip reserved field
     *pos++;
 
-    // parse rest of data, subid by subid
+    // parse rest of data as one block
     if(end - pos < n_subid * 4)
     {
 	throw(parse_error());
     }
-    quint32 subid;
-    for( int i = 0; i < n_subid; i++)
-    {
-	if(big_endian)
-	{
-	    // big endian
-	    subid =  *pos++ << 24;
-	    subid |= *pos++ << 16;
-	    subid |= *pos++ << 8;
-	    subid |= *pos++ << 0;
-	}
-	else
-	{
-	    // little posdian
-	    subid =  *pos++ << 0;
-	    subid |= *pos++ << 8;
-	    subid |= *pos++ << 16;
-	    subid |= *pos++ << 24;
-	}
-	v.push_back(subid);
-    }
+    int offset = v.size();
+    v.resize(offset + n_subid);
+    read32_array(pos, v.data() + offset, n_subid, big_endian);
 }
 
 
+
+bool OidVariable::skip(binary::const_iterator& pos,
+		       const binary::const_iterator& end,
+		       quint8* include)
+{
+    if(end - pos < 4)
+    {
+	return false;
+    }
+    int n_subid = pos[0];
+    if(pos[2] > 1)
+    {
+	return false;
+    }
+    if(include)
+    {
+	*include = pos[2];
+    }
+    pos += 4;
+    if(end - pos < n_subid * 4)
+    {
+	return false;
+    }
+    pos += n_subid * 4;
+    return true;
+}
@@ -102,6 +102,13 @@ namespace agentxcpp
              */
             binary serialize() const;
 
+            /**
+             * \internal
+             *
+             * \copydoc agentxcpp::AbstractVariable::serialize_into()
+             */
+            virtual void serialize_into(binary& serialized) const;
+
             /**
              * \internal
              *
@@ -112,6 +119,30 @@ namespace agentxcpp
                         const binary::const_iterator& end,
                         bool big_endian=true);
 
+            /**
+             * \internal
+             *
+             * \brief Skip the serialized form of an OID.
+             *
+             * Checks the structure like the parse constructor does, but 
+             * without creating an object.
+             *
+             * \param pos Iterator pointing to the OID. It is advanced behind
+             *            the OID on success, and undefined otherwise.
+             *
+             * \param end Iterator pointing one element past the end of the
+             *            buffer.
+             *
+             * \param include Receives the include field, if not NULL.
+             *
+             * \return false if the OID is malformed.
+             *
+             * \exception None.
+             */
+            static bool skip(binary::const_iterator& pos,
+                             const binary::const_iterator& end,
+                             quint8* include = 0);
+
             /**
              * \brief Convert the value to an OID.
              *
@@ -24,7 +24,13 @@ using namespace agentxcpp;
 binary OpaqueVariable::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void OpaqueVariable::serialize_into(binary& serialized) const
+{
     // encode size (big endian)
     int size = v.size();
     serialized.push_back(size >> 24 & 0xff);
@@ -37,12 +43,8 @@ binary OpaqueVariable::serialize() const
 
     // Padding bytes
     int padsize = 4 - (size % 4);
-    while( padsize-- )
-    {
-	serialized.push_back(0);
-    }
-
-    return serialized;
+    if( padsize == 4 ) padsize = 0; // avoid adding 4 padding bytes
+    serialized.append(padsize, 0);
 }
 
 
@@ -57,6 +57,13 @@ namespace agentxcpp
              */
             binary serialize() const;
 
+            /**
+             * \internal
+             *
+             * \copydoc agentxcpp::AbstractVariable::serialize_into()
+             */
+            virtual void serialize_into(binary& serialized) const;
+
             /**
              * \internal
              *
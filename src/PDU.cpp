@@ -33,18 +33,22 @@
 #include "GetNextPDU.hpp"
 #include "GetBulkPDU.hpp"
 #include "NotifyPDU.hpp"
+#include "PingPDU.hpp"
+#include "OidVariable.hpp"
+#include "OctetStringVariable.hpp"
+#include "Varbind.hpp"
 #include "util.hpp"
 
 using namespace agentxcpp;
 
 
-quint32 PDU::packetID_cnt = 0;
+QAtomicInt PDU::packetID_cnt(0);
 
 
 
 PDU::PDU()
 {
-    packetID = ++packetID_cnt;
+    packetID = quint32(packetID_cnt.fetchAndAddOrdered(1)) + 1;
 
     sessionID = 0;
     transactionID = 0;
@@ -60,6 +64,9 @@ PDU::PDU(binary::const_iterator& pos,
 	 const binary::const_iterator& end,
 	 bool big_endian)
 {
+    // Remember the time of arrival
+    received.start();
+
     if(end - pos < 20)
     {
 	throw(parse_error());
@@ -95,11 +102,25 @@ PDU::PDU(binary::const_iterator& pos,
 
 
 
-QSharedPointer<PDU> PDU::parse_pdu(binary buf)
+QSharedPointer<PDU> PDU::parse_pdu(const binary& buf)
+{
+    return create_pdu(buf, QSharedPointer<const binary>());
+}
+
+
+
+QSharedPointer<PDU> PDU::create_pdu(const binary& buf,
+				    const QSharedPointer<const binary>& shared)
 {
     // needed for parsing
     binary::const_iterator pos;
 
+    // the header must be complete
+    if( buf.size() < 20 )
+    {
+	throw( parse_error() );
+    }
+
     // check protocol version
     quint8 version = buf[0];
     if( version != 1 )
@@ -156,7 +177,8 @@ QSharedPointer<PDU> PDU::parse_pdu(binary buf)
 	    pdu = QSharedPointer<PDU>(new UndoSetPDU(pos, end, big_endian));
 	    break;
 	case agentxTestSetPDU:
-	    pdu = QSharedPointer<PDU>(new TestSetPDU(pos, end, big_endian));
+	    pdu = QSharedPointer<PDU>(new TestSetPDU(pos, end, big_endian,
+						     shared));
 	    break;
 	case agentxCleanupSetPDU:
 	    pdu = QSharedPointer<PDU>(new CleanupSetPDU(pos, end, big_endian));
@@ -171,7 +193,11 @@ QSharedPointer<PDU> PDU::parse_pdu(binary buf)
 	    pdu = QSharedPointer<PDU>(new GetBulkPDU(pos, end, big_endian));
 	    break;
 	case agentxNotifyPDU:
-	    pdu = QSharedPointer<PDU>(new NotifyPDU(pos, end, big_endian));
+	    pdu = QSharedPointer<PDU>(new NotifyPDU(pos, end, big_endian,
+						    shared));
+	    break;
+	case agentxPingPDU:
+	    pdu = QSharedPointer<PDU>(new PingPDU(pos, end, big_endian));
 	    break;
 	default:
 	    // type is invalid
@@ -184,16 +210,206 @@ QSharedPointer<PDU> PDU::parse_pdu(binary buf)
 
 
 
+QSharedPointer<PDU> PDU::parse_pdu(const binary& buf, int& error)
+{
+    error = scan_pdu(buf);
+    if( error != 0 )
+    {
+	return QSharedPointer<PDU>();
+    }
+
+    try
+    {
+	return parse_pdu(buf);
+    }
+    catch(...)
+    {
+	// Only for types not checked by scan_pdu()
+	error = -1;
+	return QSharedPointer<PDU>();
+    }
+}
+
+
+
+QSharedPointer<PDU> PDU::parse_pdu(const QSharedPointer<const binary>& buf,
+				   int& error)
+{
+    error = scan_pdu(*buf);
+    if( error != 0 )
+    {
+	return QSharedPointer<PDU>();
+    }
+
+    try
+    {
+	return create_pdu(*buf, buf);
+    }
+    catch(...)
+    {
+	// Only for types not checked by scan_pdu()
+	error = -1;
+	return QSharedPointer<PDU>();
+    }
+}
+
+
+
+namespace
+{
+    /**
+     * \internal
+     *
+     * \brief Skip a SearchRange list (see GetPDU and GetNextPDU).
+     *
+     * \return false if the list is malformed.
+     */
+    bool scan_searchranges(binary::const_iterator& pos,
+			   const binary::const_iterator& end)
+    {
+	while( pos < end )
+	{
+	    quint8 include;
+	    if( ! OidVariable::skip(pos, end)
+		|| ! OidVariable::skip(pos, end, &include)
+		|| include != 0 )
+	    {
+		return false;
+	    }
+	}
+	return true;
+    }
+}
+
+
+
+int PDU::scan_pdu(const binary& buf)
+{
+    // Header
+    if( buf.size() < 20 )
+    {
+	return -1;
+    }
+    if( buf[0] != 1 )
+    {
+	return -2;
+    }
+    quint8 type = buf[1];
+    bool big_endian = ( buf[2] & (1<<4) ) ? true : false;
+    bool context = ( buf[2] & (1<<3) ) ? true : false;
+    binary::const_iterator pos = buf.begin() + 16;
+    if( read32(pos, big_endian) % 4 != 0 )
+    {
+	return -1;
+    }
+    const binary::const_iterator end = buf.end();
+
+    // Context (PDU's derived from PDUwithContext)
+    switch(type)
+    {
+	case agentxGetPDU:
+	case agentxGetNextPDU:
+	case agentxGetBulkPDU:
+	case agentxTestSetPDU:
+	case agentxCommitSetPDU:
+	case agentxUndoSetPDU:
+	case agentxCleanupSetPDU:
+	case agentxPingPDU:
+	    if( context && ! OctetStringVariable::skip(pos, end, big_endian) )
+	    {
+		return -1;
+	    }
+	    break;
+	default:
+	    break;
+    }
+
+    // Payload
+    bool ok = true;
+    switch(type)
+    {
+	case agentxGetPDU:
+	case agentxGetNextPDU:
+	    ok = scan_searchranges(pos, end);
+	    break;
+	case agentxGetBulkPDU:
+	    // non_repeaters and max_repetitions
+	    ok = (end - pos >= 4);
+	    if(ok)
+	    {
+		pos += 4;
+		ok = scan_searchranges(pos, end);
+	    }
+	    break;
+	case agentxTestSetPDU:
+	    while( ok && pos < end )
+	    {
+		ok = Varbind::skip(pos, end, big_endian);
+	    }
+	    break;
+	case agentxResponsePDU:
+	    ok = (end - pos >= 8);
+	    if(ok)
+	    {
+		// sysUpTime, error, index
+		pos += 4;
+		quint16 error = read16(pos, big_endian);
+		pos += 2;
+		ok = (error <= ResponsePDU::inconsistentName)
+		     || (error >= ResponsePDU::openFailed
+			 && error <= ResponsePDU::processingError);
+	    }
+	    while( ok && pos < end )
+	    {
+		ok = Varbind::skip(pos, end, big_endian);
+	    }
+	    break;
+	case agentxClosePDU:
+	    ok = (end - pos >= 4) && pos[0] >= 1 && pos[0] <= 6;
+	    break;
+	case agentxCommitSetPDU:
+	case agentxUndoSetPDU:
+	case agentxCleanupSetPDU:
+	case agentxPingPDU:
+	    // No payload
+	    break;
+	case agentxOpenPDU:
+	case agentxRegisterPDU:
+	case agentxUnregisterPDU:
+	case agentxNotifyPDU:
+	    // Not checked; left to parse_pdu()
+	    break;
+	default:
+	    // parse_pdu() does not know the type
+	    ok = false;
+	    break;
+    }
+
+    return ok ? 0 : -1;
+}
+
+
+
 void PDU::add_header(type_t type, binary& payload) const
+{
+    // Make room for the header
+    payload.insert(0, 20, 0);
+
+    write_header(type, payload);
+}
+
+
+
+void PDU::write_header(type_t type, binary& serialized) const
 {
     /* Construct header */
-    binary header;
+    binary::iterator header = serialized.begin();
 
     // Protocol version
-    header.push_back(1);
+    *header++ = 1;
 
     // Type
-    header.push_back(type);
+    *header++ = type;
 
     // flags
     quint8 flags = 0;
@@ -202,17 +418,14 @@ void PDU::add_header(type_t type, binary& payload) const
     if(any_index)             flags |= (1<<2);
     if(non_default_context)   flags |= (1<<3);
 		              flags |= (1<<4);	// We always use big endian
-    header.push_back(flags);
+    *header++ = flags;
 
     // reserved field
-    header.push_back(0);
+    *header++ = 0;
 
     // remaining fields
-    write32(header, sessionID);
-    write32(header, transactionID);
-    write32(header, packetID);
-    write32(header, payload.size());	// payload length
-
-    // Add header to payload
-    payload.insert(0, header);
+    qToBigEndian<quint32>(sessionID, &*header);
+    qToBigEndian<quint32>(transactionID, &*header + 4);
+    qToBigEndian<quint32>(packetID, &*header + 8);
+    qToBigEndian<quint32>(serialized.size() - 20, &*header + 12); // payload length
 }
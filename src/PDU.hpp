@@ -25,6 +25,8 @@
 #include <QSharedPointer>
 
 #include <QtGlobal>
+#include <QElapsedTimer>
+#include <QAtomicInt>
 
 #include "exceptions.hpp"
 #include "binary.hpp"
@@ -49,7 +51,9 @@ namespace agentxcpp
      * - The ResponsePDU class overwrites the packetID
      *
      * The mechanism uses a static class member packetID_cnt to store the last 
-     * used packetID. The counter wraps at its limit.
+     * used packetID. The counter wraps at its limit. It is atomic, because 
+     * %PDU's are created in several threads, e.g. by sessions sharing a 
+     * Connector, whose responses are matched by packetID.
      */
     class PDU
     {
@@ -79,6 +83,14 @@ namespace agentxcpp
 	     */
 	    quint32 transactionID;
 
+	    /**
+	     * \brief When the %PDU was received
+	     *
+	     * Started by the parse constructor. Invalid for %PDU's which were 
+	     * not received.
+	     */
+	    QElapsedTimer received;
+
 	    /**
 	     * \brief Counter for automatic packetID generator
 	     *
@@ -89,7 +101,24 @@ namespace agentxcpp
 	     * The parse constructor does not use this member, because it reads 
 	     * the packetID from a stream.
 	     */
-	    static quint32 packetID_cnt;
+	    static QAtomicInt packetID_cnt;
+
+	    /**
+	     * \brief Parse a %PDU from a buffer, possibly shared.
+	     *
+	     * Implements parse_pdu(const binary&) and 
+	     * parse_pdu(const QSharedPointer<const binary>&, int&).
+	     *
+	     * \param buf The buffer containing exactly one PDU in serialized
+	     *            form.
+	     *
+	     * \param shared A shared pointer to buf, or a NULL pointer if buf
+	     *               is not shared. Passed to the parse constructors 
+	     *               of TestSetPDU and NotifyPDU.
+	     */
+	    static QSharedPointer<PDU> create_pdu(
+				const binary& buf,
+				const QSharedPointer<const binary>& shared);
 
 
 	protected:
@@ -202,6 +231,40 @@ namespace agentxcpp
 	     */
 	    void add_header(type_t type, binary& payload) const;
 
+	    /**
+	     * \brief Start serialization with room for the PDU header
+	     *
+	     * Replaces the contents of serialized with a placeholder for the 
+	     * header. The derived class then appends its payload and calls 
+	     * write_header() to fill in the header. Unlike add_header(), this 
+	     * does not move the payload, and the whole %PDU is encoded into a 
+	     * single string.
+	     *
+	     * \param serialized The buffer for the serialized %PDU.
+	     */
+	    void begin_payload(binary& serialized) const
+	    {
+		serialized.assign(20, 0);
+	    }
+
+	    /**
+	     * \brief Fill in the PDU header
+	     *
+	     * Writes the header into the placeholder created by 
+	     * begin_payload(). Everything behind the placeholder is the 
+	     * payload.
+	     *
+	     * \warning The payload must not grow or shrink after a call to
+	     *          this function as its size is encoded into the header.
+	     *
+	     * \param type The PDU type, according to RFC 2741, 6.1. "AgentX
+	     *             PDU Header".
+	     *
+	     * \param serialized The buffer which was prepared by
+	     *                   begin_payload().
+	     */
+	    void write_header(type_t type, binary& serialized) const;
+
 	    /**
 	     * \brief Default constructor
 	     *
@@ -266,6 +329,17 @@ namespace agentxcpp
 	     * \brief Get packetID
 	     */
 	    quint32 get_packetID() { return packetID; }
+
+	    /**
+	     * \brief Get the time since the %PDU was received
+	     *
+	     * \return The time in milliseconds since the %PDU was parsed, or 0
+	     *         if it was not received (i.e. created locally).
+	     */
+	    qint64 get_age() const
+	    {
+		return received.isValid() ? received.elapsed() : 0;
+	    }
  
 	    /**
 	     * \brief Set packetID
@@ -287,7 +361,71 @@ namespace agentxcpp
 	     * \exception version_mismatch If the AgentX version of the %PDU
 	     *                             is not 1.
 	     */
-	    static QSharedPointer<PDU> parse_pdu(binary buf);
+	    static QSharedPointer<PDU> parse_pdu(const binary& buf);
+
+	    /**
+	     * \brief Parse a %PDU from a buffer without throwing.
+	     *
+	     * Like parse_pdu(const binary&), but errors are reported with a 
+	     * return code. The buffer is checked with scan_pdu() before it is 
+	     * parsed, so that malformed input is rejected without throwing and 
+	     * catching an exception. This is the variant used by the 
+	     * connectors.
+	     *
+	     * \param buf The buffer containing exactly one PDU in serialized
+	     *            form.
+	     *
+	     * \param error Set to 0 on success, -1 if the %PDU is malformed
+	     *              or -2 if its AgentX version is not 1.
+	     *
+	     * \return The %PDU, or a NULL pointer on error.
+	     *
+	     * \exception None.
+	     */
+	    static QSharedPointer<PDU> parse_pdu(const binary& buf, int& error);
+
+	    /**
+	     * \brief Parse a %PDU from a shared buffer without throwing.
+	     *
+	     * Like parse_pdu(const binary&, int&), but the varbinds of 
+	     * TestSet and Notify PDU's keep a reference to buf for decoding 
+	     * their values later (see Varbind), instead of copying the 
+	     * payload. The connectors use this variant for the buffers they 
+	     * received.
+	     *
+	     * \param buf The buffer containing exactly one PDU in serialized
+	     *            form. It must not be modified afterwards.
+	     *
+	     * \param error Set to 0 on success, -1 if the %PDU is malformed
+	     *              or -2 if its AgentX version is not 1.
+	     *
+	     * \return The %PDU, or a NULL pointer on error.
+	     *
+	     * \exception None.
+	     */
+	    static QSharedPointer<PDU> parse_pdu(
+				const QSharedPointer<const binary>& buf,
+				int& error);
+
+	    /**
+	     * \brief Check whether a buffer contains a well-formed %PDU.
+	     *
+	     * Walks the structure of the %PDU without creating any objects.  
+	     * The %PDU types received by a subagent (Get, GetNext, GetBulk, 
+	     * TestSet, CommitSet, UndoSet, CleanupSet, Close, Ping and 
+	     * Response) are checked completely: if the function succeeds, 
+	     * parse_pdu() succeeds, too. The other types are only checked 
+	     * for a valid header.
+	     *
+	     * \param buf The buffer containing exactly one PDU in serialized
+	     *            form.
+	     *
+	     * \return 0 if the %PDU is well-formed, -1 if it is malformed or
+	     *         -2 if its AgentX version is not 1.
+	     *
+	     * \exception None.
+	     */
+	    static int scan_pdu(const binary& buf);
 
 	    /**
 	     * \brief Serialize function for concrete PDUs.
@@ -117,6 +117,24 @@ namespace agentxcpp
 		PDU::add_header(type, payload);
 	    }
 
+	    /**
+	     * \brief Start serialization with room for header and context
+	     *
+	     * Like PDU::begin_payload(), but also appends the context, if 
+	     * present. The derived class then appends its payload and calls 
+	     * write_header().
+	     *
+	     * \param serialized The buffer for the serialized %PDU.
+	     */
+	    void begin_payload(binary& serialized) const
+	    {
+		PDU::begin_payload(serialized);
+		if( non_default_context )
+		{
+		    context.serialize_into(serialized);
+		}
+	    }
+
 	    /**
 	     * \brief Default Constructor
 	     *
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <map>
+
+#include <QMutexLocker>
+
+#include "PendingResponse.hpp"
+#include "MasterProxy.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+PendingResponse::PendingResponse(MasterProxy* owner,
+                                 QSharedPointer<ResponsePDU> _response,
+                                 qint64 deadline)
+    : m_owner(owner),
+      m_outstanding(1),
+      m_round(0),
+      m_deadline(deadline),
+      response(_response)
+{
+    m_created.start();
+}
+
+
+void PendingResponse::prepare()
+{
+    // Collect the distinct variables. A variable may appear several times in 
+    // a response (e.g. GetBulk at the end of the MIB view), but is evaluated 
+    // only once.
+    //
+    // The variables are numbered in the order of their first appearance, 
+    // therefore the variables first appearing in a round are numbered 
+    // consecutively.
+    if(rounds.empty())
+    {
+        rounds.push_back(varbinds.size());
+    }
+    map< AbstractVariable*, size_t > seen;
+    positions.assign(varbinds.size(), 0);
+    m_round_variables.clear();
+    size_t round = 0;
+    for(size_t i = 0; i < varbinds.size(); i++)
+    {
+        while(i >= rounds[round])
+        {
+            m_round_variables.push_back(variables.size());
+            round++;
+        }
+
+        AbstractVariable* var = varbinds[i].var.data();
+        if( ! var )
+        {
+            continue;
+        }
+
+        map< AbstractVariable*, size_t >::const_iterator s = seen.find(var);
+        if(s == seen.end())
+        {
+            seen[var] = variables.size();
+            positions[i] = variables.size();
+            variables.push_back(varbinds[i].var);
+        }
+        else
+        {
+            positions[i] = s->second;
+        }
+    }
+
+    while(m_round_variables.size() < rounds.size())
+    {
+        m_round_variables.push_back(variables.size());
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_failed.assign(variables.size(), 0);
+    m_finished.assign(variables.size(), 0);
+    m_round = 0;
+    m_evaluation.start();
+}
+
+
+bool PendingResponse::begin_round(size_t& first, size_t& last)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(m_round >= m_round_variables.size())
+    {
+        return false;
+    }
+
+    first = (m_round == 0) ? 0 : m_round_variables[m_round - 1];
+    last = m_round_variables[m_round];
+    m_outstanding = last - first + 1;
+    m_round++;
+
+    return true;
+}
+
+
+size_t PendingResponse::rounds_started()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_round;
+}
+
+
+bool PendingResponse::more_rounds()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_round < m_round_variables.size();
+}
+
+
+void PendingResponse::truncate()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(m_round == 0 || m_round >= m_round_variables.size())
+    {
+        // Nothing started yet, or nothing left to drop
+        return;
+    }
+
+    size_t end = rounds[m_round - 1];
+    varbinds.erase(varbinds.begin() + end, varbinds.end());
+    positions.resize(end);
+    rounds.resize(m_round);
+    m_round_variables.resize(m_round);
+}
+
+
+qint64 PendingResponse::evaluation_time() const
+{
+    return m_evaluation.elapsed();
+}
+
+
+qint64 PendingResponse::remaining() const
+{
+    return m_deadline - m_created.elapsed();
+}
+
+
+void PendingResponse::finish(size_t variable, bool success)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if( ! success )
+    {
+        m_failed[variable] = 1;
+    }
+    m_finished[variable] = m_created.elapsed();
+
+    if(--m_outstanding == 0 && m_owner)
+    {
+        // We were the last one. launched() was already called, because it 
+        // holds a count itself.
+        m_owner->response_ready(this);
+    }
+}
+
+
+bool PendingResponse::launched()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return --m_outstanding == 0;
+}
+
+
+bool PendingResponse::failed(size_t variable)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_failed[variable] ? true : false;
+}
+
+
+bool PendingResponse::overran(size_t variable)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_finished[variable] > m_deadline;
+}
+
+
+void PendingResponse::detach()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_owner = 0;
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _PENDINGRESPONSE_H_
+#define _PENDINGRESPONSE_H_
+
+#include <vector>
+
+#include <QSharedPointer>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include "Oid.hpp"
+#include "AbstractVariable.hpp"
+#include "Varbind.hpp"
+#include "ResponsePDU.hpp"
+
+namespace agentxcpp
+{
+    class MasterProxy;
+
+    /**
+     * \internal
+     *
+     * \brief A varbind of a response which is being built.
+     *
+     * While processing a Get, GetNext or GetBulk request, the varbinds of 
+     * the response are first collected as pending_varbind objects, so that 
+     * the variables can be evaluated before the response is assembled.
+     */
+    struct pending_varbind
+    {
+        /**
+         * \brief The name of the varbind.
+         */
+        Oid name;
+
+        /**
+         * \brief The variable which provides the value.
+         *
+         * A NULL pointer if the varbind carries no value (e.g.  
+         * noSuchObject). The type is given by 'type' in that case.
+         */
+        QSharedPointer<AbstractVariable> var;
+
+        /**
+         * \brief The type of the varbind if var is NULL.
+         */
+        Varbind::type_t type;
+
+        /**
+         * \brief The serialized form of name, or NULL if not known.
+         */
+        QSharedPointer<const binary> encoded_name;
+
+        /**
+         * \brief Create a varbind which is served by a variable.
+         */
+        pending_varbind(const Oid& _name,
+                        QSharedPointer<AbstractVariable> _var)
+            : name(_name), var(_var), type(Varbind::Null)
+        {
+        }
+
+        /**
+         * \brief Create a varbind which is served by a variable, with a
+         *        serialized form of the name.
+         */
+        pending_varbind(const Oid& _name,
+                        QSharedPointer<AbstractVariable> _var,
+                        const QSharedPointer<const binary>& _encoded_name)
+            : name(_name), var(_var), type(Varbind::Null),
+              encoded_name(_encoded_name)
+        {
+        }
+
+        /**
+         * \brief Create a varbind without value.
+         */
+        pending_varbind(const Oid& _name, Varbind::type_t _type)
+            : name(_name), type(_type)
+        {
+        }
+    };
+
+    /**
+     * \internal
+     *
+     * \brief A response which waits for its variables to be evaluated.
+     *
+     * When a Get, GetNext or GetBulk request is processed, the MasterProxy 
+     * creates a PendingResponse which holds the ResponsePDU and the list of 
+     * its varbinds. Then each distinct variable is evaluated by calling its 
+     * AbstractVariable::handle_get_async() method with a GetCompletion 
+     * object. The variables report their result via GetCompletion::finish(), 
+     * which calls finish() of this class.
+     *
+     * The object counts the outstanding variables. The counter starts with 
+     * the number of variables plus one; the additional count is held by the 
+     * MasterProxy while it starts the evaluation and is given back with 
+     * launched(). If launched() returns true, all variables finished 
+     * synchronously and the MasterProxy sends the response right away. 
+     * Otherwise, the variable which finishes last informs the MasterProxy 
+     * (see MasterProxy::response_ready()), which then sends the response 
+     * from its own thread.
+     *
+     * The variables may be evaluated in several rounds (see rounds). A 
+     * GetBulk response uses one round per repetition, so that the 
+     * MasterProxy can stop evaluating further repetitions when the deadline 
+     * of the response approaches (see truncate()). The counter described 
+     * above then applies to each round.
+     *
+     * The private members are protected by m_mutex. The public members are 
+     * not modified after prepare() was called, except by truncate().
+     */
+    class PendingResponse
+    {
+        private:
+
+            /**
+             * \brief Protects the private members.
+             */
+            QMutex m_mutex;
+
+            /**
+             * \brief The MasterProxy to inform when all variables
+             *        finished.
+             *
+             * Set to NULL by detach().
+             */
+            MasterProxy* m_owner;
+
+            /**
+             * \brief The number of outstanding variables, plus one until
+             *        launched() is called.
+             */
+            size_t m_outstanding;
+
+            /**
+             * \brief Whether a variable failed.
+             *
+             * Indexed like the variables member. We use char instead of 
+             * bool, because the elements of vector<bool> cannot be accessed 
+             * independently.
+             */
+            std::vector<char> m_failed;
+
+            /**
+             * \brief When each variable finished, in milliseconds after
+             *        m_created.
+             *
+             * Indexed like the variables member.
+             */
+            std::vector<qint64> m_finished;
+
+            /**
+             * \brief The number of rounds started so far.
+             */
+            size_t m_round;
+
+            /**
+             * \brief The end of each round within variables.
+             *
+             * Filled by prepare().
+             */
+            std::vector<size_t> m_round_variables;
+
+            /**
+             * \brief Started on construction.
+             */
+            QElapsedTimer m_created;
+
+            /**
+             * \brief Started by prepare().
+             */
+            QElapsedTimer m_evaluation;
+
+            /**
+             * \brief The deadline, in milliseconds after m_created.
+             */
+            qint64 m_deadline;
+
+        public:
+
+            /**
+             * \brief The response to be sent.
+             */
+            QSharedPointer<ResponsePDU> response;
+
+            /**
+             * \brief The varbinds of the response, in request order.
+             */
+            std::vector<pending_varbind> varbinds;
+
+            /**
+             * \brief The distinct variables referenced by varbinds.
+             *
+             * Filled by prepare().
+             */
+            std::vector< QSharedPointer<AbstractVariable> > variables;
+
+            /**
+             * \brief The number of the variable of each varbind.
+             *
+             * Indexed like varbinds, the values are indexes into variables.  
+             * The value for varbinds without variable is undefined. Filled by 
+             * prepare().
+             */
+            std::vector<size_t> positions;
+
+            /**
+             * \brief The evaluation rounds.
+             *
+             * Each element is the end index (within varbinds) of a round; 
+             * the last element must be varbinds.size(). The variables of a 
+             * round are evaluated only after the previous round finished. If 
+             * empty, all varbinds form a single round.
+             */
+            std::vector<size_t> rounds;
+
+            /**
+             * \brief Constructor.
+             *
+             * \param owner The MasterProxy processing the request.
+             *
+             * \param response The pre-initialized ResponsePDU.
+             *
+             * \param deadline The time, in milliseconds from now, until
+             *                 which the response should be sent.
+             */
+            PendingResponse(MasterProxy* owner,
+                            QSharedPointer<ResponsePDU> response,
+                            qint64 deadline);
+
+            /**
+             * \brief Prepare the evaluation.
+             *
+             * Collects the distinct variables of the varbinds member. Must 
+             * be called after varbinds and rounds were filled and before the 
+             * evaluation starts.
+             */
+            void prepare();
+
+            /**
+             * \brief Start the next round.
+             *
+             * Initializes the counter of outstanding variables with the 
+             * number of variables of the round plus one.
+             *
+             * \param first Set to the number of the first variable of the
+             *              round (see variables).
+             *
+             * \param last Set to the number behind the last variable of the
+             *             round.
+             *
+             * \return False if all rounds were already started.
+             */
+            bool begin_round(size_t& first, size_t& last);
+
+            /**
+             * \brief Get the number of rounds started so far.
+             */
+            size_t rounds_started();
+
+            /**
+             * \brief Find out whether not all rounds were started yet.
+             */
+            bool more_rounds();
+
+            /**
+             * \brief Drop the rounds which were not started yet.
+             *
+             * The varbinds of these rounds are removed from the response.  
+             * This is allowed for the repetitions of a GetBulk response 
+             * (RFC 2741, 7.2.3.3).
+             */
+            void truncate();
+
+            /**
+             * \brief Get the time spent since prepare() was called.
+             *
+             * \return The time in milliseconds.
+             */
+            qint64 evaluation_time() const;
+
+            /**
+             * \brief Get the time left until the deadline.
+             *
+             * \return The time in milliseconds. Negative if the deadline
+             *         has passed.
+             */
+            qint64 remaining() const;
+
+            /**
+             * \brief Report the result of a variable.
+             *
+             * Called by GetCompletion::finish(). If this is the last 
+             * outstanding variable, the owner is informed.
+             *
+             * \param variable The number of the variable (see variables).
+             *
+             * \param success Whether the Get operation succeeded.
+             */
+            void finish(size_t variable, bool success);
+
+            /**
+             * \brief Give back the count held during the start of the
+             *        evaluation.
+             *
+             * \return True if all variables already finished. The owner is
+             *         not informed in this case.
+             */
+            bool launched();
+
+            /**
+             * \brief Find out whether a variable failed.
+             *
+             * Only meaningful after all variables finished.
+             *
+             * \param variable The number of the variable (see variables).
+             */
+            bool failed(size_t variable);
+
+            /**
+             * \brief Find out whether a variable finished after the
+             *        deadline.
+             *
+             * Only meaningful after all variables finished.
+             *
+             * \param variable The number of the variable (see variables).
+             */
+            bool overran(size_t variable);
+
+            /**
+             * \brief Forget the owner.
+             *
+             * Called by the owner when it is destroyed. Results reported 
+             * afterwards are discarded.
+             */
+            void detach();
+    };
+}
+
+#endif // _PENDINGRESPONSE_H_
@@ -66,7 +66,7 @@ namespace agentxcpp
 	    /**
 	     * \brief Serialize the %PDU
 	     */
-	    binary serialize();
+	    binary serialize() const;
     };
 }
 
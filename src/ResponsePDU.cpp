@@ -15,6 +15,28 @@ ResponsePDU::ResponsePDU()
 
 
 
+void ResponsePDU::recycle()
+{
+    this->set_sessionID(0);
+    this->set_transactionID(0);
+    this->error = noAgentXError;
+    this->index = 0;
+    this->sysUpTime = 0;
+
+    // Keep the capacity of ordinary responses, but don't hold on to the 
+    // memory of a huge GetBulk response
+    if( varbindlist.capacity() > 1024 )
+    {
+	vector<Varbind>().swap(varbindlist);
+    }
+    else
+    {
+	varbindlist.clear();
+    }
+}
+
+
+
 ResponsePDU::ResponsePDU(binary::const_iterator& pos,
 			 const binary::const_iterator& end,
 			 bool big_endian)
@@ -85,6 +107,7 @@ ResponsePDU::ResponsePDU(binary::const_iterator& pos,
 binary ResponsePDU::serialize() const
 {
     binary serialized;
+    begin_payload(serialized);
 
     // Encode simple fields
     write32(serialized, this->sysUpTime);
@@ -95,11 +118,11 @@ binary ResponsePDU::serialize() const
     vector<Varbind>::const_iterator i;
     for(i = this->varbindlist.begin(); i != this->varbindlist.end(); i++)
     {
-	serialized += i->serialize();
+	i->serialize_into(serialized);
     }
 
     // Add Header
-    add_header(PDU::agentxResponsePDU, serialized);
+    write_header(PDU::agentxResponsePDU, serialized);
 
     return serialized;
 }
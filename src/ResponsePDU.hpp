@@ -157,6 +157,19 @@ namespace agentxcpp
 	     */
 	    ResponsePDU();
 
+	    /**
+	     * \brief Reset the object for reuse.
+	     *
+	     * Restores the state set by the default constructor, except for 
+	     * the packetID, which is left unchanged. The varbindlist is 
+	     * emptied but keeps its capacity (unless it is very large), so 
+	     * that the object can be filled again without allocating. Used by 
+	     * ResponsePDUPool.
+	     *
+	     * \exception None.
+	     */
+	    void recycle();
+
 	    /**
 	     * \brief Set the error status.
 	     *
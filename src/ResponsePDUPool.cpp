@@ -0,0 +1,130 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include "ResponsePDUPool.hpp"
+
+using namespace agentxcpp;
+
+
+
+ResponsePDUPool::state::~state()
+{
+    for(size_t i = 0; i < idle.size(); i++)
+    {
+	delete idle[i];
+    }
+}
+
+
+
+void ResponsePDUPool::recycler::operator()(ResponsePDU* pdu) const
+{
+    pdu->recycle();
+
+    QMutexLocker locker(&pool->mutex);
+    if(pool->idle.size() < pool->max_size)
+    {
+	pool->idle.push_back(pdu);
+	return;
+    }
+    locker.unlock();
+
+    delete pdu;
+}
+
+
+
+ResponsePDUPool::ResponsePDUPool(size_t max_size)
+    : m_state(new state)
+{
+    m_state->max_size = max_size;
+    m_state->reused = 0;
+    m_state->allocated = 0;
+    m_state->idle.reserve(max_size);
+}
+
+
+
+ResponsePDUPool::~ResponsePDUPool()
+{
+    // Objects still in use are deleted when released
+    std::vector<ResponsePDU*> idle;
+    m_state->mutex.lock();
+    m_state->max_size = 0;
+    idle.swap(m_state->idle);
+    m_state->mutex.unlock();
+
+    for(size_t i = 0; i < idle.size(); i++)
+    {
+	delete idle[i];
+    }
+}
+
+
+
+QSharedPointer<ResponsePDU> ResponsePDUPool::acquire()
+{
+    ResponsePDU* pdu = 0;
+
+    m_state->mutex.lock();
+    if( ! m_state->idle.empty() )
+    {
+	pdu = m_state->idle.back();
+	m_state->idle.pop_back();
+	m_state->reused++;
+    }
+    else
+    {
+	m_state->allocated++;
+    }
+    m_state->mutex.unlock();
+
+    if( ! pdu )
+    {
+	pdu = new ResponsePDU;
+    }
+
+    recycler r;
+    r.pool = m_state;
+    return QSharedPointer<ResponsePDU>(pdu, r);
+}
+
+
+
+size_t ResponsePDUPool::idle() const
+{
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->idle.size();
+}
+
+
+
+quint64 ResponsePDUPool::get_reused() const
+{
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->reused;
+}
+
+
+
+quint64 ResponsePDUPool::get_allocated() const
+{
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->allocated;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _RESPONSEPDUPOOL_H_
+#define _RESPONSEPDUPOOL_H_
+
+#include <vector>
+
+#include <QtGlobal>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include "ResponsePDU.hpp"
+
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief A pool of reusable ResponsePDU objects.
+     *
+     * A subagent creates one ResponsePDU for every request it answers. The 
+     * pool recycles these objects: when the last QSharedPointer to a 
+     * ResponsePDU obtained from acquire() is dropped, the object is reset 
+     * with ResponsePDU::recycle() and kept for the next request, instead 
+     * of being deleted. The varbindlist keeps its capacity, so that a 
+     * recycled %PDU can be filled without allocating a new vector.
+     *
+     * At most max_size idle objects are kept; further objects are deleted 
+     * when they are released.
+     *
+     * The pool is thread-safe. Objects may be released after the pool was 
+     * destroyed; they are deleted then.
+     */
+    class ResponsePDUPool
+    {
+	private:
+	    /**
+	     * \brief The state shared by the pool and its objects.
+	     */
+	    struct state
+	    {
+		/**
+		 * \brief Guards all members.
+		 */
+		QMutex mutex;
+
+		/**
+		 * \brief The idle objects.
+		 */
+		std::vector<ResponsePDU*> idle;
+
+		/**
+		 * \brief The maximum number of idle objects.
+		 *
+		 * Set to 0 when the pool is destroyed.
+		 */
+		size_t max_size;
+
+		/**
+		 * \brief The number of acquire() calls served from idle.
+		 */
+		quint64 reused;
+
+		/**
+		 * \brief The number of acquire() calls which allocated.
+		 */
+		quint64 allocated;
+
+		~state();
+	    };
+
+	    /**
+	     * \brief Deleter which returns an object to the pool.
+	     *
+	     * Keeps the state alive until all objects are released.
+	     */
+	    struct recycler
+	    {
+		QSharedPointer<state> pool;
+
+		void operator()(ResponsePDU* pdu) const;
+	    };
+
+	    /**
+	     * \brief The state of this pool.
+	     */
+	    QSharedPointer<state> m_state;
+
+	    // Not copyable
+	    ResponsePDUPool(const ResponsePDUPool&);
+	    ResponsePDUPool& operator=(const ResponsePDUPool&);
+
+	public:
+	    /**
+	     * \brief Create an empty pool.
+	     *
+	     * \param max_size The maximum number of idle objects kept.
+	     */
+	    ResponsePDUPool(size_t max_size = 64);
+
+	    /**
+	     * \brief Destructor.
+	     *
+	     * Deletes the idle objects. Objects which are still in use are 
+	     * deleted when they are released.
+	     */
+	    ~ResponsePDUPool();
+
+	    /**
+	     * \brief Get a ResponsePDU.
+	     *
+	     * Returns a recycled object if one is idle, otherwise a new one.  
+	     * The object is in the state set by ResponsePDU::recycle(); the 
+	     * packetID must be set by the caller.
+	     */
+	    QSharedPointer<ResponsePDU> acquire();
+
+	    /**
+	     * \brief The number of idle objects.
+	     */
+	    size_t idle() const;
+
+	    /**
+	     * \brief The number of acquire() calls served with a recycled
+	     *        object.
+	     */
+	    quint64 get_reused() const;
+
+	    /**
+	     * \brief The number of acquire() calls which allocated a new
+	     *        object.
+	     */
+	    quint64 get_allocated() const;
+    };
+}
+
+#endif  //_RESPONSEPDUPOOL_H_
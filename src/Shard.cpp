@@ -0,0 +1,132 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <QMutexLocker>
+#include <QMetaObject>
+
+#include "Shard.hpp"
+
+using namespace agentxcpp;
+
+
+namespace
+{
+    /**
+     * \brief Throw a default constructed exception of type E.
+     */
+    template<class E>
+    void throw_exception()
+    {
+        throw E();
+    }
+
+    /**
+     * \brief Destroys the MasterProxy of a shard.
+     */
+    class DestroyCall : public ShardCall
+    {
+        public:
+            virtual void run(MasterProxy& proxy)
+            {
+                delete &proxy;
+            }
+    };
+}
+
+
+void ShardCall::execute(MasterProxy& proxy)
+{
+    m_rethrow = 0;
+    try
+    {
+        run(proxy);
+    }
+    catch(parse_error)            { m_rethrow = &throw_exception<parse_error>; }
+    catch(inval_param)            { m_rethrow = &throw_exception<inval_param>; }
+    catch(version_error)          { m_rethrow = &throw_exception<version_error>; }
+    catch(disconnected)           { m_rethrow = &throw_exception<disconnected>; }
+    catch(timeout_error)          { m_rethrow = &throw_exception<timeout_error>; }
+    catch(network_error)          { m_rethrow = &throw_exception<network_error>; }
+    catch(internal_error)         { m_rethrow = &throw_exception<internal_error>; }
+    catch(master_is_unable)       { m_rethrow = &throw_exception<master_is_unable>; }
+    catch(master_is_unwilling)    { m_rethrow = &throw_exception<master_is_unwilling>; }
+    catch(duplicate_registration) { m_rethrow = &throw_exception<duplicate_registration>; }
+    catch(unknown_registration)   { m_rethrow = &throw_exception<unknown_registration>; }
+    catch(generic_error)          { m_rethrow = &throw_exception<generic_error>; }
+    catch(unsupported_context)    { m_rethrow = &throw_exception<unsupported_context>; }
+    catch(...)                    { m_rethrow = &throw_exception<generic_error>; }
+}
+
+
+void ShardCall::rethrow()
+{
+    if(m_rethrow)
+    {
+        m_rethrow();
+    }
+}
+
+
+Shard::Shard(MasterProxy* proxy)
+: m_proxy(proxy),
+  m_call(0)
+{
+    m_proxy->moveToThread(&m_thread);
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+
+Shard::~Shard()
+{
+    // The proxy is destroyed in its thread, because its timers must not be 
+    // destroyed from another thread
+    DestroyCall destroy;
+    call(destroy);
+    m_proxy = 0;
+
+    m_thread.quit();
+    m_thread.wait();
+}
+
+
+void Shard::execute()
+{
+    m_call->execute(*m_proxy);
+}
+
+
+void Shard::call(ShardCall& c)
+{
+    if(QThread::currentThread() == &m_thread)
+    {
+        // Already in our thread (e.g. called by a variable)
+        c.execute(*m_proxy);
+    }
+    else
+    {
+        QMutexLocker locker(&m_call_mutex);
+        m_call = &c;
+        QMetaObject::invokeMethod(this, "execute",
+                                  Qt::BlockingQueuedConnection);
+        m_call = 0;
+    }
+
+    c.rethrow();
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+
+#include "MasterProxy.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief An operation executed on the MasterProxy of a Shard.
+     *
+     * Subclasses implement run(). Shard::call() executes run() within the 
+     * thread of the shard and rethrows the exceptions of the library (see 
+     * exceptions.hpp) in the calling thread.
+     */
+    class ShardCall
+    {
+	private:
+	    /**
+	     * \brief Throws the exception caught by execute(), or NULL.
+	     */
+	    void (*m_rethrow)();
+
+	public:
+	    /**
+	     * \brief Constructor.
+	     */
+	    ShardCall() : m_rethrow(0)
+	    {
+	    }
+
+	    /**
+	     * \brief Destructor.
+	     */
+	    virtual ~ShardCall()
+	    {
+	    }
+
+	    /**
+	     * \brief The operation.
+	     */
+	    virtual void run(MasterProxy& proxy) = 0;
+
+	    /**
+	     * \brief Call run() and catch the exceptions of the library.
+	     */
+	    void execute(MasterProxy& proxy);
+
+	    /**
+	     * \brief Rethrow the exception caught by execute(), if any.
+	     */
+	    void rethrow();
+    };
+
+    /**
+     * \internal
+     *
+     * \brief A MasterProxy with its own thread.
+     *
+     * A shard moves a MasterProxy into a thread which runs an event loop, 
+     * so that the %PDU's of the MasterProxy's session are processed in that 
+     * thread (the connector passes them to MasterProxy::handle_pdu() via a 
+     * queued invocation). The MasterProxy must only be accessed through 
+     * call(), which executes a ShardCall within the shard's thread. This 
+     * way, the variables and registrations of the MasterProxy are only 
+     * accessed by a single thread, as the MasterProxy requires.
+     *
+     * The shard object itself lives in its thread, too. call() invokes the 
+     * execute() slot with a blocking queued connection.
+     */
+    class Shard : public QObject
+    {
+        Q_OBJECT
+
+	private:
+	    /**
+	     * \brief The thread of the shard.
+	     */
+	    QThread m_thread;
+
+	    /**
+	     * \brief The MasterProxy of the shard.
+	     */
+	    MasterProxy* m_proxy;
+
+	    /**
+	     * \brief The call to be executed by execute().
+	     *
+	     * Protected by m_call_mutex.
+	     */
+	    ShardCall* m_call;
+
+	    /**
+	     * \brief Serializes call().
+	     */
+	    QMutex m_call_mutex;
+
+	private slots:
+	    /**
+	     * \brief Execute m_call.
+	     */
+	    void execute();
+
+	public:
+	    /**
+	     * \brief Constructor.
+	     *
+	     * Moves the proxy into a new thread and starts the thread.
+	     *
+	     * \param proxy The MasterProxy. The shard takes ownership. It must 
+	     *              not have a parent.
+	     */
+	    Shard(MasterProxy* proxy);
+
+	    /**
+	     * \brief Destructor.
+	     *
+	     * Destroys the MasterProxy within the shard's thread (which closes 
+	     * its session), then stops the thread.
+	     */
+	    ~Shard();
+
+	    /**
+	     * \brief Execute an operation within the shard's thread.
+	     *
+	     * Blocks until the operation finished. If called from within the 
+	     * shard's thread, the operation is executed directly.
+	     *
+	     * \exception All exceptions of the library thrown by the operation
+	     *            are forwarded.
+	     */
+	    void call(ShardCall& c);
+    };
+}
+
+#endif  //_SHARD_H_
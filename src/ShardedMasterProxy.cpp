@@ -0,0 +1,340 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include "ShardedMasterProxy.hpp"
+#include "Shard.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+namespace
+{
+    /**
+     * \brief Calls MasterProxy::register_subtree().
+     */
+    class RegisterCall : public ShardCall
+    {
+        public:
+            Oid subtree;
+            quint8 priority;
+            quint8 timeout;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                proxy.register_subtree(subtree, priority, timeout);
+            }
+    };
+
+    /**
+     * \brief Calls MasterProxy::unregister_subtree().
+     */
+    class UnregisterCall : public ShardCall
+    {
+        public:
+            Oid subtree;
+            quint8 priority;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                proxy.unregister_subtree(subtree, priority);
+            }
+    };
+
+    /**
+     * \brief Calls MasterProxy::add_variable().
+     */
+    class AddVariableCall : public ShardCall
+    {
+        public:
+            Oid id;
+            QSharedPointer<AbstractVariable> variable;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                proxy.add_variable(id, variable);
+            }
+    };
+
+    /**
+     * \brief Calls MasterProxy::remove_variable().
+     */
+    class RemoveVariableCall : public ShardCall
+    {
+        public:
+            Oid id;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                proxy.remove_variable(id);
+            }
+    };
+
+    /**
+     * \brief Calls MasterProxy::send_notification().
+     */
+    class NotificationCall : public ShardCall
+    {
+        public:
+            Oid snmpTrapOID;
+            const TimeTicksVariable* sysUpTime;
+            const vector<Varbind>* varbinds;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                proxy.send_notification(snmpTrapOID, sysUpTime, *varbinds);
+            }
+    };
+
+    /**
+     * \brief Calls MasterProxy::is_connected().
+     */
+    class IsConnectedCall : public ShardCall
+    {
+        public:
+            bool connected;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                connected = proxy.is_connected();
+            }
+    };
+
+    /**
+     * \brief Calls MasterProxy::set_worker_threads().
+     */
+    class WorkerThreadsCall : public ShardCall
+    {
+        public:
+            int count;
+
+            virtual void run(MasterProxy& proxy)
+            {
+                proxy.set_worker_threads(count);
+            }
+    };
+}
+
+
+ShardedMasterProxy::ShardedMasterProxy(unsigned shards,
+                                       std::string description,
+                                       quint8 default_timeout,
+                                       Oid ID,
+                                       std::string unix_domain_socket)
+{
+    if(shards == 0)
+    {
+        shards = 1;
+    }
+    for(unsigned i = 0; i < shards; i++)
+    {
+        MasterProxy* proxy = new MasterProxy(description, default_timeout,
+                                             ID, unix_domain_socket);
+        m_shards.push_back(new Shard(proxy));
+    }
+    m_load.resize(m_shards.size(), 0);
+}
+
+
+ShardedMasterProxy::ShardedMasterProxy(
+        const std::vector< QSharedPointer<Connector> >& connectors,
+        std::string description,
+        quint8 default_timeout,
+        Oid ID)
+{
+    vector< QSharedPointer<Connector> >::const_iterator c;
+    for(c = connectors.begin(); c != connectors.end(); c++)
+    {
+        MasterProxy* proxy = new MasterProxy(*c, description,
+                                             default_timeout, ID);
+        m_shards.push_back(new Shard(proxy));
+    }
+    m_load.resize(m_shards.size(), 0);
+}
+
+
+ShardedMasterProxy::~ShardedMasterProxy()
+{
+    vector<Shard*>::iterator s;
+    for(s = m_shards.begin(); s != m_shards.end(); s++)
+    {
+        delete *s;
+    }
+}
+
+
+size_t ShardedMasterProxy::shard_for(const Oid& id) const
+{
+    // Find the most specific registration
+    const placement* best = 0;
+    list<placement>::const_iterator r;
+    for(r = m_registrations.begin(); r != m_registrations.end(); r++)
+    {
+        if(r->subtree.contains(id)
+           && (best == 0 || r->subtree.size() > best->subtree.size()))
+        {
+            best = &*r;
+        }
+    }
+
+    if(best == 0)
+    {
+        throw(unknown_registration());
+    }
+    return best->shard;
+}
+
+
+bool ShardedMasterProxy::is_connected()
+{
+    for(size_t i = 0; i < m_shards.size(); i++)
+    {
+        IsConnectedCall call;
+        m_shards[i]->call(call);
+        if( ! call.connected )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+size_t ShardedMasterProxy::register_subtree(Oid subtree,
+                                            quint8 priority,
+                                            quint8 timeout)
+{
+    if(m_shards.empty())
+    {
+        throw(disconnected());
+    }
+
+    // Choose the shard with the fewest registrations
+    size_t shard = 0;
+    for(size_t i = 1; i < m_load.size(); i++)
+    {
+        if(m_load[i] < m_load[shard])
+        {
+            shard = i;
+        }
+    }
+
+    // Register (exceptions are forwarded)
+    RegisterCall call;
+    call.subtree = subtree;
+    call.priority = priority;
+    call.timeout = timeout;
+    m_shards[shard]->call(call);
+
+    // Remember the shard
+    placement p;
+    p.subtree = subtree;
+    p.priority = priority;
+    p.shard = shard;
+    m_registrations.push_back(p);
+    m_load[shard]++;
+
+    return shard;
+}
+
+
+void ShardedMasterProxy::unregister_subtree(Oid subtree,
+                                            quint8 priority)
+{
+    list<placement>::iterator r;
+    for(r = m_registrations.begin(); r != m_registrations.end(); r++)
+    {
+        if(r->subtree == subtree && r->priority == priority)
+        {
+            break;
+        }
+    }
+    if(r == m_registrations.end())
+    {
+        throw(unknown_registration());
+    }
+
+    // Unregister (exceptions are forwarded, keeping the placement)
+    size_t shard = r->shard;
+    UnregisterCall call;
+    call.subtree = subtree;
+    call.priority = priority;
+    m_shards[shard]->call(call);
+
+    m_registrations.erase(r);
+    m_load[shard]--;
+}
+
+
+void ShardedMasterProxy::add_variable(const Oid& id,
+                                      QSharedPointer<AbstractVariable> v)
+{
+    AddVariableCall call;
+    call.id = id;
+    call.variable = v;
+    m_shards[shard_for(id)]->call(call);
+}
+
+
+void ShardedMasterProxy::remove_variable(const Oid& id)
+{
+    size_t shard = 0;
+    try
+    {
+        shard = shard_for(id);
+    }
+    catch(unknown_registration)
+    {
+        // No variable can exist
+        return;
+    }
+
+    RemoveVariableCall call;
+    call.id = id;
+    m_shards[shard]->call(call);
+}
+
+
+void ShardedMasterProxy::send_notification(const Oid& snmpTrapOID,
+                                           const TimeTicksVariable* sysUpTime,
+                                           const vector<Varbind>& varbinds)
+{
+    if(m_shards.empty())
+    {
+        throw(disconnected());
+    }
+
+    NotificationCall call;
+    call.snmpTrapOID = snmpTrapOID;
+    call.sysUpTime = sysUpTime;
+    call.varbinds = &varbinds;
+    m_shards[0]->call(call);
+}
+
+
+void ShardedMasterProxy::set_worker_threads(int count)
+{
+    for(size_t i = 0; i < m_shards.size(); i++)
+    {
+        WorkerThreadsCall call;
+        call.count = count;
+        m_shards[i]->call(call);
+    }
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _SHARDED_MASTER_PROXY_H_
+#define _SHARDED_MASTER_PROXY_H_
+
+#include <string>
+#include <vector>
+#include <list>
+
+#include <QSharedPointer>
+#include <QtGlobal>
+
+#include "Oid.hpp"
+#include "AbstractVariable.hpp"
+#include "TimeTicksVariable.hpp"
+#include "Varbind.hpp"
+#include "Connector.hpp"
+
+
+namespace agentxcpp
+{
+    class Shard;
+
+    /**
+     * \brief A subagent which spreads its MIB over several sessions.
+     *
+     * The master agent processes the requests of a session one after 
+     * another, and a MasterProxy handles all of them in a single thread. 
+     * For a large MIB this limits the throughput. A ShardedMasterProxy 
+     * therefore opens several sessions (shards), each with its own 
+     * MasterProxy, its own thread and its own variables. The registered 
+     * subtrees are distributed over the shards, so that requests for 
+     * different subtrees are processed in parallel.
+     *
+     * For the application, the MIB stays the same: subtrees are registered 
+     * and variables added like with a MasterProxy. Each variable is added 
+     * to the shard which registered the enclosing subtree:
+     *
+     * \code
+     * ShardedMasterProxy master(4, "my subagent");
+     * master.register_subtree(Oid("1.3.6.1.4.1.42.1"));
+     * master.register_subtree(Oid("1.3.6.1.4.1.42.2"));
+     * master.add_variable(Oid("1.3.6.1.4.1.42.1.1.0"), var1);  // shard 0
+     * master.add_variable(Oid("1.3.6.1.4.1.42.2.1.0"), var2);  // shard 1
+     * \endcode
+     *
+     * Each subtree is assigned to the shard with the fewest registrations.  
+     * Only subtrees registered as a whole are split; a single subtree is 
+     * always served by one shard. Therefore, a MIB should be registered as 
+     * several subtrees to benefit from sharding.
+     *
+     * The Get handlers of the variables of different shards run 
+     * concurrently, in the threads of the shards. Variables which share 
+     * data across subtrees must synchronize access to it.
+     *
+     * The public methods of this class must be called from a single 
+     * thread, or from the handlers of the variables.
+     *
+     * \internal
+     *
+     * Each shard is a Shard object, which owns a MasterProxy living in its 
+     * own thread. All accesses to a MasterProxy are executed in the 
+     * shard's thread (see Shard::call()). m_registrations remembers which 
+     * shard registered which subtree, so that add_variable(), 
+     * remove_variable() and unregister_subtree() can be forwarded to it.
+     *
+     * \endinternal
+     */
+    class ShardedMasterProxy
+    {
+	private:
+	    /**
+	     * \brief A registration and the shard which made it.
+	     */
+	    struct placement
+	    {
+		Oid subtree;
+		quint8 priority;
+		size_t shard;
+	    };
+
+	    /**
+	     * \brief The shards.
+	     */
+	    std::vector<Shard*> m_shards;
+
+	    /**
+	     * \brief The number of registrations of each shard.
+	     */
+	    std::vector<size_t> m_load;
+
+	    /**
+	     * \brief The registrations.
+	     */
+	    std::list<placement> m_registrations;
+
+	    /**
+	     * \brief Find the shard serving an OID.
+	     *
+	     * \return The shard with the most specific registration which
+	     *         contains the OID.
+	     *
+	     * \exception unknown_registration If the OID is not within a
+	     *                                 registered subtree.
+	     */
+	    size_t shard_for(const Oid& id) const;
+
+	    /**
+	     * \brief Don't allow copying.
+	     */
+	    ShardedMasterProxy(const ShardedMasterProxy&);
+
+	    /**
+	     * \brief Don't allow copying.
+	     */
+	    ShardedMasterProxy& operator=(const ShardedMasterProxy&);
+
+	public:
+	    /**
+	     * \brief Create a sharded subagent with one connection per
+	     *        shard.
+	     *
+	     * Creates \p shards MasterProxy objects, each connecting to the 
+	     * master agent via its own unix domain socket connection. See 
+	     * MasterProxy::MasterProxy(std::string, quint8, Oid, std::string) 
+	     * for the parameters.
+	     *
+	     * \param shards The number of shards (at least 1).
+	     */
+	    ShardedMasterProxy(unsigned shards,
+			       std::string description="",
+			       quint8 default_timeout=0,
+			       Oid ID=Oid(),
+			       std::string unix_domain_socket="/var/agentx/master");
+
+	    /**
+	     * \brief Create a sharded subagent using the given connectors.
+	     *
+	     * Creates one shard per connector. A connector may be given 
+	     * several times, in which case the shards open several sessions 
+	     * over the same connection (see 
+	     * MasterProxy::MasterProxy(QSharedPointer<Connector>, std::string, 
+	     * quint8, Oid)).
+	     *
+	     * \param connectors The connectors (at least one).
+	     */
+	    ShardedMasterProxy(const std::vector< QSharedPointer<Connector> >& connectors,
+			       std::string description="",
+			       quint8 default_timeout=0,
+			       Oid ID=Oid());
+
+	    /**
+	     * \brief Destructor.
+	     *
+	     * Stops the shards and closes their sessions.
+	     */
+	    ~ShardedMasterProxy();
+
+	    /**
+	     * \brief The number of shards.
+	     */
+	    size_t shard_count() const
+	    {
+		return m_shards.size();
+	    }
+
+	    /**
+	     * \brief Check whether all shards are connected.
+	     */
+	    bool is_connected();
+
+	    /**
+	     * \brief Register a subtree with the master agent.
+	     *
+	     * The subtree is registered by the shard with the fewest 
+	     * registrations. See MasterProxy::register_subtree() for the 
+	     * parameters and exceptions.
+	     *
+	     * \return The index of the shard serving the subtree.
+	     */
+	    size_t register_subtree(Oid subtree,
+				    quint8 priority=127,
+				    quint8 timeout=0);
+
+	    /**
+	     * \brief Unregister a subtree with the master agent.
+	     *
+	     * See MasterProxy::unregister_subtree() for the parameters and 
+	     * exceptions.
+	     */
+	    void unregister_subtree(Oid subtree,
+				    quint8 priority=127);
+
+	    /**
+	     * \brief Add an SNMP variable.
+	     *
+	     * The variable is added to the shard which registered the 
+	     * enclosing subtree. See MasterProxy::add_variable().
+	     *
+	     * \exception unknown_registration If the id is not within a
+	     *                                 registered subtree.
+	     */
+	    void add_variable(const Oid& id, QSharedPointer<AbstractVariable> v);
+
+	    /**
+	     * \brief Remove an SNMP variable.
+	     *
+	     * See MasterProxy::remove_variable(). If the id is not within a 
+	     * registered subtree, nothing happens.
+	     *
+	     * \exception None.
+	     */
+	    void remove_variable(const Oid& id);
+
+	    /**
+	     * \brief Send a notification or trap.
+	     *
+	     * The notification is sent via the first shard. See 
+	     * MasterProxy::send_notification(const Oid&, const 
+	     * TimeTicksVariable*, const std::vector<Varbind>&).
+	     */
+	    void send_notification(const Oid& snmpTrapOID,
+				   const TimeTicksVariable* sysUpTime,
+				   const std::vector<Varbind>& varbinds=std::vector<Varbind>());
+
+	    /**
+	     * \brief Send a notification without sysUpTime.0.
+	     */
+	    void send_notification(const Oid& snmpTrapOID,
+				   const std::vector<Varbind>& varbinds=std::vector<Varbind>())
+	    {
+		send_notification(snmpTrapOID, 0, varbinds);
+	    }
+
+	    /**
+	     * \brief Set the worker threads of each shard.
+	     *
+	     * See MasterProxy::set_worker_threads().
+	     */
+	    void set_worker_threads(int count);
+    };
+}
+
+#endif  //_SHARDED_MASTER_PROXY_H_
@@ -0,0 +1,665 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "ShmConnector.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+struct agentxcpp::ShmRegion
+{
+    quint32 magic;
+    quint32 version;
+    quint32 ring_size;
+    char pad0[52];
+
+    /**
+     * \brief The head and tail of a ring.
+     */
+    struct Positions
+    {
+        /**
+         * \brief Bytes written by the producer.
+         */
+        quint32 head;
+        char pad0[60];
+
+        /**
+         * \brief Bytes read by the consumer.
+         */
+        quint32 tail;
+        char pad1[60];
+    };
+
+    /**
+     * \brief Set while the subagent's reader thread sleeps.
+     */
+    quint32 subagent_sleeping;
+    char pad1[60];
+
+    /**
+     * \brief Set while the master agent sleeps.
+     */
+    quint32 master_sleeping;
+    char pad2[60];
+
+    Positions to_master;
+    Positions to_subagent;
+
+    /**
+     * \brief The data of the ring to the master.
+     */
+    quint8* to_master_data()
+    {
+        return reinterpret_cast<quint8*>(this + 1);
+    }
+
+    /**
+     * \brief The data of the ring to the subagent.
+     *
+     * \param size The ring size validated by the subagent (the master 
+     *             agent could modify ring_size at any time).
+     */
+    quint8* to_subagent_data(quint32 size)
+    {
+        return reinterpret_cast<quint8*>(this + 1) + size;
+    }
+};
+
+
+namespace
+{
+    const quint32 shm_magic = 0x41585348;   // "AXSH"
+    const quint32 shm_version = 1;
+
+    /**
+     * \brief Write to an eventfd.
+     */
+    void signal_event(int fd)
+    {
+        quint64 one = 1;
+        if(::write(fd, &one, sizeof(one)) != sizeof(one))
+        {
+            // Counter overflow; the peer is woken up anyway
+        }
+    }
+}
+
+
+ShmConnector::ShmConnector(const std::string& _unix_domain_socket,
+                           quint32 _ring_size,
+                           unsigned _timeout)
+: Connector(),
+  m_filename(_unix_domain_socket),
+  m_timeout(_timeout),
+  m_ring_size(4096),
+  m_spin_count(0),
+  m_fd(-1),
+  m_event(-1),
+  m_master_event(-1),
+  m_region(0),
+  m_stop(0),
+  m_reader(this),
+  m_high_water_mark(256*1024)
+{
+    // The positions are free-running 32-bit counters, so the ring size must 
+    // be a power of 2.
+    while(m_ring_size < _ring_size && m_ring_size < 0x40000000)
+    {
+        m_ring_size *= 2;
+    }
+
+    // We want to deliver this types within a signal:
+    qRegisterMetaType< QSharedPointer<PDU> >("QSharedPointer<PDU>");
+}
+
+
+ShmConnector::~ShmConnector()
+{
+    disconnect();
+}
+
+
+void ShmConnector::set_spin_count(unsigned count)
+{
+    __atomic_store_n(&m_spin_count, count, __ATOMIC_RELAXED);
+}
+
+
+unsigned ShmConnector::spin_count()
+{
+    return __atomic_load_n(&m_spin_count, __ATOMIC_RELAXED);
+}
+
+
+bool ShmConnector::connect()
+{
+    QMutexLocker connection_locker(&m_connection_mutex);
+
+    if(is_connected())
+    {
+        return true;
+    }
+
+    // A reader thread which terminated on connection loss
+    m_reader.wait();
+    close_fds();
+
+    // Create the shared memory region
+    size_t map_size = sizeof(ShmRegion) + 2 * size_t(m_ring_size);
+    int memfd = memfd_create("agentxcpp", MFD_CLOEXEC);
+    if(memfd == -1)
+    {
+        return false;
+    }
+    if(ftruncate(memfd, map_size) == -1)
+    {
+        ::close(memfd);
+        return false;
+    }
+    void* map = mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     memfd, 0);
+    if(map == MAP_FAILED)
+    {
+        ::close(memfd);
+        return false;
+    }
+    m_region = static_cast<ShmRegion*>(map);
+    m_region->magic = shm_magic;
+    m_region->version = shm_version;
+    m_region->ring_size = m_ring_size;
+
+    // Create the eventfds
+    m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_master_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_event == -1 || m_master_event == -1)
+    {
+        ::close(memfd);
+        close_fds();
+        return false;
+    }
+
+    // Connect to the master agent
+    struct sockaddr_un addr;
+    int fd = -1;
+    if(m_filename.size() < sizeof(addr.sun_path))
+    {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, m_filename.c_str());
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    if(fd != -1 && ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                             sizeof(addr)) == -1)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+    if(fd == -1)
+    {
+        ::close(memfd);
+        close_fds();
+        return false;
+    }
+
+    // Pass the region and the eventfds
+    int fds[3] = { memfd, m_master_event, m_event };
+    char cmsg_buf[CMSG_SPACE(sizeof(fds))];
+    memset(cmsg_buf, 0, sizeof(cmsg_buf));
+    char byte = 0;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf;
+    msg.msg_controllen = sizeof(cmsg_buf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    ssize_t sent = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    ::close(memfd);
+
+    // Wait for the master to accept
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if(sent != 1
+       || ::poll(&pfd, 1, m_timeout) != 1
+       || ::read(fd, &byte, 1) != 1)
+    {
+        ::close(fd);
+        close_fds();
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    {
+        QMutexLocker locker(&m_send_mutex);
+        m_fd = fd;
+        m_outbuf.clear();
+        m_outbuf_pdus.clear();
+    }
+    m_inbuf.clear();
+    m_stop = 0;
+
+    // Start receiving
+    m_reader.start();
+
+    return true;
+}
+
+
+void ShmConnector::disconnect()
+{
+    QMutexLocker connection_locker(&m_connection_mutex);
+
+    if(m_event != -1)
+    {
+        // Stop the reader thread, which may be spinning or sleeping
+        __atomic_store_n(&m_stop, 1, __ATOMIC_RELEASE);
+        signal_event(m_event);
+    }
+    m_reader.wait();
+
+    close_fds();
+}
+
+
+void ShmConnector::close_fds()
+{
+    {
+        QMutexLocker locker(&m_send_mutex);
+        if(m_fd != -1)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+
+        // Data not yet written is lost
+        m_outbuf.clear();
+        m_outbuf_pdus.clear();
+        m_outbuf_space.wakeAll();
+    }
+
+    if(m_region)
+    {
+        munmap(m_region, sizeof(ShmRegion) + 2 * size_t(m_ring_size));
+        m_region = 0;
+    }
+    if(m_event != -1)
+    {
+        ::close(m_event);
+        m_event = -1;
+    }
+    if(m_master_event != -1)
+    {
+        ::close(m_master_event);
+        m_master_event = -1;
+    }
+}
+
+
+bool ShmConnector::is_connected()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_fd != -1;
+}
+
+
+unsigned long ShmConnector::get_timeout() const
+{
+    return m_timeout;
+}
+
+
+void ShmConnector::run()
+{
+    unsigned idle = 0;
+    while( ! __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE) )
+    {
+        // Fast path: work without system calls
+        int received = receive();
+        if(received < 0)
+        {
+            break;  // corrupted byte stream
+        }
+        bool busy = (received > 0);
+        {
+            QMutexLocker locker(&m_send_mutex);
+            size_t buffered = m_outbuf.size();
+            if(buffered != 0)
+            {
+                write_locked(0, 0);
+                busy = busy || m_outbuf.size() != buffered;
+            }
+        }
+        if(busy || idle < spin_count())
+        {
+            idle = busy ? 0 : idle + 1;
+            continue;
+        }
+        idle = 0;
+
+        // Slow path: sleep until the master wakes us up
+        __atomic_store_n(&m_region->subagent_sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if( ! has_work() )
+        {
+            struct pollfd pfds[2];
+            pfds[0].fd = m_event;
+            pfds[0].events = POLLIN;
+            pfds[1].fd = m_fd;
+            pfds[1].events = POLLIN | POLLRDHUP;
+            int n = ::poll(pfds, 2, -1);
+            if(n == -1 && errno != EINTR)
+            {
+                break;
+            }
+            if(n > 0 && pfds[1].revents != 0)
+            {
+                // The master closed the session (it sends nothing else)
+                break;
+            }
+            quint64 count;
+            if(::read(m_event, &count, sizeof(count)) == -1)
+            {
+                // EAGAIN: not woken by the eventfd
+            }
+        }
+        __atomic_store_n(&m_region->subagent_sleeping, 0, __ATOMIC_RELAXED);
+    }
+
+    if(__atomic_load_n(&m_stop, __ATOMIC_ACQUIRE))
+    {
+        // disconnect() was called
+        return;
+    }
+
+    // Connection lost. Mark as disconnected; the shared memory is released 
+    // by the next connect() or disconnect().
+    {
+        QMutexLocker locker(&m_send_mutex);
+        if(m_fd != -1)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        m_outbuf.clear();
+        m_outbuf_pdus.clear();
+        m_outbuf_space.wakeAll();
+    }
+    abort_requests();
+    emit connectionLost();
+}
+
+
+bool ShmConnector::has_work()
+{
+    ShmRegion::Positions& in = m_region->to_subagent;
+    if(__atomic_load_n(&in.head, __ATOMIC_ACQUIRE) != in.tail)
+    {
+        return true;
+    }
+
+    QMutexLocker locker(&m_send_mutex);
+    if(m_outbuf.empty())
+    {
+        return false;
+    }
+    ShmRegion::Positions& out = m_region->to_master;
+    quint32 used = out.head - __atomic_load_n(&out.tail, __ATOMIC_ACQUIRE);
+    return used < m_ring_size;
+}
+
+
+int ShmConnector::receive()
+{
+    ShmRegion::Positions& in = m_region->to_subagent;
+    quint32 ring_size = m_ring_size;
+    quint32 tail = in.tail;
+    quint32 head = __atomic_load_n(&in.head, __ATOMIC_ACQUIRE);
+    if(head == tail)
+    {
+        return 0;
+    }
+    quint32 length = head - tail;
+    if(length > ring_size)
+    {
+        return -1;  // the master corrupted the ring
+    }
+
+    // Copy the data, which may wrap around
+    const quint8* data = m_region->to_subagent_data(m_ring_size);
+    quint32 offset = tail & (ring_size - 1);
+    quint32 first = std::min(length, ring_size - offset);
+    m_inbuf.append(data + offset, first);
+    m_inbuf.append(data, length - first);
+
+    // Release the space
+    __atomic_store_n(&in.tail, head, __ATOMIC_RELEASE);
+    notify_master();
+
+    // Process all complete PDU's
+    return dispatch_buffer(m_inbuf) ? 1 : -1;
+}
+
+
+void ShmConnector::notify_master()
+{
+    // Pairs with the barrier of the master between setting its sleep flag 
+    // and checking the rings.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&m_region->master_sleeping, __ATOMIC_RELAXED))
+    {
+        signal_event(m_master_event);
+    }
+}
+
+
+size_t ShmConnector::ring_write(const quint8* data, size_t size)
+{
+    ShmRegion::Positions& out = m_region->to_master;
+    quint32 ring_size = m_ring_size;
+    quint32 head = out.head;
+    quint32 used = head - __atomic_load_n(&out.tail, __ATOMIC_ACQUIRE);
+    if(used >= ring_size)
+    {
+        return 0;   // full, or corrupted by the master
+    }
+    size_t length = std::min(size, size_t(ring_size - used));
+    if(length == 0)
+    {
+        return 0;
+    }
+
+    // Copy the data, which may wrap around
+    quint8* ring = m_region->to_master_data();
+    quint32 offset = head & (ring_size - 1);
+    size_t first = std::min(length, size_t(ring_size - offset));
+    memcpy(ring + offset, data, first);
+    memcpy(ring, data + first, length - first);
+
+    // Publish it
+    __atomic_store_n(&out.head, head + quint32(length), __ATOMIC_RELEASE);
+    return length;
+}
+
+
+void ShmConnector::write_locked(const quint8* data, size_t size)
+{
+    if(m_fd == -1)
+    {
+        return;
+    }
+
+    // Buffered data is written first
+    size_t flushed = 0;
+    if( ! m_outbuf.empty() )
+    {
+        flushed = ring_write(m_outbuf.data(), m_outbuf.size());
+    }
+    if(flushed != 0)
+    {
+        m_outbuf.erase(0, flushed);
+        while( ! m_outbuf_pdus.empty() && m_outbuf_pdus.front() <= flushed)
+        {
+            m_outbuf_pdus.pop_front();
+        }
+        std::deque<size_t>::iterator i;
+        for(i = m_outbuf_pdus.begin(); i != m_outbuf_pdus.end(); i++)
+        {
+            *i -= flushed;
+        }
+        m_outbuf_space.wakeAll();
+    }
+
+    // Write the new data directly, if nothing is pending
+    size_t written = 0;
+    if(data != 0 && m_outbuf.empty())
+    {
+        written = ring_write(data, size);
+    }
+
+    // A single wake-up for everything written
+    if(flushed != 0 || written != 0)
+    {
+        notify_master();
+    }
+
+    // Keep the rest until the master frees space
+    if(data != 0 && written < size)
+    {
+        m_outbuf.append(data + written, size - written);
+        m_outbuf_pdus.push_back(m_outbuf.size());
+    }
+}
+
+
+bool ShmConnector::enqueue(const binary& data)
+{
+    if(m_fd == -1)
+    {
+        throw(disconnected());
+    }
+    qint64 buffered = m_outbuf.size();
+    if(buffered != 0 && buffered + qint64(data.size()) > m_high_water_mark)
+    {
+        // Buffer is full
+        return false;
+    }
+
+    write_locked(data.data(), data.size());
+    return true;
+}
+
+
+void ShmConnector::send(QSharedPointer<PDU> pdu)
+{
+    binary data = pdu->serialize();
+
+    QMutexLocker locker(&m_send_mutex);
+    if(enqueue(data))
+    {
+        return;
+    }
+
+    // Buffer is full. We must not wait within the reader thread, because 
+    // the buffer is flushed there.
+    if(QThread::currentThread() == &m_reader)
+    {
+        throw(timeout_error());
+    }
+
+    // Wait for space
+    QElapsedTimer timer;
+    timer.start();
+    while( ! enqueue(data) )
+    {
+        qint64 left = qint64(m_timeout) - timer.elapsed();
+        if(left <= 0)
+        {
+            throw(timeout_error());
+        }
+        m_outbuf_space.wait(&m_send_mutex, left);
+    }
+}
+
+
+bool ShmConnector::trySend(QSharedPointer<PDU> pdu)
+{
+    binary data = pdu->serialize();
+
+    QMutexLocker locker(&m_send_mutex);
+    return enqueue(data);
+}
+
+
+void ShmConnector::set_high_water_mark(qint64 bytes)
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    m_high_water_mark = bytes;
+    m_outbuf_space.wakeAll();
+}
+
+
+qint64 ShmConnector::high_water_mark()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_high_water_mark;
+}
+
+
+size_t ShmConnector::queue_depth()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_outbuf_pdus.size();
+}
+
+
+qint64 ShmConnector::bytes_buffered()
+{
+    QMutexLocker locker(&m_send_mutex);
+
+    return m_outbuf.size();
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _SHM_CONNECTOR_H_
+#define _SHM_CONNECTOR_H_
+
+#include <string>
+#include <deque>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "Connector.hpp"
+#include "binary.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief The layout of the shared memory region.
+     *
+     * Defined in the implementation file.
+     */
+    struct ShmRegion;
+
+    /**
+     * \brief Connect to a co-located master agent via shared memory.
+     *
+     * This connector exchanges %PDU's with a master agent on the same host 
+     * through two ring buffers in a shared memory region. While both sides 
+     * are busy, no system call is needed to transfer a %PDU. It can be 
+     * passed to MasterProxy::MasterProxy(Connector*, std::string, quint8, 
+     * Oid):
+     *
+     * \code
+     * MasterProxy master(new ShmConnector("/var/agentx/master.shm"),
+     *                    "my subagent");
+     * \endcode
+     *
+     * The master agent must support the protocol described below; standard 
+     * master agents do not. The connector is available on Linux only.
+     *
+     * \internal
+     *
+     * \par Protocol
+     *
+     * connect() creates a memfd with the following layout (see ShmRegion, 
+     * all integers in host byte order, each field group in its own cache 
+     * line of 64 bytes):
+     * - A header: magic number 0x41585348 ("AXSH"), version 1, ring size.
+     * - The sleep flags of the subagent and of the master.
+     * - The head and tail positions of the ring to the master, then those
+     *   of the ring to the subagent.
+     * - The data of the ring to the master, then the data of the ring to
+     *   the subagent, each of the given ring size (a power of 2).
+     *
+     * It then connects to the unix domain socket m_filename and passes the 
+     * memfd, the eventfd of the master and the eventfd of the subagent 
+     * (in this order) with a single byte of data as \c SCM_RIGHTS. The 
+     * master answers with a single byte to accept the connection. The 
+     * socket is kept open; closing it terminates the session.
+     *
+     * Each ring transports the usual AgentX byte stream, i.e. %PDU's 
+     * encoded with PDU::serialize(). A ring has a single producer and a 
+     * single consumer. Head and tail are free-running 32-bit byte counters: 
+     * the producer copies data to the ring and then advances the head 
+     * (release), the consumer copies data from the ring and then advances 
+     * the tail (release). A %PDU may wrap around the end of the ring and 
+     * may be transferred in several parts.
+     *
+     * Before a side blocks on its eventfd, it sets its sleep flag and checks 
+     * the rings again (with a full memory barrier in between). After 
+     * advancing a head or tail, a side issues a full memory barrier and 
+     * writes to the eventfd of the peer only if the peer's sleep flag is 
+     * set. A side must therefore also wake up when the peer frees space in 
+     * a ring, not only when data arrives.
+     *
+     * \par Receiving
+     *
+     * The reader thread (see run()) copies all available data from the ring 
+     * to m_inbuf and passes complete %PDU's to Connector::dispatch_buffer(). 
+     * It also writes data from m_outbuf as soon as the master frees space.  
+     * If there is nothing to do, it polls the rings up to m_spin_count 
+     * times before it goes to sleep in poll(2), waiting for its eventfd or 
+     * the socket.
+     *
+     * \par Sending
+     *
+     * send() and trySend() serialize the %PDU in the calling thread and copy 
+     * it to the ring directly. If the ring is full, the remainder is kept in 
+     * m_outbuf, which is limited by the high-water mark. All sending members 
+     * are protected by m_send_mutex, so there is a single producer.
+     *
+     * \endinternal
+     */
+    class ShmConnector : public Connector
+    {
+	private:
+
+            /**
+             * \brief The reader thread.
+             *
+             * Runs ShmConnector::run().
+             */
+            class ReaderThread : public QThread
+            {
+                private:
+                    /**
+                     * \brief The connector.
+                     */
+                    ShmConnector* m_connector;
+
+                protected:
+                    /**
+                     * \brief The thread function.
+                     */
+                    virtual void run()
+                    {
+                        m_connector->run();
+                    }
+
+                public:
+                    /**
+                     * \brief Constructor.
+                     */
+                    ReaderThread(ShmConnector* connector)
+                        : m_connector(connector)
+                    {
+                    }
+            };
+
+            /**
+             * \brief The filename of the unix domain socket used to set up
+             *        the session.
+             */
+	    std::string m_filename;
+
+	    /**
+	     * \brief The timeout in milliseconds.
+	     */
+	    unsigned m_timeout;
+
+            /**
+             * \brief The size of each ring in bytes (a power of 2).
+             *
+             * The ring size is published in the shared region for the 
+             * master agent, but never read back from there, because the 
+             * master agent could modify it.
+             */
+            quint32 m_ring_size;
+
+            /**
+             * \brief How often the reader thread polls the rings before it
+             *        sleeps.
+             */
+            unsigned m_spin_count;
+
+            /**
+             * \brief The session socket, or -1 if disconnected.
+             *
+             * Protected by m_send_mutex.
+             */
+            int m_fd;
+
+            /**
+             * \brief The eventfd the reader thread waits on, or -1.
+             */
+            int m_event;
+
+            /**
+             * \brief The eventfd of the master agent, or -1.
+             */
+            int m_master_event;
+
+            /**
+             * \brief The shared memory region, or NULL if disconnected.
+             */
+            ShmRegion* m_region;
+
+            /**
+             * \brief Set by disconnect() to stop the reader thread.
+             */
+            int m_stop;
+
+            /**
+             * \brief The reader thread.
+             */
+            ReaderThread m_reader;
+
+            /**
+             * \brief Received data which is not yet processed.
+             *
+             * Only accessed by the reader thread.
+             */
+            binary m_inbuf;
+
+            /**
+             * \brief Data which did not fit into the ring.
+             *
+             * Protected by m_send_mutex.
+             */
+            binary m_outbuf;
+
+            /**
+             * \brief The end offsets of the %PDU's in m_outbuf.
+             *
+             * Protected by m_send_mutex.
+             */
+            std::deque<size_t> m_outbuf_pdus;
+
+            /**
+             * \brief The maximum size of m_outbuf.
+             *
+             * Protected by m_send_mutex.
+             */
+            qint64 m_high_water_mark;
+
+            /**
+             * \brief Protects the sending members.
+             */
+            QMutex m_send_mutex;
+
+            /**
+             * \brief Triggered when m_outbuf shrinks.
+             *
+             * Used in conjunction with m_send_mutex.
+             */
+            QWaitCondition m_outbuf_space;
+
+            /**
+             * \brief Serializes connect() and disconnect().
+             */
+            QMutex m_connection_mutex;
+
+            /**
+             * \brief The reader loop.
+             *
+             * Runs until the connection is lost or disconnect() is called.
+             */
+            void run();
+
+            /**
+             * \brief Take the available data from the ring to the subagent.
+             *
+             * \return 1 if data was processed, 0 if the ring was empty, -1
+             *         if the byte stream is corrupted.
+             */
+            int receive();
+
+            /**
+             * \brief Whether the reader thread has work to do.
+             *
+             * Used before going to sleep.
+             */
+            bool has_work();
+
+            /**
+             * \brief Copy data to the ring to the master.
+             *
+             * m_send_mutex must be locked by the caller.
+             *
+             * \return The number of bytes copied.
+             */
+            size_t ring_write(const quint8* data, size_t size);
+
+            /**
+             * \brief Wake up the master agent, if it sleeps.
+             */
+            void notify_master();
+
+            /**
+             * \brief Write m_outbuf and then the given data to the ring.
+             *
+             * Data which does not fit is appended to m_outbuf. 
+             * m_send_mutex must be locked by the caller.
+             *
+             * \param data The data, or NULL to only flush m_outbuf.
+             *
+             * \param size The size of the data.
+             */
+            void write_locked(const quint8* data, size_t size);
+
+            /**
+             * \brief Release the shared memory and close all file
+             *        descriptors.
+             *
+             * The reader thread must not be running.
+             */
+            void close_fds();
+
+            /**
+             * \brief Write a serialized %PDU if there is enough space.
+             *
+             * m_send_mutex must be locked by the caller.
+             *
+             * \return True if the %PDU was written or buffered, false if
+             *         m_outbuf is full.
+             *
+             * \exception disconnected If the connector is not connected.
+             */
+            bool enqueue(const binary& data);
+
+            friend class ReaderThread;
+
+        public:
+            /**
+             * \brief Constructor.
+             *
+             * This constructor initializes the connector object to be in
+             * disconnected state.
+             *
+             * \param unix_domain_socket The path to the unix domain socket 
+             *                           used to set up the session.
+             *
+             * \param ring_size The size of each ring in bytes. It is 
+             *                  rounded up to a power of 2 of at least 
+             *                  4096 bytes.
+             *
+             * \param timeout The timeout, in milliseconds, used for 
+             *                connecting and for sending when the outbound 
+             *                buffer is full.
+             */
+            ShmConnector(const std::string& unix_domain_socket
+                                            = "/var/agentx/master.shm",
+                         quint32 ring_size = 1024*1024,
+                         unsigned timeout = 1000);
+
+            /**
+             * \brief Destructor.
+             *
+             * Disconnects.
+             */
+            virtual ~ShmConnector();
+
+            /**
+             * \brief Set how often the reader thread polls the rings
+             *        before it sleeps.
+             *
+             * Polling avoids the wake-up latency (and the system calls) at 
+             * high request rates, but burns CPU time while idle. The 
+             * default is 0, i.e. the reader thread sleeps as soon as there 
+             * is nothing to do.
+             */
+            void set_spin_count(unsigned count);
+
+            /**
+             * \brief The spin count.
+             */
+            unsigned spin_count();
+
+            virtual bool connect();
+            virtual void disconnect();
+            virtual bool is_connected();
+            virtual unsigned long get_timeout() const;
+	    virtual void send(QSharedPointer<PDU> pdu);
+            virtual bool trySend(QSharedPointer<PDU> pdu);
+            virtual void set_high_water_mark(qint64 bytes);
+            virtual qint64 high_water_mark();
+            virtual size_t queue_depth();
+            virtual qint64 bytes_buffered();
+    };
+
+}
+
+#endif  //_SHM_CONNECTOR_H_
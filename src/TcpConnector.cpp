@@ -0,0 +1,161 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "TcpConnector.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+TcpConnector::TcpConnector(const std::string& _host,
+			   quint16 _port,
+			   unsigned _timeout)
+: EpollConnector("", _timeout),
+  m_host(_host),
+  m_port(_port),
+  m_nodelay(true),
+  m_send_buffer_size(0),
+  m_receive_buffer_size(0)
+{
+}
+
+
+void TcpConnector::set_nodelay(bool enable)
+{
+    m_nodelay = enable;
+}
+
+
+bool TcpConnector::nodelay() const
+{
+    return m_nodelay;
+}
+
+
+void TcpConnector::set_send_buffer_size(int bytes)
+{
+    m_send_buffer_size = bytes;
+}
+
+
+int TcpConnector::send_buffer_size() const
+{
+    return m_send_buffer_size;
+}
+
+
+void TcpConnector::set_receive_buffer_size(int bytes)
+{
+    m_receive_buffer_size = bytes;
+}
+
+
+int TcpConnector::receive_buffer_size() const
+{
+    return m_receive_buffer_size;
+}
+
+
+int TcpConnector::open_socket()
+{
+    // Resolve the host
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    char port[6];
+    snprintf(port, sizeof(port), "%u", unsigned(m_port));
+
+    struct addrinfo* addresses;
+    if(getaddrinfo(m_host.c_str(), port, &hints, &addresses) != 0)
+    {
+        return -1;
+    }
+
+    // Try each address in turn
+    int fd = -1;
+    for(struct addrinfo* ai = addresses; ai != 0; ai = ai->ai_next)
+    {
+        fd = ::socket(ai->ai_family,
+                      ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                      ai->ai_protocol);
+        if(fd == -1)
+        {
+            continue;
+        }
+
+        // The buffer sizes must be set before connecting, because they
+        // determine the window scale negotiated in the handshake.
+        if(m_send_buffer_size > 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+                       &m_send_buffer_size, sizeof(m_send_buffer_size));
+        }
+        if(m_receive_buffer_size > 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                       &m_receive_buffer_size, sizeof(m_receive_buffer_size));
+        }
+        int nodelay = m_nodelay ? 1 : 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        // Connect, waiting at most m_timeout milliseconds
+        if(::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            break;
+        }
+        if(errno == EINPROGRESS)
+        {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            int error = ETIMEDOUT;
+            socklen_t len = sizeof(error);
+            if(::poll(&pfd, 1, m_timeout) == 1)
+            {
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            }
+            if(error == 0)
+            {
+                break;
+            }
+        }
+
+        ::close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(addresses);
+    return fd;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _TCP_CONNECTOR_H_
+#define _TCP_CONNECTOR_H_
+
+#include <string>
+
+#include <QtGlobal>
+
+#include "EpollConnector.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \brief Connect to the master agent via TCP.
+     *
+     * RFC 2741 defines TCP port 705 as transport for AgentX. This connector
+     * can be passed to MasterProxy::MasterProxy(Connector*, std::string,
+     * quint8, Oid) to use it:
+     *
+     * \code
+     * TcpConnector* connector = new TcpConnector("127.0.0.1");
+     * connector->set_send_buffer_size(64*1024);
+     * MasterProxy master(connector, "my subagent");
+     * \endcode
+     *
+     * The socket options are applied when the connection is established,
+     * i.e. they must be set before connect() is called (MasterProxy calls
+     * connect() in its constructor, so they must be set before the
+     * MasterProxy is created). The buffer sizes in particular must be known
+     * before connecting, because they determine the TCP window scaling
+     * negotiated with the peer.
+     *
+     * Sending and receiving work exactly as in EpollConnector: several
+     * %PDU's may be in flight at the same time, queued data is written in a
+     * single system call, and the outbound buffer is bounded by the
+     * high-water mark.
+     *
+     * \internal
+     *
+     * The class only overrides EpollConnector::open_socket(). The host name
+     * is resolved with getaddrinfo(3); each returned address is tried in
+     * turn. The connect is done non-blocking and waits at most m_timeout
+     * milliseconds for each address.
+     *
+     * \endinternal
+     */
+    class TcpConnector : public EpollConnector
+    {
+	private:
+	    /**
+	     * \brief The host name or address of the master agent.
+	     */
+	    std::string m_host;
+
+	    /**
+	     * \brief The TCP port of the master agent.
+	     */
+	    quint16 m_port;
+
+	    /**
+	     * \brief Whether TCP_NODELAY is set on the socket.
+	     */
+	    bool m_nodelay;
+
+	    /**
+	     * \brief The SO_SNDBUF size in bytes, or 0 for the system default.
+	     */
+	    int m_send_buffer_size;
+
+	    /**
+	     * \brief The SO_RCVBUF size in bytes, or 0 for the system default.
+	     */
+	    int m_receive_buffer_size;
+
+	protected:
+	    /**
+	     * \brief Create a connected TCP socket.
+	     *
+	     * Resolves m_host, connects to m_port and applies the socket
+	     * options.
+	     *
+	     * \return The socket, or -1 on error.
+	     */
+	    virtual int open_socket();
+
+	public:
+	    /**
+	     * \brief Constructor.
+	     *
+	     * This constructor initializes the connector object to be in
+	     * disconnected state. TCP_NODELAY is enabled by default, because
+	     * AgentX is a request/response protocol with small messages, where
+	     * Nagle's algorithm only adds latency.
+	     *
+	     * \param host The host name or address of the master agent.
+	     *
+	     * \param port The TCP port of the master agent.
+	     *
+	     * \param timeout The timeout, in milliseconds, used for connecting
+	     *                and for sending when the outbound buffer is full.
+	     */
+	    TcpConnector(const std::string& host = "127.0.0.1",
+			 quint16 port = 705,
+			 unsigned timeout = 1000);
+
+	    /**
+	     * \brief Enable or disable TCP_NODELAY.
+	     *
+	     * Takes effect on the next connect().
+	     */
+	    void set_nodelay(bool enable);
+
+	    /**
+	     * \brief Whether TCP_NODELAY is enabled.
+	     */
+	    bool nodelay() const;
+
+	    /**
+	     * \brief Set the socket send buffer size (SO_SNDBUF).
+	     *
+	     * Takes effect on the next connect(). The kernel may adjust the
+	     * value (Linux doubles it).
+	     *
+	     * \param bytes The size in bytes, or 0 for the system default.
+	     */
+	    void set_send_buffer_size(int bytes);
+
+	    /**
+	     * \brief The configured send buffer size.
+	     */
+	    int send_buffer_size() const;
+
+	    /**
+	     * \brief Set the socket receive buffer size (SO_RCVBUF).
+	     *
+	     * Takes effect on the next connect(). The kernel may adjust the
+	     * value (Linux doubles it).
+	     *
+	     * \param bytes The size in bytes, or 0 for the system default.
+	     */
+	    void set_receive_buffer_size(int bytes);
+
+	    /**
+	     * \brief The configured receive buffer size.
+	     */
+	    int receive_buffer_size() const;
+    };
+
+}
+
+#endif  //_TCP_CONNECTOR_H_
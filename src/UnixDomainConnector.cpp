@@ -24,6 +24,7 @@
 #include <QEventLoop>
 #include <QMutexLocker>
 #include <QScopedArrayPointer>
+#include <QElapsedTimer>
 
 #include "util.hpp"
 
@@ -34,17 +35,25 @@ using namespace std;
 UnixDomainConnector::UnixDomainConnector(
         const std::string& _unix_domain_socket,
         unsigned _timeout)
-: QObject(),
+: Connector(),
   m_socket(this),
   m_filename(QString::fromStdString(_unix_domain_socket)),
   m_timeout(_timeout),
-  m_is_connected(false)
+  m_is_connected(false),
+  m_queued_bytes(0),
+  m_socket_bytes(0),
+  m_high_water_mark(256*1024),
+  m_send_scheduled(false)
 {
     // We want to deliver this types within a signal:
     qRegisterMetaType< QSharedPointer<PDU> >("QSharedPointer<PDU>");
     qRegisterMetaType< QSharedPointer<PDU> >("QSharedPointer<PDU>");
 
     QObject::connect(&m_socket, SIGNAL(readyRead()), this, SLOT(do_receive()));
+    QObject::connect(&m_socket, SIGNAL(bytesWritten(qint64)),
+                     this, SLOT(bytes_written(qint64)));
+    QObject::connect(&m_socket, SIGNAL(disconnected()),
+                     this, SLOT(socket_disconnected()));
 }
 
 
@@ -108,6 +117,12 @@ bool UnixDomainConnector::connect()
 
 void UnixDomainConnector::do_disconnect()
 {
+    // Update connection state first, so that socket_disconnected() knows 
+    // that this disconnect is intended
+    m_mutex_is_connected.lock();
+    m_is_connected = false; // Set this to false in any case
+    m_mutex_is_connected.unlock();
+
     // Disconnect
     m_socket.disconnectFromServer();
     if(!m_socket.waitForDisconnected(m_timeout))
@@ -117,9 +132,9 @@ void UnixDomainConnector::do_disconnect()
                 << m_socket.errorString();
     }
 
-    // Update connection state
-    QMutexLocker locker(&m_mutex_is_connected);
-    m_is_connected = false; // Set this to false in any case
+    // Data not yet written or processed is lost
+    clear_outqueue();
+    m_last_header.clear();
 
     // Wake disconnect()
     m_connection_waitcondition.wakeAll();
@@ -145,6 +160,31 @@ bool UnixDomainConnector::is_connected()
     return state;
 }
 
+unsigned long UnixDomainConnector::get_timeout() const
+{
+    return m_timeout;
+}
+
+void UnixDomainConnector::socket_disconnected()
+{
+    {
+        QMutexLocker locker(&m_mutex_is_connected);
+        if( ! m_is_connected )
+        {
+            // do_disconnect() was called
+            return;
+        }
+        m_is_connected = false;
+    }
+
+    // Data not yet written or processed is lost
+    clear_outqueue();
+    m_last_header.clear();
+
+    abort_requests();
+    emit connectionLost();
+}
+
 UnixDomainConnector::~UnixDomainConnector()
 {
 }
@@ -152,11 +192,6 @@ UnixDomainConnector::~UnixDomainConnector()
 
 void UnixDomainConnector::do_receive()
 {
-    // If a header was read from the socket, but the payload did not
-    // yet arrive completely, the read header is stored here until
-    // more data arrived:
-    static binary last_header;
-
     // Read all PDUs into distinct buffers
     std::list<binary> queue;
     do
@@ -164,13 +199,13 @@ void UnixDomainConnector::do_receive()
         binary buf;
 
         // Read header
-        if(last_header.size() != 0)
+        if(m_last_header.size() != 0)
         {
             // Last time, we read a header, but no payload yet.
             // Therefore we don't read the header here, but continue
             // with reading the payload.
-            buf = last_header;
-            last_header.clear();
+            buf = m_last_header;
+            m_last_header.clear();
         }
         else
         {
@@ -179,6 +214,8 @@ void UnixDomainConnector::do_receive()
             if(m_socket.read(header, 20) != 20)
             {
                 disconnect(); // error!
+                abort_requests();
+                emit connectionLost();
                 break; // Stop reading PDUs
             }
             buf.append(reinterpret_cast<quint8*>(header), 20);
@@ -198,6 +235,8 @@ void UnixDomainConnector::do_receive()
             // We don't know where next PDU starts within the byte stream,
             // therefore we disconnect.
             disconnect(); // error!
+            abort_requests();
+            emit connectionLost();
             // stop reading PDU's (but process the ones we got so far)
             break;
         }
@@ -207,7 +246,7 @@ void UnixDomainConnector::do_receive()
         {
             // Payload did not completely arrive. We store the header until
             // more data arrived:
-            last_header = buf;
+            m_last_header = buf;
             break;
         }
         QScopedArrayPointer<char> payload(new char[payload_length]);
@@ -215,6 +254,8 @@ void UnixDomainConnector::do_receive()
         if(bytes_read != payload_length)
         {
             disconnect();
+            abort_requests();
+            emit connectionLost();
             return;
         }
         buf.append(reinterpret_cast<quint8*>(payload.data()), payload_length);
@@ -224,89 +265,204 @@ void UnixDomainConnector::do_receive()
     while(m_socket.bytesAvailable() >= 20); // still enough data for next header
 
     // Process all received PDU's
-    for(list<binary>::const_iterator i = queue.begin(); i != queue.end(); i++)
+    for(list<binary>::iterator i = queue.begin(); i != queue.end(); i++)
     {
-        // Parse PDU
-        QSharedPointer<PDU> pdu;
-        try
-        {
-            pdu = PDU::parse_pdu(*i);
-        }
-        catch(version_error)
+        // Parse PDU. It may keep the buffer (see PDU::parse_pdu()), which 
+        // is therefore moved out of the queue.
+        QSharedPointer<binary> pdu_data(new binary);
+        pdu_data->swap(*i);
+        int error;
+        QSharedPointer<PDU> pdu = PDU::parse_pdu(pdu_data, error);
+        if(error != 0)
         {
             return;
         }
-        catch(parse_error)
+
+        // Deliver it
+        dispatch(pdu);
+    }
+}
+
+
+
+bool UnixDomainConnector::enqueue(const binary& data)
+{
+    if( ! is_connected() )
+    {
+        throw(disconnected());
+    }
+    qint64 buffered = m_queued_bytes + m_socket_bytes;
+    if(buffered != 0 && buffered + qint64(data.size()) > m_high_water_mark)
+    {
+        // Queue is full
+        return false;
+    }
+
+    m_outqueue.push_back(data);
+    m_queued_bytes += data.size();
+
+    // One do_send() flushes all PDU's queued until it runs
+    if( ! m_send_scheduled )
+    {
+        m_send_scheduled = true;
+        QMetaObject::invokeMethod(this, "do_send", Qt::QueuedConnection);
+    }
+
+    return true;
+}
+
+
+
+void UnixDomainConnector::clear_outqueue()
+{
+    QMutexLocker locker(&m_outqueue_mutex);
+
+    m_outqueue.clear();
+    m_queued_bytes = 0;
+    m_socket_bytes = 0;
+    m_outqueue_space.wakeAll();
+
+    // A scheduled do_send() finds the queue empty; m_send_scheduled is 
+    // reset there.
+}
+
+
+
+void UnixDomainConnector::do_send()
+{
+    // Take all queued PDU's and concatenate them
+    binary data;
+    {
+        QMutexLocker locker(&m_outqueue_mutex);
+        m_send_scheduled = false;
+        if(m_outqueue.empty())
         {
+            // Queue was cleared meanwhile
             return;
         }
-
-        // Special case: ResponsePDU's
-        QSharedPointer<ResponsePDU> response;
-        response = qSharedPointerDynamicCast<ResponsePDU>(pdu);
-        if(response)
+        if(m_outqueue.size() == 1)
         {
-            m_response_mutex.lock();
-            // Was a response
-            std::map< quint32, QSharedPointer<ResponsePDU> >::iterator i;
-            i = this->m_responses.find( response->get_packetID() );
-            if(i != this->m_responses.end())
-            {
-                // Someone is waiting for this response
-                i->second = response;
-                m_response_mutex.unlock();
-                m_response_arrived.wakeAll();
-            }
-            else
-            {
-                // Nobody was waiting for the response
-                // -> ignore it
-                m_response_mutex.unlock();
-            }
+            // Avoid copying
+            data.swap(m_outqueue.front());
         }
         else
         {
-            // Was not a Response
-            // -> emit signal
-            emit pduArrived(pdu);
+            data.reserve(m_queued_bytes);
+            std::deque<binary>::const_iterator i;
+            for(i = m_outqueue.begin(); i != m_outqueue.end(); i++)
+            {
+                data.append(*i);
+            }
         }
+        m_outqueue.clear();
+        m_queued_bytes = 0;
+    }
+
+    qint64 written = m_socket.write(reinterpret_cast<const char*>(data.c_str()),
+                                    data.size());
+
+    QMutexLocker locker(&m_outqueue_mutex);
+    if(written > 0)
+    {
+        // Buffered by the socket until bytes_written() is called
+        m_socket_bytes += written;
+    }
+    else
+    {
+        // Not accepted by the socket: space was freed
+        m_outqueue_space.wakeAll();
+    }
+}
+
+
+
+void UnixDomainConnector::bytes_written(qint64 bytes)
+{
+    QMutexLocker locker(&m_outqueue_mutex);
+
+    m_socket_bytes -= bytes;
+    if(m_socket_bytes < 0)
+    {
+        m_socket_bytes = 0;
     }
+    m_outqueue_space.wakeAll();
 }
 
-QSharedPointer<ResponsePDU> UnixDomainConnector::request(QSharedPointer<PDU> pdu)
+
+void UnixDomainConnector::send(QSharedPointer<PDU> pdu)
 {
-    m_response_mutex.lock();
-    m_responses[pdu->get_packetID()] = QSharedPointer<ResponsePDU>();
-    QMetaObject::invokeMethod(this, "do_send", Q_ARG(QSharedPointer<PDU>, pdu));
+    binary data = pdu->serialize();
 
-    std::map<quint32, QSharedPointer<ResponsePDU> >::iterator i;
-    m_responses[pdu->get_packetID()] = QSharedPointer<ResponsePDU>();
-    do
+    QMutexLocker locker(&m_outqueue_mutex);
+    if(enqueue(data))
     {
-        m_response_arrived.wait(&m_response_mutex);
+        return;
     }
-    while ( ! (m_responses[pdu->get_packetID()]) );
 
-    QSharedPointer<ResponsePDU> response = m_responses[pdu->get_packetID()];
-    m_responses.erase(m_responses.find(pdu->get_packetID()));
-    m_response_mutex.unlock();
+    // Queue is full. We must not wait within our own thread, because the 
+    // queue is drained there.
+    if(QThread::currentThread() == thread())
+    {
+        throw(timeout_error());
+    }
 
-    return response;
+    // Wait for space
+    QElapsedTimer timer;
+    timer.start();
+    while( ! enqueue(data) )
+    {
+        qint64 left = qint64(m_timeout) - timer.elapsed();
+        if(left <= 0)
+        {
+            throw(timeout_error());
+        }
+        m_outqueue_space.wait(&m_outqueue_mutex, left);
+    }
 }
 
 
 
-void UnixDomainConnector::do_send(QSharedPointer<PDU> pdu)
+bool UnixDomainConnector::trySend(QSharedPointer<PDU> pdu)
 {
     binary data = pdu->serialize();
 
-    m_socket.write(reinterpret_cast<const char*>(data.c_str()),
-            data.size());
+    QMutexLocker locker(&m_outqueue_mutex);
+    return enqueue(data);
 }
 
 
-void UnixDomainConnector::send(QSharedPointer<PDU> pdu)
+
+void UnixDomainConnector::set_high_water_mark(qint64 bytes)
 {
-    // Start do_disconnect()
-    QMetaObject::invokeMethod(this, "do_send", Q_ARG(QSharedPointer<PDU>, pdu));
+    QMutexLocker locker(&m_outqueue_mutex);
+
+    m_high_water_mark = bytes;
+    m_outqueue_space.wakeAll();
+}
+
+
+
+qint64 UnixDomainConnector::high_water_mark()
+{
+    QMutexLocker locker(&m_outqueue_mutex);
+
+    return m_high_water_mark;
+}
+
+
+
+size_t UnixDomainConnector::queue_depth()
+{
+    QMutexLocker locker(&m_outqueue_mutex);
+
+    return m_outqueue.size();
+}
+
+
+
+qint64 UnixDomainConnector::bytes_buffered()
+{
+    QMutexLocker locker(&m_outqueue_mutex);
+
+    return m_queued_bytes + m_socket_bytes;
 }
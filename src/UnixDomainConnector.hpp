@@ -20,17 +20,16 @@
 #define _UNIX_DOMAIN_CONNECTOR_H_
 
 #include <string>
+#include <deque>
 
 #include <QSharedPointer>
 
-#include <QObject>
 #include <QLocalSocket>
 #include <QWaitCondition>
 #include <QMutex>
 #include <QString>
 
-#include "PDU.hpp"
-#include "ResponsePDU.hpp"
+#include "Connector.hpp"
 
 
 namespace agentxcpp
@@ -40,15 +39,8 @@ namespace agentxcpp
      *
      * \brief Connect to a unix domain socket.
      *
-     * This class connects to a unix domain socket and provides the following 
-     * services:
-     * - Methods to connect and disconnect to the unix domain socket, and
-     *   a method to obtain the current state,
-     * - A QT signal which is emitted when a PDU arrives (with an exception, 
-     *   see below),
-     * - A request service which sends a PDU and then blocks until the 
-     *   corresponding ResponsePDU arrived,
-     * - A send service which just sends a PDU.
+     * This class connects to a unix domain socket and provides the services 
+     * of the Connector interface.
      *
      * An object of this class is intended to run in its own thread, like so:
      * \code
@@ -96,22 +88,38 @@ namespace agentxcpp
      * separately. Sending is done using the do_send() slot, which works for 
      * all types of PDU: all request-PDU's (such as OpenPDU) can be send 
      * without considering special cases, and ResponsePDU's also are no 
-     * exception. Received PDU's are forwarded using the pduArrived() signal to 
-     * whoever is listening, which works for PDU's \e except ResponsePDU's: 
-     * these are the answer to a sent request-PDU and must be routed 
-     * differently.
+     * exception. Received PDU's are passed to Connector::dispatch(), which 
+     * forwards them using the pduArrived() signal, except ResponsePDU's: 
+     * these are the answer to a sent request-PDU and are routed to 
+     * Connector::request().
      *
-     * Received ResponsePDU's are transmitted via the m_responses map. This map 
-     * assigns a packetID a ResponsePDU. Each time a request is sent, do_send() 
-     * adds an entry to the map with the packetID of the request and a NULL 
-     * ResponsePDU (i.e. a NULL pointer). This entry indicates that a 
-     * ResponsePDU with the same packetID is awaited. The do_receive() slot 
-     * then adds the ResponsePDU to the map, when it arrived. However, when a 
-     * ResponsePDU arrives which is \e not awaited, it is discarded.
+     * \par The outbound queue
+     *
+     * %PDU's are serialized by the thread calling send() or trySend() and 
+     * stored in the m_outqueue member. The do_send() slot then takes them 
+     * from the queue and writes them to the socket. The number of bytes 
+     * which are not yet written to the master agent (i.e. which are either 
+     * in m_outqueue or in the internal buffer of m_socket) is limited by a 
+     * high-water mark. If the master agent stalls, send() blocks until 
+     * enough data was written or the timeout expires, while trySend() fails 
+     * immediately. Thus, memory usage is bounded even if many %PDU's are 
+     * sent in bursts (e.g. notifications).
+     *
+     * %PDU's are coalesced: do_send() is only invoked when the first %PDU is 
+     * added to an empty queue (tracked with m_send_scheduled). When it runs, 
+     * it concatenates all queued %PDU's into one buffer and writes them with 
+     * a single call. Thus, %PDU's produced within the same event loop 
+     * iteration of the sending thread (e.g. the responses to pipelined 
+     * requests) are flushed with one system call.
+     *
+     * The m_socket_bytes member tracks the bytes in the buffer of m_socket: 
+     * do_send() increments it, and the bytes_written() slot, which is 
+     * connected to QLocalSocket::bytesWritten(), decrements it. All members 
+     * belonging to the outbound queue are protected by m_outqueue_mutex.
      * 
      * \todo Improve error handling in all functions.
      */
-    class UnixDomainConnector  : public QObject
+    class UnixDomainConnector  : public Connector
     {
         Q_OBJECT
 
@@ -122,6 +130,16 @@ namespace agentxcpp
              */
 	    QLocalSocket m_socket;
 
+            /**
+             * \brief A received header whose payload did not yet arrive.
+             *
+             * If a header was read from the socket, but the payload did not 
+             * yet arrive completely, the header is stored here until more 
+             * data arrived. Only accessed by do_receive() and 
+             * do_disconnect(), i.e. within the connector's thread.
+             */
+            binary m_last_header;
+
             /**
              * \brief The filename of the unix domain socket.
              */
@@ -159,27 +177,67 @@ namespace agentxcpp
             QMutex m_mutex_is_connected;
 
             /**
-             * \brief Storage for ResponsePDU's.
-             *
-             * This map contains entries with packetID as key and 
-             * %ResponsePDU's as values. An entry with a NULL pointer value 
-             * means that a %ResponsePDU with the given packetID is awaited.
+             * \brief Serialized %PDU's waiting to be written to the socket.
+             */
+            std::deque<binary> m_outqueue;
+
+            /**
+             * \brief The total size of the %PDU's in m_outqueue, in bytes.
+             */
+            qint64 m_queued_bytes;
+
+            /**
+             * \brief The number of bytes written to m_socket, but not yet
+             *        to the master agent.
+             */
+            qint64 m_socket_bytes;
+
+            /**
+             * \brief The maximum number of bytes buffered for sending.
+             */
+            qint64 m_high_water_mark;
+
+            /**
+             * \brief Whether do_send() was invoked, but did not yet run.
+             */
+            bool m_send_scheduled;
+
+            /**
+             * \brief Protects the outbound queue members.
+             */
+            QMutex m_outqueue_mutex;
+
+            /**
+             * \brief Triggered when buffered bytes were written.
              *
-             * This member is protected by m_response_mutex.
+             * Used in conjunction with m_outqueue_mutex.
              */
-	    std::map< quint32, QSharedPointer<ResponsePDU> > m_responses;
+            QWaitCondition m_outqueue_space;
 
             /**
-             * \brief Used to protect m_responses and for m_response_arrived.
+             * \brief Enqueue a serialized %PDU if there is enough space.
+             *
+             * If the %PDU fits below the high-water mark, it is appended to 
+             * m_outqueue. do_send() is invoked unless that was already done. 
+             * A %PDU which exceeds the 
+             * high-water mark on its own is accepted if nothing else is 
+             * buffered.
+             *
+             * m_outqueue_mutex must be locked by the caller.
+             *
+             * \return True if the %PDU was enqueued, false if the queue is
+             *         full.
+             *
+             * \exception disconnected If the connector is not connected.
              */
-	    QMutex m_response_mutex;
+            bool enqueue(const binary& data);
 
             /**
-             * \brief A waitcondition to inform waiters of ResponsePDU's.
+             * \brief Discard all buffered data.
              *
-             * The m_response_mutex is used for synchronization.
+             * Called when the connection is lost. Wakes blocked senders.
              */
-	    QWaitCondition m_response_arrived;
+            void clear_outqueue();
 
         private slots:
 
@@ -208,12 +266,35 @@ namespace agentxcpp
             /**
              * \brief Internal slot to send data.
              *
-             * This slot is invoked when data must be sent. It serializes the 
-             * given %PDU and sends it. Errors are ignored.
+             * This slot is invoked when %PDU's were added to the empty 
+             * m_outqueue. It takes all %PDU's from the queue and writes them 
+             * to the socket with a single call. Errors are ignored.
+             *
+             * \note Don't invoke this slot from outside the object!
+             */
+            void do_send();
+
+            /**
+             * \brief Internal slot to track written data.
+             *
+             * This slot is connected to QLocalSocket::bytesWritten(). It 
+             * updates m_socket_bytes and wakes senders waiting for space in 
+             * the outbound queue.
              *
              * \note Don't invoke this slot from outside the object!
              */
-            void do_send(QSharedPointer<PDU> pdu);
+            void bytes_written(qint64 bytes);
+
+            /**
+             * \brief Internal slot to detect a lost connection.
+             *
+             * This slot is connected to QLocalSocket::disconnected(). If the 
+             * disconnect was not requested by do_disconnect(), the state is 
+             * set to 'disconnected' and connectionLost() is emitted.
+             *
+             * \note Don't invoke this slot from outside the object!
+             */
+            void socket_disconnected();
 
             /**
              * \brief Connect to the remote entity.
@@ -257,15 +338,6 @@ namespace agentxcpp
              */
             void do_disconnect();
 
-	signals:
-	    /**
-	     * \brief Emitted when a PDU arrived.
-             *
-             * This signal is emitted once for every arrived PDU, except for 
-             * %ResponsePDU's.
-	     */
-	    void pduArrived(QSharedPointer<PDU>);
-
         public:
             /**
              * \brief Standard constructor.
@@ -305,7 +377,7 @@ namespace agentxcpp
              * \return True on success (i.e. if the object is in connected
              *         state), false otherwise.
              */
-            bool connect();
+            virtual bool connect();
 
             /**
              * \brief Disconnect from the remote entity.
@@ -321,37 +393,96 @@ namespace agentxcpp
              * The object will be in disconnected state after this method, no 
              * matter whether disconnecting times out or not.
              */
-            void disconnect();
+            virtual void disconnect();
 
             /**
 	     * \brief Find out whether the object is currently connected.
 	     *
 	     * \return True if the object is connected, false otherwise.
 	     */
-	    bool is_connected();
+	    virtual bool is_connected();
+
+            /**
+             * \brief Get the timeout of the connector.
+             *
+             * This is the timeout given to the constructor. It is used for
+             * connecting, disconnecting and sending, and by MasterProxy to
+             * wait for the responses of the master agent.
+             *
+             * \return The timeout in milliseconds.
+             */
+	    virtual unsigned long get_timeout() const;
 
             /**
              * \brief Send a %PDU.
              *
-             * This function enqueues a %PDU for sending, by invoking 
-             * do_send(). This means the this function returns before the PDU 
-             * is actually sent.
+             * This function serializes the %PDU and enqueues it for sending, 
+             * by invoking do_send(). This means the this function returns 
+             * before the PDU is actually sent.
+             *
+             * If the outbound queue is full (see set_high_water_mark()), the 
+             * function blocks until enough data was written to the master 
+             * agent, but not longer than the configured timeout. When called 
+             * from the thread of the UnixDomainConnector, it does not block.
              *
              * \note Don't invoke do_send() yourself.
+             *
+             * \exception timeout_error If the outbound queue stays full.
+             *
+             * \exception disconnected If the connector is not connected, or
+             *                         the connection is lost while 
+             *                         waiting for space.
              */
-	    void send(QSharedPointer<PDU> pdu);
+	    virtual void send(QSharedPointer<PDU> pdu);
 
             /**
-             * \brief Send a PDU and wait for the response.
+             * \brief Send a %PDU without blocking.
              *
-             * This method sends a %PDU. Then, it adds an entry to m_responses 
-             * to indicate that a ResponsePDU is awaited. Finally, it waits 
-             * until that ResponsePDU arrives and returns it (it is removed 
-             * from m_responses).
+             * Like send(), but fails immediately if the outbound queue is 
+             * full.
+             *
+             * \return True if the %PDU was enqueued, false if the queue is
+             *         full.
+             *
+             * \exception disconnected If the connector is not connected.
+             */
+            virtual bool trySend(QSharedPointer<PDU> pdu);
+
+            /**
+             * \brief Set the high-water mark of the outbound queue.
+             *
+             * The high-water mark limits the number of bytes which were 
+             * passed to send() or trySend(), but not yet written to the 
+             * master agent. The default is 256 KiB.
+             *
+             * \param bytes The high-water mark in bytes. A single %PDU
+             *              exceeding it is still sent if nothing else is 
+             *              buffered.
+             */
+            virtual void set_high_water_mark(qint64 bytes);
+
+            /**
+             * \brief Get the high-water mark of the outbound queue.
+             */
+            virtual qint64 high_water_mark();
+
+            /**
+             * \brief Get the number of %PDU's waiting in the outbound
+             *        queue.
+             *
+             * %PDU's which were already passed to the socket are not 
+             * counted.
+             */
+            virtual size_t queue_depth();
+
+            /**
+             * \brief Get the number of bytes not yet written to the master
+             *        agent.
              *
-             * \todo Add timeout. Currently, the method does not time out.
+             * This includes the %PDU's in the outbound queue and the data 
+             * buffered within the socket.
              */
-	    QSharedPointer<ResponsePDU> request(QSharedPointer<PDU> pdu);
+            virtual qint64 bytes_buffered();
 
     };
 
@@ -0,0 +1,911 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef AGENTXCPP_HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "UringConnector.hpp"
+
+using namespace agentxcpp;
+using namespace std;
+
+
+#ifdef AGENTXCPP_HAVE_IO_URING
+
+struct agentxcpp::UringRing
+{
+    /**
+     * \brief The io_uring file descriptor.
+     */
+    int fd;
+
+    // Submission queue
+    unsigned sq_entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+
+    /**
+     * \brief The tail including prepared, but unpublished entries.
+     */
+    unsigned sq_local_tail;
+
+    /**
+     * \brief The number of requests whose final completion is pending.
+     *
+     * Incremented by get_sqe() and decremented for each completion without 
+     * IORING_CQE_F_MORE. Accessed atomically.
+     */
+    unsigned pending;
+
+    // Completion queue
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // The mappings
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+
+    // The provided-buffer ring
+    struct io_uring_buf_ring* br;
+    size_t br_size;
+    unsigned short br_tail;
+    quint8* buffers;
+};
+
+namespace
+{
+    /**
+     * \brief user_data of the multishot receive request.
+     */
+    const quint64 tag_recv = ~quint64(0);
+
+    /**
+     * \brief user_data of the request stopping the reader thread.
+     */
+    const quint64 tag_stop = ~quint64(0) - 1;
+
+    /**
+     * \brief user_data of the request cancelling all other requests.
+     */
+    const quint64 tag_cancel = ~quint64(0) - 2;
+
+    /**
+     * \brief The buffer group of the receive buffers.
+     */
+    const unsigned short buffer_group = 0;
+
+    /**
+     * \brief Get a free submission queue entry.
+     *
+     * The entry is cleared and published by submit().
+     *
+     * \return The entry, or NULL if the submission queue is full.
+     */
+    struct io_uring_sqe* get_sqe(UringRing* r);
+
+    /**
+     * \brief Get the number of free submission queue entries.
+     */
+    unsigned sq_space(UringRing* r)
+    {
+        unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        return r->sq_entries - (r->sq_local_tail - head);
+    }
+
+    struct io_uring_sqe* get_sqe(UringRing* r)
+    {
+        if(sq_space(r) == 0)
+        {
+            return 0;
+        }
+        unsigned index = r->sq_local_tail & *r->sq_mask;
+        struct io_uring_sqe* sqe = &r->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        r->sq_array[index] = index;
+        r->sq_local_tail++;
+        __atomic_add_fetch(&r->pending, 1, __ATOMIC_RELAXED);
+        return sqe;
+    }
+
+    /**
+     * \brief Account for a completion.
+     *
+     * Must be called for every completion taken from the completion queue.
+     */
+    void completed(UringRing* r, const struct io_uring_cqe* cqe)
+    {
+        if( ! (cqe->flags & IORING_CQE_F_MORE) )
+        {
+            __atomic_sub_fetch(&r->pending, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    /**
+     * \brief Publish and submit the prepared entries.
+     *
+     * \return False on error.
+     */
+    bool submit(UringRing* r)
+    {
+        unsigned tail = *r->sq_tail;
+        unsigned count = r->sq_local_tail - tail;
+        __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+        while(count != 0)
+        {
+            long ret = syscall(__NR_io_uring_enter, r->fd, count, 0, 0, 0, 0);
+            if(ret < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            count -= ret;
+        }
+        return true;
+    }
+
+    /**
+     * \brief Give a receive buffer (back) to the kernel.
+     */
+    void recycle_buffer(UringRing* r, unsigned short bid,
+                        unsigned count, unsigned size)
+    {
+        // Note: The bufs member of io_uring_buf_ring is declared using 
+        // __DECLARE_FLEX_ARRAY, which places it behind an empty struct when 
+        // compiled as C++. Therefore we compute the address ourselves: the 
+        // buffers start at the beginning of the ring.
+        struct io_uring_buf* bufs =
+                            reinterpret_cast<struct io_uring_buf*>(r->br);
+        struct io_uring_buf* buf = &bufs[r->br_tail & (count - 1)];
+        buf->addr = reinterpret_cast<quint64>(r->buffers + size_t(bid) * size);
+        buf->len = size;
+        buf->bid = bid;
+        r->br_tail++;
+        __atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * \brief Cancel all requests and wait until they completed.
+     *
+     * Afterwards the kernel does not access the receive buffers and the 
+     * buffers of sends anymore. The reader thread must not be running.
+     *
+     * \return False if waiting failed, i.e. requests may still be in 
+     *         flight.
+     */
+    bool cancel_all(UringRing* r)
+    {
+        if(__atomic_load_n(&r->pending, __ATOMIC_RELAXED) == 0)
+        {
+            return true;
+        }
+
+        // If the submission queue is full, the requests complete anyway 
+        // because the socket was shut down.
+        struct io_uring_sqe* sqe = get_sqe(r);
+        if( ! sqe )
+        {
+            submit(r);
+            sqe = get_sqe(r);
+        }
+        if(sqe)
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            sqe->user_data = tag_cancel;
+        }
+        if( ! submit(r) )
+        {
+            return false;
+        }
+
+        // Reap completions until all requests finished
+        while(true)
+        {
+            unsigned head = *r->cq_head;
+            unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+            for(; head != tail; head++)
+            {
+                completed(r, &r->cqes[head & *r->cq_mask]);
+            }
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+            if(__atomic_load_n(&r->pending, __ATOMIC_RELAXED) == 0)
+            {
+                return true;
+            }
+            long ret = syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                               IORING_ENTER_GETEVENTS, 0, 0);
+            if(ret < 0 && errno != EINTR)
+            {
+                return false;
+            }
+        }
+    }
+}
+
+#else // AGENTXCPP_HAVE_IO_URING
+
+struct agentxcpp::UringRing
+{
+};
+
+#endif // AGENTXCPP_HAVE_IO_URING
+
+
+UringConnector::UringConnector(const std::string& _unix_domain_socket,
+                               unsigned _timeout)
+: Connector(),
+  m_filename(_unix_domain_socket),
+  m_timeout(_timeout),
+  m_fd(-1),
+  m_ring(0),
+  m_reader(this),
+  m_next_send(1),
+  m_buffered(0),
+  m_high_water_mark(256*1024)
+{
+    // We want to deliver this types within a signal:
+    qRegisterMetaType< QSharedPointer<PDU> >("QSharedPointer<PDU>");
+}
+
+
+UringConnector::~UringConnector()
+{
+    disconnect();
+}
+
+
+bool UringConnector::setup_ring()
+{
+#ifdef AGENTXCPP_HAVE_IO_URING
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, 64, &p);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    UringRing* r = new UringRing;
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    m_ring = r;
+
+    // Map the rings
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(r->cq_size > r->sq_size)
+        {
+            r->sq_size = r->cq_size;
+        }
+        r->cq_size = r->sq_size;
+    }
+    r->sq_ptr = mmap(0, r->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(r->sq_ptr == MAP_FAILED)
+    {
+        r->sq_ptr = 0;
+        return false;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        r->cq_ptr = r->sq_ptr;
+    }
+    else
+    {
+        r->cq_ptr = mmap(0, r->cq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(r->cq_ptr == MAP_FAILED)
+        {
+            r->cq_ptr = 0;
+            return false;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(0, r->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED)
+    {
+        return false;
+    }
+    r->sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(r->sq_ptr);
+    r->sq_entries = p.sq_entries;
+    r->sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    r->sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    r->sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    r->sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    r->sq_local_tail = *r->sq_tail;
+
+    char* cq = static_cast<char*>(r->cq_ptr);
+    r->cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    r->cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    r->cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    r->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    // Set up the provided-buffer ring (must be page aligned)
+    long page = sysconf(_SC_PAGESIZE);
+    r->br_size = m_buffer_count * sizeof(struct io_uring_buf);
+    r->br_size = (r->br_size + page - 1) / page * page;
+    void* br = mmap(0, r->br_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(br == MAP_FAILED)
+    {
+        return false;
+    }
+    r->br = static_cast<struct io_uring_buf_ring*>(br);
+    r->buffers = new quint8[size_t(m_buffer_count) * m_buffer_size];
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<quint64>(r->br);
+    reg.ring_entries = m_buffer_count;
+    reg.bgid = buffer_group;
+    if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING,
+               &reg, 1) < 0)
+    {
+        return false;
+    }
+    for(unsigned bid = 0; bid < m_buffer_count; bid++)
+    {
+        recycle_buffer(r, bid, m_buffer_count, m_buffer_size);
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void UringConnector::close_ring()
+{
+    // Shut down the socket, so that pending receives and sends terminate.  
+    // No further requests are submitted once m_fd is -1.
+    int fd;
+    {
+        QMutexLocker locker(&m_mutex);
+        fd = m_fd;
+        m_fd = -1;
+    }
+    if(fd != -1)
+    {
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+#ifdef AGENTXCPP_HAVE_IO_URING
+    // Destroy the io_uring instance. Closing the ring would cancel the 
+    // requests only asynchronously, therefore we cancel them and wait for 
+    // their completions before the buffers are released.
+    if(m_ring)
+    {
+        UringRing* r = m_ring;
+        if( ! cancel_all(r) )
+        {
+            // Cannot happen unless io_uring_enter() fails. The kernel may 
+            // still write to the buffers, so we leak them rather than 
+            // freeing them.
+            r->buffers = 0;
+            QMutexLocker locker(&m_mutex);
+            (new std::map<quint64, binary>)->swap(m_inflight);
+        }
+        ::close(r->fd);
+        if(r->sqes)
+        {
+            munmap(r->sqes, r->sqes_size);
+        }
+        if(r->cq_ptr && r->cq_ptr != r->sq_ptr)
+        {
+            munmap(r->cq_ptr, r->cq_size);
+        }
+        if(r->sq_ptr)
+        {
+            munmap(r->sq_ptr, r->sq_size);
+        }
+        if(r->br)
+        {
+            munmap(r->br, r->br_size);
+        }
+        delete[] r->buffers;
+        delete r;
+    }
+#else
+    delete m_ring;
+#endif
+    m_ring = 0;
+    if(fd != -1)
+    {
+        ::close(fd);
+    }
+
+    // Data not yet written is lost
+    QMutexLocker locker(&m_mutex);
+    m_outqueue.clear();
+    m_inflight.clear();
+    m_unsent.clear();
+    m_buffered = 0;
+    m_space.wakeAll();
+}
+
+
+bool UringConnector::connect()
+{
+    QMutexLocker connection_locker(&m_connection_mutex);
+
+    if(is_connected())
+    {
+        return true;
+    }
+
+    // A reader thread which terminated on connection loss
+    m_reader.wait();
+    close_ring();
+
+    // Create and connect the socket
+    struct sockaddr_un addr;
+    if(m_filename.size() >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, m_filename.c_str());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        return false;
+    }
+    if(::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                 sizeof(addr)) == -1)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Set up io_uring
+    if( ! setup_ring() )
+    {
+        ::close(fd);
+        close_ring();
+        return false;
+    }
+    m_inbuf.clear();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_fd = fd;
+        if( ! submit_recv() )
+        {
+            locker.unlock();
+            close_ring();
+            return false;
+        }
+    }
+
+    // Start receiving
+    m_reader.start();
+
+    return true;
+}
+
+
+void UringConnector::disconnect()
+{
+    QMutexLocker connection_locker(&m_connection_mutex);
+
+    if(m_ring)
+    {
+        submit_stop();
+    }
+    m_reader.wait();
+
+    close_ring();
+}
+
+
+bool UringConnector::is_connected()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_fd != -1;
+}
+
+
+unsigned long UringConnector::get_timeout() const
+{
+    return m_timeout;
+}
+
+
+bool UringConnector::submit_recv()
+{
+#ifdef AGENTXCPP_HAVE_IO_URING
+    struct io_uring_sqe* sqe = get_sqe(m_ring);
+    if( ! sqe )
+    {
+        submit(m_ring);
+        sqe = get_sqe(m_ring);
+    }
+    if( ! sqe )
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = m_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffer_group;
+    sqe->user_data = tag_recv;
+
+    return submit(m_ring);
+#else
+    return false;
+#endif
+}
+
+
+void UringConnector::submit_sends()
+{
+#ifdef AGENTXCPP_HAVE_IO_URING
+    if( ! m_inflight.empty() || m_outqueue.empty() || ! m_ring || m_fd == -1 )
+    {
+        return;
+    }
+
+    // All queued PDU's form one chain, as far as the submission queue has 
+    // space (a chain must be submitted at once). One entry is kept free for 
+    // submit_recv() and submit_stop().
+    size_t count = m_outqueue.size();
+    unsigned space = sq_space(m_ring);
+    if(space < 2)
+    {
+        submit(m_ring);
+        space = sq_space(m_ring);
+    }
+    if(space < 2)
+    {
+        // The kernel did not take the entries (io_uring_enter() failed).  
+        // The next send() tries again.
+        return;
+    }
+    if(count > space - 1)
+    {
+        count = space - 1;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        quint64 id = m_next_send++;
+        binary& data = m_inflight[id];
+        data.swap(m_outqueue.front());
+        m_outqueue.pop_front();
+
+        struct io_uring_sqe* sqe = get_sqe(m_ring);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = m_fd;
+        sqe->addr = reinterpret_cast<quint64>(data.data());
+        sqe->len = data.size();
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = id;
+        if(i + 1 < count)
+        {
+            // Execute the next send after this one
+            sqe->flags = IOSQE_IO_LINK;
+        }
+    }
+
+    submit(m_ring);
+#endif
+}
+
+
+bool UringConnector::send_completed(quint64 id, int res)
+{
+    QMutexLocker locker(&m_mutex);
+
+    std::map<quint64, binary>::iterator i = m_inflight.find(id);
+    if(i != m_inflight.end())
+    {
+        binary& data = i->second;
+        if(res >= 0 && size_t(res) < data.size())
+        {
+            // Short send: the sends linked behind it are cancelled. Keep 
+            // the rest.
+            data.erase(0, res);
+            m_unsent.push_back(binary());
+            m_unsent.back().swap(data);
+        }
+        else if(res == -ECANCELED && ! m_unsent.empty())
+        {
+            // Cancelled behind a short send
+            m_unsent.push_back(binary());
+            m_unsent.back().swap(data);
+        }
+        else if(res < 0)
+        {
+            return false;
+        }
+        if(res > 0)
+        {
+            m_buffered -= res;
+            m_space.wakeAll();
+        }
+        m_inflight.erase(i);
+    }
+
+    if(m_inflight.empty())
+    {
+        // Chain finished: send the unsent rests first, then what was 
+        // queued meanwhile
+        m_outqueue.insert(m_outqueue.begin(),
+                          m_unsent.begin(), m_unsent.end());
+        m_unsent.clear();
+        submit_sends();
+    }
+
+    return true;
+}
+
+
+void UringConnector::submit_stop()
+{
+#ifdef AGENTXCPP_HAVE_IO_URING
+    QMutexLocker locker(&m_mutex);
+
+    struct io_uring_sqe* sqe = get_sqe(m_ring);
+    if( ! sqe )
+    {
+        submit(m_ring);
+        sqe = get_sqe(m_ring);
+    }
+    if(sqe)
+    {
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = tag_stop;
+        submit(m_ring);
+    }
+#endif
+}
+
+
+void UringConnector::run()
+{
+#ifdef AGENTXCPP_HAVE_IO_URING
+    UringRing* r = m_ring;
+    bool stop = false;
+    bool lost = false;
+    while( ! stop && ! lost )
+    {
+        // Wait for completions
+        long ret = syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                           IORING_ENTER_GETEVENTS, 0, 0);
+        if(ret < 0 && errno != EINTR)
+        {
+            lost = true;
+            break;
+        }
+
+        // Process them
+        bool received = false;
+        bool rearm = false;
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++)
+        {
+            const struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+            completed(r, cqe);
+            quint64 id = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+
+            if(id == tag_stop)
+            {
+                stop = true;
+            }
+            else if(id == tag_recv)
+            {
+                if(res > 0 && (flags & IORING_CQE_F_BUFFER))
+                {
+                    unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                    m_inbuf.append(r->buffers + size_t(bid) * m_buffer_size,
+                                   res);
+                    recycle_buffer(r, bid, m_buffer_count, m_buffer_size);
+                    received = true;
+                }
+                else if(res == 0 || (res < 0 && res != -ENOBUFS))
+                {
+                    // Closed by the master agent, or error
+                    lost = true;
+                }
+                if( ! (flags & IORING_CQE_F_MORE) )
+                {
+                    // The multishot request terminated (e.g. because all 
+                    // buffers were in use)
+                    rearm = true;
+                }
+            }
+            else
+            {
+                // A send completed
+                if( ! send_completed(id, res) )
+                {
+                    lost = true;
+                }
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+        // Deliver the received PDU's
+        if(received && ! dispatch_buffer(m_inbuf))
+        {
+            lost = true;
+        }
+
+        if(rearm && ! lost && ! stop)
+        {
+            QMutexLocker locker(&m_mutex);
+            if( ! submit_recv() )
+            {
+                lost = true;
+            }
+        }
+    }
+
+    if(lost)
+    {
+        // Connection lost. Mark as disconnected; the io_uring instance is 
+        // destroyed by the next connect() or disconnect().
+        {
+            QMutexLocker locker(&m_mutex);
+            if(m_fd != -1)
+            {
+                ::shutdown(m_fd, SHUT_RDWR);
+                ::close(m_fd);
+                m_fd = -1;
+            }
+            m_outqueue.clear();
+            m_space.wakeAll();
+        }
+        abort_requests();
+        emit connectionLost();
+    }
+#endif
+}
+
+
+bool UringConnector::enqueue(const binary& data)
+{
+    if(m_fd == -1)
+    {
+        throw(disconnected());
+    }
+    if(m_buffered != 0 && m_buffered + qint64(data.size()) > m_high_water_mark)
+    {
+        // Queue is full
+        return false;
+    }
+
+    m_outqueue.push_back(data);
+    m_buffered += data.size();
+    submit_sends();
+
+    return true;
+}
+
+
+void UringConnector::send(QSharedPointer<PDU> pdu)
+{
+    binary data = pdu->serialize();
+
+    QMutexLocker locker(&m_mutex);
+    if(enqueue(data))
+    {
+        return;
+    }
+
+    // Queue is full. We must not wait within the reader thread, because 
+    // the queue is drained there.
+    if(QThread::currentThread() == &m_reader)
+    {
+        throw(timeout_error());
+    }
+
+    // Wait for space
+    QElapsedTimer timer;
+    timer.start();
+    while( ! enqueue(data) )
+    {
+        qint64 left = qint64(m_timeout) - timer.elapsed();
+        if(left <= 0)
+        {
+            throw(timeout_error());
+        }
+        m_space.wait(&m_mutex, left);
+    }
+}
+
+
+bool UringConnector::trySend(QSharedPointer<PDU> pdu)
+{
+    binary data = pdu->serialize();
+
+    QMutexLocker locker(&m_mutex);
+    return enqueue(data);
+}
+
+
+void UringConnector::set_high_water_mark(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_high_water_mark = bytes;
+    m_space.wakeAll();
+}
+
+
+qint64 UringConnector::high_water_mark()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_high_water_mark;
+}
+
+
+size_t UringConnector::queue_depth()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_outqueue.size() + m_inflight.size() + m_unsent.size();
+}
+
+
+qint64 UringConnector::bytes_buffered()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_buffered;
+}
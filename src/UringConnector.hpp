@@ -0,0 +1,361 @@
+/*
+ * Copyright 2011-2016 Tanjeff-Nicolai Moos <tanjeff@cccmz.de>
+ *
+ * This file is part of the agentXcpp library.
+ *
+ * AgentXcpp is free software: you can redistribute it and/or modify
+ * it under the terms of the AgentXcpp library license, version 1, which 
+ * consists of the GNU General Public License and some additional 
+ * permissions.
+ *
+ * AgentXcpp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See the AgentXcpp library license in the LICENSE file of this package 
+ * for more details.
+ */
+#ifndef _URING_CONNECTOR_H_
+#define _URING_CONNECTOR_H_
+
+#include <string>
+#include <deque>
+#include <map>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "Connector.hpp"
+#include "binary.hpp"
+
+
+namespace agentxcpp
+{
+    /**
+     * \internal
+     *
+     * \brief The mapped rings of an io_uring instance.
+     *
+     * Defined in the implementation file, because it depends on the kernel 
+     * headers.
+     */
+    struct UringRing;
+
+    /**
+     * \brief Connect to a unix domain socket using io_uring.
+     *
+     * This connector can be passed to 
+     * MasterProxy::MasterProxy(Connector*, std::string, quint8, Oid) to 
+     * communicate with the master agent via Linux' io_uring interface. 
+     * Receiving needs only one system call per batch of completions, and 
+     * sending one per batch of %PDU's.
+     *
+     * The connector requires Linux 6.0 or newer. It is only functional if 
+     * the library was built with io_uring support (the build system checks 
+     * for it); otherwise connect() always fails.
+     *
+     * \code
+     * MasterProxy master(new UringConnector("/var/agentx/master"),
+     *                    "my subagent");
+     * \endcode
+     *
+     * \internal
+     *
+     * The io_uring instance is set up directly with the io_uring_setup(2), 
+     * io_uring_enter(2) and io_uring_register(2) system calls; liburing is 
+     * not used.
+     *
+     * \par Receiving
+     *
+     * A provided-buffer ring with m_buffer_count buffers of m_buffer_size 
+     * bytes is registered with the kernel. A single multishot receive 
+     * request reads into these buffers and produces one completion per 
+     * chunk of data. The reader thread (see run()) waits for completions, 
+     * appends the data to m_inbuf, returns the buffer to the ring and passes 
+     * complete %PDU's to Connector::dispatch_buffer(). If the kernel 
+     * terminates the multishot request (e.g. because all buffers were in 
+     * use), it is submitted again.
+     *
+     * \par Sending
+     *
+     * send() and trySend() serialize the %PDU in the calling thread and 
+     * append it to m_outqueue. If no send is in flight, all queued %PDU's 
+     * are submitted at once as a chain of linked send requests 
+     * (IOSQE_IO_LINK), so that the kernel executes them in order. The 
+     * buffers are kept in m_inflight until their completion arrived. When 
+     * the last send of a chain completes, the reader thread submits the 
+     * %PDU's queued meanwhile as the next chain. If a send completes short 
+     * (which breaks the chain), the unsent bytes are submitted again with 
+     * the next chain, so that the stream stays intact. The bytes in m_outqueue and 
+     * m_inflight are limited by the high-water mark.
+     *
+     * The submission queue is shared by all threads and protected by 
+     * m_mutex, together with all sending members. The completion queue is 
+     * only accessed by the reader thread.
+     *
+     * \endinternal
+     */
+    class UringConnector : public Connector
+    {
+	private:
+
+            /**
+             * \brief The reader thread.
+             *
+             * Runs UringConnector::run().
+             */
+            class ReaderThread : public QThread
+            {
+                private:
+                    /**
+                     * \brief The connector.
+                     */
+                    UringConnector* m_connector;
+
+                protected:
+                    /**
+                     * \brief The thread function.
+                     */
+                    virtual void run()
+                    {
+                        m_connector->run();
+                    }
+
+                public:
+                    /**
+                     * \brief Constructor.
+                     */
+                    ReaderThread(UringConnector* connector)
+                        : m_connector(connector)
+                    {
+                    }
+            };
+
+            /**
+             * \brief The filename of the unix domain socket.
+             */
+	    std::string m_filename;
+
+	    /**
+	     * \brief The timeout in milliseconds.
+	     */
+	    unsigned m_timeout;
+
+            /**
+             * \brief The socket, or -1 if disconnected.
+             *
+             * Protected by m_mutex.
+             */
+            int m_fd;
+
+            /**
+             * \brief The io_uring instance, or NULL if disconnected.
+             */
+            UringRing* m_ring;
+
+            /**
+             * \brief The reader thread.
+             */
+            ReaderThread m_reader;
+
+            /**
+             * \brief The number of receive buffers (a power of 2).
+             */
+            static const unsigned m_buffer_count = 16;
+
+            /**
+             * \brief The size of each receive buffer.
+             */
+            static const unsigned m_buffer_size = 16*1024;
+
+            /**
+             * \brief Received data which is not yet processed.
+             *
+             * Only accessed by the reader thread.
+             */
+            binary m_inbuf;
+
+            /**
+             * \brief Serialized %PDU's not yet submitted.
+             *
+             * Protected by m_mutex.
+             */
+            std::deque<binary> m_outqueue;
+
+            /**
+             * \brief Submitted %PDU's, by request number.
+             *
+             * The buffers must stay valid until the send request completed. 
+             * Protected by m_mutex.
+             */
+            std::map<quint64, binary> m_inflight;
+
+            /**
+             * \brief The unsent rests of a chain with a short send.
+             *
+             * If a send of a chain completes short, the kernel cancels the 
+             * sends linked behind it. The rest of the short %PDU and the 
+             * cancelled %PDU's are collected here, in order, and queued 
+             * again ahead of m_outqueue when the chain finished. Protected by 
+             * m_mutex.
+             */
+            std::deque<binary> m_unsent;
+
+            /**
+             * \brief The number of the next send request.
+             *
+             * Protected by m_mutex.
+             */
+            quint64 m_next_send;
+
+            /**
+             * \brief The bytes in m_outqueue and m_inflight.
+             *
+             * Protected by m_mutex.
+             */
+            qint64 m_buffered;
+
+            /**
+             * \brief The maximum of m_buffered.
+             *
+             * Protected by m_mutex.
+             */
+            qint64 m_high_water_mark;
+
+            /**
+             * \brief Protects the submission queue and the sending
+             *        members.
+             */
+            QMutex m_mutex;
+
+            /**
+             * \brief Triggered when m_buffered shrinks.
+             *
+             * Used in conjunction with m_mutex.
+             */
+            QWaitCondition m_space;
+
+            /**
+             * \brief Serializes connect() and disconnect().
+             */
+            QMutex m_connection_mutex;
+
+            /**
+             * \brief The reader loop.
+             *
+             * Processes completions until the connection is lost or 
+             * disconnect() submitted a stop request.
+             */
+            void run();
+
+            /**
+             * \brief Set up the io_uring instance and the buffer ring.
+             *
+             * \return False on error (e.g. if the kernel does not support
+             *         the required features).
+             */
+            bool setup_ring();
+
+            /**
+             * \brief Release the io_uring instance and close the socket.
+             *
+             * The socket is shut down and all requests are cancelled. The 
+             * function waits for their completions before it releases the 
+             * buffers, because the kernel may access them until then.
+             *
+             * The reader thread must not be running.
+             */
+            void close_ring();
+
+            /**
+             * \brief Submit a multishot receive request.
+             *
+             * m_mutex must be locked by the caller.
+             */
+            bool submit_recv();
+
+            /**
+             * \brief Submit the queued %PDU's as a chain of linked sends.
+             *
+             * Does nothing if a send is in flight or the queue is empty. 
+             * m_mutex must be locked by the caller.
+             */
+            void submit_sends();
+
+            /**
+             * \brief Process the completion of a send request.
+             *
+             * Releases the buffer of a completed send. The rest of a short 
+             * send and the sends cancelled behind it are kept in m_unsent. 
+             * When the chain finished, the next chain is submitted. Called 
+             * by the reader thread; locks m_mutex.
+             *
+             * \param id The request number of the send.
+             *
+             * \param res The result of the send, i.e. the number of bytes
+             *            sent or a negative error code.
+             *
+             * \return False if the send failed, i.e. the connection is
+             *         lost.
+             */
+            bool send_completed(quint64 id, int res);
+
+            /**
+             * \brief Submit a request which stops the reader thread.
+             */
+            void submit_stop();
+
+            /**
+             * \brief Enqueue a serialized %PDU if there is enough space.
+             *
+             * m_mutex must be locked by the caller.
+             *
+             * \return True if the %PDU was enqueued, false if the queue is
+             *         full.
+             *
+             * \exception disconnected If the connector is not connected.
+             */
+            bool enqueue(const binary& data);
+
+            friend class ReaderThread;
+
+        public:
+            /**
+             * \brief Constructor.
+             *
+             * This constructor initializes the connector object to be in
+             * disconnected state.
+             *
+             * \param unix_domain_socket The path to the unix_domain_socket.
+             *
+             * \param timeout The timeout, in milliseconds, used for sending 
+             *                when the outbound queue is full.
+             */
+            UringConnector(const std::string& unix_domain_socket
+                                              = "/var/agentx/master",
+                           unsigned timeout = 1000);
+
+            /**
+             * \brief Destructor.
+             *
+             * Disconnects.
+             */
+            virtual ~UringConnector();
+
+            virtual bool connect();
+            virtual void disconnect();
+            virtual bool is_connected();
+            virtual unsigned long get_timeout() const;
+	    virtual void send(QSharedPointer<PDU> pdu);
+            virtual bool trySend(QSharedPointer<PDU> pdu);
+            virtual void set_high_water_mark(qint64 bytes);
+            virtual qint64 high_water_mark();
+            virtual size_t queue_depth();
+            virtual qint64 bytes_buffered();
+    };
+
+}
+
+#endif  //_URING_CONNECTOR_H_
@@ -35,26 +35,38 @@ using namespace agentxcpp;
 binary Varbind::serialize() const
 {
     binary serialized;
+    serialize_into(serialized);
+    return serialized;
+}
+
 
+void Varbind::serialize_into(binary& serialized) const
+{
     // encode type
-    serialized.push_back( type << 8 & 0xff );
-    serialized.push_back( type << 0 & 0xff );
+    write16(serialized, type);
     
     // reserved field
-    serialized.push_back( 0 );	// reserved
-    serialized.push_back( 0 );	// reserved
+    write16(serialized, 0);
     
     // encode name
-    serialized += OidVariable(name).serialize();
+    if (encoded_name)
+    {
+	serialized += *encoded_name;
+    }
+    else
+    {
+	OidVariable(name).serialize_into(serialized);
+    }
 
     // encode data if needed
-    if (var) serialized += var->serialize();
-
-    return serialized;
+    QSharedPointer<AbstractVariable> v = get_var();
+    if (v) v->serialize_into(serialized);
 }
 
 
 Varbind::Varbind(const Oid& o, QSharedPointer<AbstractVariable> v)
+    : offset(0),
+      big_endian(true)
 {
     name = o;
     var = v;
@@ -77,7 +89,22 @@ Varbind::Varbind(const Oid& o, QSharedPointer<AbstractVariable> v)
 }
 
 
+Varbind::Varbind(const Oid& o,
+		 const QSharedPointer<const binary>& encoded,
+		 QSharedPointer<AbstractVariable> v)
+    : offset(0),
+      big_endian(true)
+{
+    // Determines the type
+    *this = Varbind(o, v);
+
+    encoded_name = encoded;
+}
+
+
 Varbind::Varbind(const Oid& o, type_t t)
+    : offset(0),
+      big_endian(true)
 {
     name = o;
 
@@ -99,10 +126,38 @@ Varbind::Varbind(const Oid& o, type_t t)
 
 Varbind::Varbind(binary::const_iterator& pos,
 		 const binary::const_iterator& end,
-		 bool big_endian)
+		 bool _big_endian)
+    : offset(0),
+      big_endian(true)
 {
-    quint16 type;
+    // Type and reserved field
+    if(end - pos < 4)
+    {
+	throw(parse_error());
+    }
     
+    // Get type
+    type = read16(pos, _big_endian);
+
+    // skip reserved field
+    pos += 2;
+    
+    // read OID: no exceptions are catched; they are forwarded to the caller
+    name = OidVariable(pos, end, _big_endian).value();
+
+    // Get data: no exceptions are catched; they are forwarded to the caller
+    var = parse_var(type, pos, end, _big_endian);
+}
+
+
+Varbind::Varbind(binary::const_iterator& pos,
+		 const QSharedPointer<const binary>& buf,
+		 bool _big_endian)
+    : offset(0),
+      big_endian(_big_endian)
+{
+    const binary::const_iterator end = buf->end();
+
     // Type and reserved field
     if(end - pos < 4)
     {
@@ -118,7 +173,98 @@ Varbind::Varbind(binary::const_iterator& pos,
     // read OID: no exceptions are catched; they are forwarded to the caller
     name = OidVariable(pos, end, big_endian).value();
 
-    // Get data: no exceptions are catched; they are forwarded to the caller
+    // Check the data, but don't decode it yet
+    binary::const_iterator value = pos;
+    if( ! skip_value(type, pos, end, big_endian) )
+    {
+	throw(parse_error());
+    }
+    if(pos != value)
+    {
+	data = buf;
+	offset = value - buf->begin();
+    }
+}
+
+
+void Varbind::decode() const
+{
+    binary::const_iterator pos = data->begin() + offset;
+    var = parse_var(type, pos, data->end(), big_endian);
+    data.clear();
+}
+
+
+bool Varbind::skip_value(quint16 type,
+			 binary::const_iterator& pos,
+			 const binary::const_iterator& end,
+			 bool big_endian)
+{
+    quint32 size;
+    switch(type)
+    {
+	case 2:	    // Integer
+	case 65:    // Counter32
+	case 66:    // Gauge32
+	case 67:    // TimeTicks
+	    if(end - pos < 4)
+	    {
+		return false;
+	    }
+	    pos += 4;
+	    return true;
+	case 70:    // Counter64
+	    if(end - pos < 8)
+	    {
+		return false;
+	    }
+	    pos += 8;
+	    return true;
+	case 4:	    // OctetString
+	case 68:    // Opaque
+	    return OctetStringVariable::skip(pos, end, big_endian);
+	case 64:    // IpAddress
+	    return OctetStringVariable::skip(pos, end, big_endian, &size)
+		   && size == 4;
+	case 6:	    // Oid
+	    return OidVariable::skip(pos, end);
+	case 5:	    // Null
+	case 128:   // noSuchObject
+	case 129:   // noSuchInstance
+	case 130:   // endOfMibView
+	    return true;
+	default:
+	    return false;
+    }
+}
+
+
+bool Varbind::skip(binary::const_iterator& pos,
+		   const binary::const_iterator& end,
+		   bool big_endian)
+{
+    if(end - pos < 4)
+    {
+	return false;
+    }
+    quint16 type = read16(pos, big_endian);
+    pos += 2;   // reserved
+    if( ! OidVariable::skip(pos, end) )
+    {
+	return false;
+    }
+    return skip_value(type, pos, end, big_endian);
+}
+
+
+QSharedPointer<AbstractVariable> Varbind::parse_var(
+					quint16 type,
+					binary::const_iterator& pos,
+					const binary::const_iterator& end,
+					bool big_endian)
+{
+    QSharedPointer<AbstractVariable> var;
+
     switch(type)
     {
 	case 2:
@@ -158,4 +304,6 @@ Varbind::Varbind(binary::const_iterator& pos,
 	    // invalid type
 	    throw(parse_error());
     }
+
+    return var;
 }
@@ -33,6 +33,13 @@ namespace agentxcpp
      * \internal
      *
      * \brief Represents a VarBind according to RFC 2741, section 5.4.
+     *
+     * A varbind created by the lazy parse constructor decodes its value on 
+     * the first call to get_var() (or serialize()), which modifies the 
+     * object without locking. Such a varbind must therefore be used by 
+     * one thread at a time, even through const member functions and when 
+     * it is copied. The MasterProxy only uses the varbinds of received 
+     * %PDU's in its own thread.
      */
     class Varbind
     {
@@ -46,9 +53,37 @@ namespace agentxcpp
 	     * \brief The variable inside the varbind.
 	     *
 	     * This pointer may be 0 if the varbind has a type without a 
-	     * variable (e.g. "NoSuchObject").
+	     * variable (e.g. "NoSuchObject"), or if the value is not yet 
+	     * decoded (see data). Set by decode() (see the class 
+	     * documentation for thread safety).
+	     */
+	    mutable QSharedPointer<AbstractVariable> var;
+
+	    /**
+	     * \brief The serialized form of the name, if known.
+	     *
+	     * If set, serialize() copies it instead of encoding the name.
 	     */
-	    QSharedPointer<AbstractVariable> var;
+	    QSharedPointer<const binary> encoded_name;
+
+	    /**
+	     * \brief The buffer containing the undecoded value.
+	     *
+	     * Set by the lazy parse constructor. The value is decoded by the 
+	     * first call to get_var(), which then clears this pointer. NULL 
+	     * if the value is decoded (or if there is no value).
+	     */
+	    mutable QSharedPointer<const binary> data;
+
+	    /**
+	     * \brief The position of the undecoded value within data.
+	     */
+	    binary::size_type offset;
+
+	    /**
+	     * \brief Whether the undecoded value is in big endian format.
+	     */
+	    bool big_endian;
 
 	    /**
 	     * \brief The type of the varbind.
@@ -58,6 +93,37 @@ namespace agentxcpp
 	     * varbind.
 	     */
 	    quint16 type;
+
+	    /**
+	     * \brief Decode the value stored in data.
+	     */
+	    void decode() const;
+
+	    /**
+	     * \brief Parse a value of the given type.
+	     *
+	     * \return The variable, or a NULL pointer for types without
+	     *         value.
+	     *
+	     * \exception parse_error If the type is invalid or parsing fails.
+	     */
+	    static QSharedPointer<AbstractVariable> parse_var(
+					    quint16 type,
+					    binary::const_iterator& pos,
+					    const binary::const_iterator& end,
+					    bool big_endian);
+
+	    /**
+	     * \brief Skip a value of the given type.
+	     *
+	     * \return false if the type is invalid or the value is
+	     *         malformed.
+	     */
+	    static bool skip_value(quint16 type,
+				   binary::const_iterator& pos,
+				   const binary::const_iterator& end,
+				   bool big_endian);
+
 	public:
 
 	    /**
@@ -77,6 +143,29 @@ namespace agentxcpp
 	     * thrown.
 	     */
 	    Varbind(const Oid&, QSharedPointer<AbstractVariable> v);
+
+	    /**
+	     * \internal
+	     *
+	     * \brief Create a VarBind with an oid, its serialized form and a
+	     *        var.
+	     *
+	     * Like Varbind(const Oid&, QSharedPointer<AbstractVariable>), but 
+	     * serialize() uses the given serialized form of the name instead 
+	     * of encoding it. This is used for the names of registered 
+	     * variables, which are encoded once.
+	     *
+	     * \param name The name.
+	     *
+	     * \param encoded The name, serialized as described in RFC 2741,
+	     *                section 5.1 (see OidVariable::serialize()). A 
+	     *                NULL pointer is allowed.
+	     *
+	     * \param v The variable.
+	     */
+	    Varbind(const Oid& name,
+		    const QSharedPointer<const binary>& encoded,
+		    QSharedPointer<AbstractVariable> v);
 	    
 	    /**
 	     * \brief These values can be used to create a VarBind.
@@ -125,6 +214,64 @@ namespace agentxcpp
 		    const binary::const_iterator& end,
 		    bool big_endian=true);
 
+	    /**
+	     * \internal
+	     *
+	     * \brief Construct the object from a buffer, decoding the value
+	     *        lazily
+	     *
+	     * Like Varbind(binary::const_iterator&, const 
+	     * binary::const_iterator&, bool), but only the type and the name 
+	     * are decoded. The structure of the value is checked, but the 
+	     * variable object is created by the first call to get_var(). This 
+	     * avoids creating variables which are never looked at, e.g. if a 
+	     * TestSet-PDU is rejected because of an earlier varbind.
+	     *
+	     * The varbind keeps a reference to the buffer until the value is 
+	     * decoded. Copies of an undecoded varbind decode the value 
+	     * independently, i.e. they don't share the variable object.
+	     *
+	     * \param pos Iterator pointing into buf at the varbind. The
+	     *            iterator is advanced behind the varbind.
+	     *
+	     * \param buf The buffer containing the varbind. The end of the
+	     *            buffer marks the end of the stream.
+	     *
+	     * \param big_endian Whether the input stream is in big endian
+	     *                   format
+	     *
+	     * \exception parse_error If parsing fails.
+	     */
+	    Varbind(binary::const_iterator& pos,
+		    const QSharedPointer<const binary>& buf,
+		    bool big_endian=true);
+
+	    /**
+	     * \internal
+	     *
+	     * \brief Skip the serialized form of a varbind.
+	     *
+	     * Checks the structure like the parse constructor does, but 
+	     * without creating any objects.
+	     *
+	     * \param pos Iterator pointing to the varbind. It is advanced
+	     *            behind the varbind on success, and undefined 
+	     *            otherwise.
+	     *
+	     * \param end Iterator pointing one element past the end of the
+	     *            buffer.
+	     *
+	     * \param big_endian Whether the input stream is in big endian
+	     *                   format
+	     *
+	     * \return false if the varbind is malformed.
+	     *
+	     * \exception None.
+	     */
+	    static bool skip(binary::const_iterator& pos,
+			     const binary::const_iterator& end,
+			     bool big_endian=true);
+
             /**
              * \brief Get the name (the OID) stored within the varbind.
              */
@@ -138,9 +285,18 @@ namespace agentxcpp
              *
              * \note This returns a smart pointer to the variable, i.e. the
              *       variable can be modified in-place.
+             *
+             * \note If the varbind was parsed lazily, the first call
+             *       decodes the value. Such a varbind must not be used by 
+             *       several threads at once (see the class 
+             *       documentation).
              */
             QSharedPointer<AbstractVariable> get_var() const
             {
+                if(data)
+                {
+                    decode();
+                }
                 return var;
             }
 
@@ -153,6 +309,17 @@ namespace agentxcpp
 	     */
 	    binary serialize() const;
 
+            /**
+	     * \internal
+	     *
+	     * \brief Serialize the varbind into a buffer.
+	     *
+	     * Appends the binary representation of the varbind to 
+	     * serialized, without temporary strings for the name and the 
+	     * value.
+	     */
+	    void serialize_into(binary& serialized) const;
+
     };
 
 }
@@ -20,7 +20,10 @@
 #ifndef _HELPER_H_
 #define _HELPER_H_
 
+#include <cstring>
+
 #include <QtGlobal>
+#include <QtEndian>
 
 #include "binary.hpp"
 
@@ -80,23 +83,10 @@ namespace agentxcpp
 
     inline quint32 read32(binary::const_iterator& pos, bool big_endian)
     {
-        quint32 value;
-        if( big_endian )
-        {
-            value =  *pos++ << 24;
-            value |= *pos++ << 16;
-            value |= *pos++ << 8;
-            value |= *pos++ << 0;
-        }
-        else
-        {
-            value =  *pos++ << 0;
-            value |= *pos++ << 8;
-            value |= *pos++ << 16;
-            value |= *pos++ << 24;
-        }
-
-        return value;
+        const uchar* src = &*pos;
+        pos += 4;
+        return big_endian ? qFromBigEndian<quint32>(src)
+                          : qFromLittleEndian<quint32>(src);
     }
 
     /**
@@ -109,10 +99,89 @@ namespace agentxcpp
     inline void write32(binary& serialized, quint32 value)
     {
         // always big endian
-        serialized.push_back(value >> 24 & 0xff);
-        serialized.push_back(value >> 16 & 0xff);
-        serialized.push_back(value >> 8 & 0xff);
-        serialized.push_back(value >> 0 & 0xff);
+        uchar bytes[4];
+        qToBigEndian<quint32>(value, bytes);
+        serialized.append(bytes, 4);
+    }
+
+
+    /**
+     * \brief Read an array of 32-bit values from a string
+     *
+     * The values are copied as one block and byte-swapped afterwards only
+     * if the byte order of the data differs from the host byte order. The
+     * swap loop has no branches, so that the compiler can vectorize it.
+     *
+     * \param pos Points to the first value. Is advanced behind the last
+     *            value.
+     *
+     * \param values Receives the values.
+     *
+     * \param count The number of values. The caller must ensure that
+     *              enough data is available.
+     *
+     * \param big_endian The byte order of the data.
+     */
+    inline void read32_array(binary::const_iterator& pos,
+                             quint32* values,
+                             int count,
+                             bool big_endian)
+    {
+        if( count <= 0 )
+        {
+            return;
+        }
+        std::memcpy(values, &*pos, count * 4);
+        pos += count * 4;
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        if( ! big_endian )
+#else
+        if( big_endian )
+#endif
+        {
+            for( int i = 0; i < count; i++ )
+            {
+                values[i] = qbswap(values[i]);
+            }
+        }
+    }
+
+
+    /**
+     * \brief Write an array of 32-bit values into a string
+     *
+     * The string is grown once for all values. On big endian hosts the
+     * values are copied as one block.
+     *
+     * \param serialized The string to which the values are appended.
+     *
+     * \param values The values which are appended to the string.
+     *
+     * \param count The number of values.
+     */
+    inline void write32_array(binary& serialized,
+                              const quint32* values,
+                              int count)
+    {
+        if( count <= 0 )
+        {
+            return;
+        }
+        binary::size_type offset = serialized.size();
+        serialized.resize(offset + count * 4);
+        uchar* dest = &serialized[offset];
+
+        // always big endian
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        std::memcpy(dest, values, count * 4);
+#else
+        for( int i = 0; i < count; i++ )
+        {
+            quint32 value = qbswap(values[i]);
+            std::memcpy(dest + i * 4, &value, 4);
+        }
+#endif
     }
 
     inline quint16 read16(binary::const_iterator& pos, bool big_endian)